@@ -0,0 +1,4 @@
+#!/bin/sh
+printf 'Content-Type: text/plain\r\n\r\n'
+printf 'partial output\n'
+exit 1
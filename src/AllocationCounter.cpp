@@ -0,0 +1,32 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.hpp"
+
+#ifdef COUNT_ALLOCS
+
+static size_t allocations = 0;
+
+static void *countedAlloc(std::size_t size) {
+    ++allocations;
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size) throw(std::bad_alloc) { return countedAlloc(size); }
+void *operator new[](std::size_t size) throw(std::bad_alloc) { return countedAlloc(size); }
+void operator delete(void *ptr) throw() { std::free(ptr); }
+void operator delete[](void *ptr) throw() { std::free(ptr); }
+
+bool AllocationCounter::enabled() { return true; }
+size_t AllocationCounter::count() { return allocations; }
+
+#else
+
+bool AllocationCounter::enabled() { return false; }
+size_t AllocationCounter::count() { return 0; }
+
+#endif
@@ -0,0 +1,10 @@
+#pragma once /* AllocationCounter.hpp */
+
+#include <cstddef>
+
+// Build with `COUNT_ALLOCS=1 make re` to replace the global operator new/delete with counting versions.
+// Without it, count() is always 0.
+namespace AllocationCounter {
+    bool enabled();
+    size_t count(); // number of heap allocations made through operator new so far
+} // namespace AllocationCounter
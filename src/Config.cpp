@@ -101,9 +101,29 @@ static inline void populateDefaultHttpDirectives(Directives &directives) {
     Logger::lastInstance().trace() << "Updating missing http directives" << std::endl;
     Logger::lastInstance().trace3() << "http directives before adding defaults: " << repr(directives) << std::endl;
     addIfNotExists(directives, "autoindex", "off");
+    addIfNotExists(directives, "cgi_timeout", "5s");
+    addIfNotExists(directives, "client_body_buffer_size", "16k");
+    addIfNotExists(directives, "client_body_timeout", "60s");
+    addIfNotExists(directives, "client_header_timeout", "60s");
     addIfNotExists(directives, "client_max_body_size", "1m");
+    addIfNotExists(directives, "gzip", "off");
+    addIfNotExists(directives, "gzip_comp_level", "1");
+    addIfNotExists(directives, "gzip_min_length", "20");
+    addIfNotExists(directives, "gzip_static", "off");
+    addIfNotExists(directives, "gzip_types", "text/html");
     addIfNotExists(directives, "index", "index.html");
+    addIfNotExists(directives, "io_budget", "256k");
+    addIfNotExists(directives, "keepalive_requests", "1000");
+    addIfNotExists(directives, "keepalive_timeout", "75s");
+    addIfNotExists(directives, "multiplex", "poll");
+    addIfNotExists(directives, "open_file_cache", "off");
+    addIfNotExists(directives, "open_file_cache_errors", "off");
+    addIfNotExists(directives, "open_file_cache_min_uses", "1");
+    addIfNotExists(directives, "open_file_cache_valid", "60s");
+    addIfNotExists(directives, "response_cache_max_file_size", "64k");
+    addIfNotExists(directives, "response_cache_size", "0");
     addIfNotExists(directives, "root", "html");
+    addIfNotExists(directives, "send_timeout", "60s");
     addIfNotExists(directives, "upload_dir", "");
     Logger::lastInstance().trace3() << "http directives after adding defaults: " << repr(directives) << std::endl;
 }
@@ -114,7 +134,15 @@ static inline void populateDefaultServerDirectives(Directives &directives, Direc
     Logger::lastInstance().trace3() << "Server " + repr(serverId) << " before adding defaults: " << repr(server) << std::endl;
     takeMultipleFromParentAndAdd(directives, httpDirectives, "index", "index.html");
     takeFromParentOrSet(directives, httpDirectives, "autoindex", "off");
+    takeFromParentOrSet(directives, httpDirectives, "client_body_buffer_size", "16k");
     takeFromParentOrSet(directives, httpDirectives, "client_max_body_size", "1m");
+    takeFromParentOrSet(directives, httpDirectives, "gzip", "off");
+    takeFromParentOrSet(directives, httpDirectives, "gzip_comp_level", "1");
+    takeFromParentOrSet(directives, httpDirectives, "gzip_min_length", "20");
+    takeFromParentOrSet(directives, httpDirectives, "gzip_static", "off");
+    takeFromParentOrSet(directives, httpDirectives, "gzip_types", "text/html");
+    takeFromParentOrSet(directives, httpDirectives, "keepalive_requests", "1000");
+    takeFromParentOrSet(directives, httpDirectives, "keepalive_timeout", "75s");
     takeFromParentOrSet(directives, httpDirectives, "root", "html");
     takeFromParentOrSet(directives, httpDirectives, "upload_dir", "");
 
@@ -134,7 +162,15 @@ static inline void populateDefaultLocationDirectives(Directives &directives, Dir
     Logger::lastInstance().trace3() << "Location block " << repr(locationId) + " before adding defaults: " + repr(location) << std::endl;
     takeMultipleFromParentAndAdd(directives, serverDirectives, "index", "index.html");
     takeFromParentOrSet(directives, serverDirectives, "autoindex", "off");
+    takeFromParentOrSet(directives, serverDirectives, "client_body_buffer_size", "16k");
     takeFromParentOrSet(directives, serverDirectives, "client_max_body_size", "1m");
+    takeFromParentOrSet(directives, serverDirectives, "gzip", "off");
+    takeFromParentOrSet(directives, serverDirectives, "gzip_comp_level", "1");
+    takeFromParentOrSet(directives, serverDirectives, "gzip_min_length", "20");
+    takeFromParentOrSet(directives, serverDirectives, "gzip_static", "off");
+    takeFromParentOrSet(directives, serverDirectives, "gzip_types", "text/html");
+    takeFromParentOrSet(directives, serverDirectives, "keepalive_requests", "1000");
+    takeFromParentOrSet(directives, serverDirectives, "keepalive_timeout", "75s");
     takeFromParentOrSet(directives, serverDirectives, "root", "html");
     takeFromParentOrSet(directives, serverDirectives, "upload_dir", "");
 
@@ -16,6 +16,8 @@
     "standard errro.\n"                                                                                                                    \
     "    -T: Same as `-t`, but additionally dump the configuration file to standard "                                                      \
     "output.\n"                                                                                                                            \
+    "    -m METHOD: Use I/O multiplexing method METHOD, overriding the multiplex "                                                         \
+    "directive. Supported methods are poll, epoll, epoll_et (edge-triggered epoll) and io_uring.\n"                                        \
     "    -v: Print version information.\n"                                                                                                 \
     "    -h: Print help information.\n"
 
@@ -26,10 +28,15 @@ namespace Constants {
     const size_t loggingMaxStringLen = 50;
     const size_t clientMaxRequestLineSize = 8196;
     const size_t clientMaxRequestSizeWithoutBody = 16384;
+    const size_t clientMaxPipelinedSize = 65536; // bytes buffered behind a request whose response is still being produced or sent
     const size_t cgiMaxResponseSizeWithoutBody = 8196;
     const size_t cgiMaxResponseBodySize = 1L * 10 * 1024 * 1024 * 1024;
-    const int cgiTimeout = 5;
-    const int multiplexTimeout = 1000; // in milliseconds
+    const int epollMaxEvents = 1024;      // max number of events returned by a single epoll_wait()
+    const size_t acceptBatchSize = 64;    // max number of connections accepted per readiness event of a listening socket
+    const unsigned ioUringEntries = 1024; // size of the io_uring submission queue (the completion queue is twice as big)
+    const unsigned ioUringBuffers = 256;  // number of chunk-sized buffers io_uring receives client data into, a power of two
+    const size_t maxFds = 65536;          // upper bound for the connection table, RLIMIT_NOFILE is lowered to this
+    const size_t maxRanges = 16;          // Range headers asking for more ranges are ignored, the whole file is sent instead
     const size_t chunkSize = CONSTANTS_CHUNK_SIZE;
     const char commentSymbol = '#';
     const int highestPort = 65535;
@@ -41,5 +48,7 @@ namespace Constants {
     const string &webservVersion = "0.2";
     const string &helpText = HELP_TEXT;
     const string &defaultClientMaxBodySize = "1m"; // k=Kibibyte, m=Mibibyte, g=Gibibyte
+    const string &defaultClientBodyBufferSize = "16k";
+    const string &clientBodyTempPath = "/tmp"; // where request bodies beyond client_body_buffer_size are spooled
     enum MultPlexType defaultMultPlexType = POLL;
 } // namespace Constants
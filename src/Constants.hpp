@@ -4,6 +4,7 @@
 #include <string>
 
 #define CONSTANTS_CHUNK_SIZE 4096
+#define CONSTANTS_MAX_IOVECS 64 // max number of buffers handed to a single writev()
 
 #ifndef STRICT_EVAL
 #define STRICT_EVAL true
@@ -24,10 +25,15 @@ namespace Constants {
     extern const size_t loggingMaxStringLen;
     extern const size_t clientMaxRequestLineSize;
     extern const size_t clientMaxRequestSizeWithoutBody;
+    extern const size_t clientMaxPipelinedSize;
     extern const size_t cgiMaxResponseSizeWithoutBody;
     extern const size_t cgiMaxResponseBodySize;
-    extern const int cgiTimeout;
-    extern const int multiplexTimeout;
+    extern const int epollMaxEvents;
+    extern const size_t acceptBatchSize;
+    extern const unsigned ioUringEntries;
+    extern const unsigned ioUringBuffers;
+    extern const size_t maxFds;
+    extern const size_t maxRanges;
     extern const size_t chunkSize;
     extern const char commentSymbol;
     extern const int logLevel;
@@ -43,5 +49,7 @@ namespace Constants {
     extern const string &webservVersion;
     extern const string &helpText;
     extern const string &defaultClientMaxBodySize;
-    extern enum MultPlexType { SELECT, POLL, EPOLL } defaultMultPlexType;
+    extern const string &defaultClientBodyBufferSize;
+    extern const string &clientBodyTempPath;
+    extern enum MultPlexType { SELECT, POLL, EPOLL, IO_URING } defaultMultPlexType;
 } // namespace Constants
@@ -184,6 +184,29 @@ static inline void ensureValidSize(const string &ctx, const string &directive, c
     throw runtime_error(Errors::Config::DirectiveInvalidSizeArgument(ctx, directive, argument));
 }
 
+static inline void ensureNumeric(const string &ctx, const string &directive, const string &argument) {
+    ensureNotEmpty(ctx, directive, argument);
+    string::const_iterator c = argument.begin();
+    while (c != argument.end() && std::isdigit(*c))
+        ++c;
+    if (c == argument.end())
+        return;
+    throw runtime_error(Errors::Config::DirectiveArgumentNotNumeric(ctx, directive, argument));
+}
+
+// seconds, optionally suffixed with s, m, h or d like in nginx (but no combinations like 1h30m)
+static inline void ensureValidTime(const string &ctx, const string &directive, const string &argument) {
+    ensureNotEmpty(ctx, directive, argument);
+    string::const_iterator c = argument.begin();
+    while (c != argument.end() && std::isdigit(*c))
+        ++c;
+    if (c == argument.end())
+        return;
+    if (c != argument.begin() && std::strchr("smhd", std::tolower(*c)) && c + 1 == argument.end())
+        return;
+    throw runtime_error(Errors::Config::DirectiveInvalidTimeArgument(ctx, directive, argument));
+}
+
 static inline void ensureOnOff(const string &ctx, const string &directive, string &argument) {
     if (argument == "on" || argument == "yes" || argument == "true") {
         argument = "on";
@@ -307,6 +330,16 @@ static inline bool checkClientMaxBodySize(const string &ctx, const string &direc
     return false;
 }
 
+// bodies up to this size are kept in memory, bigger ones are spooled to a temporary file
+static inline bool checkClientBodyBufferSize(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "client_body_buffer_size") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidSize(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
 static inline bool checkLimitExcept(const string &ctx, const string &directive, const Arguments &arguments) {
     if (directive == "limit_except") {
         ensureArity(ctx, directive, arguments, 1, -1);
@@ -350,6 +383,42 @@ static inline bool checkAutoindex(const string &ctx, const string &directive, Ar
     return false;
 }
 
+static inline bool checkGzip(const string &ctx, const string &directive, Arguments &arguments) {
+    if (directive == "gzip") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureOnOff(ctx, directive, arguments[0]);
+        return true;
+    }
+    if (directive == "gzip_comp_level") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureOneOfStrings(ctx, directive, arguments[0], VEC(string, "1", "2", "3", "4", "5", "6", "7", "8", "9"));
+        return true;
+    }
+    if (directive == "gzip_min_length") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidSize(ctx, directive, arguments[0]);
+        return true;
+    }
+    if (directive == "gzip_types") { // MIME types besides text/html, * for all of them
+        ensureArity(ctx, directive, arguments, 1, -1);
+        for (Arguments::iterator type = arguments.begin(); type != arguments.end(); ++type)
+            *type = Utils::strToLower(*type);
+        return true;
+    }
+    return false;
+}
+
+// on, off or always (send file.gz even to clients that don't accept gzip) like in nginx
+static inline bool checkGzipStatic(const string &ctx, const string &directive, Arguments &arguments) {
+    if (directive == "gzip_static") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        if (arguments[0] != "always")
+            ensureOnOff(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
 static inline bool checkErrorPage(const string &ctx, const string &directive, const Arguments &arguments) {
     if (directive == "error_page") {
         ensureArity(ctx, directive, arguments, 2, -1);
@@ -393,6 +462,101 @@ static inline bool checkUploadDir(const string &ctx, const string &directive, co
     return false;
 }
 
+static inline bool checkIoBudget(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "io_budget") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidSize(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
+static inline bool checkTimeout(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "cgi_timeout" || directive == "client_body_timeout" || directive == "client_header_timeout" ||
+        directive == "send_timeout") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidTime(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
+static inline bool checkKeepaliveTimeout(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "keepalive_timeout") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidTime(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
+static inline bool checkKeepaliveRequests(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "keepalive_requests") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureNumeric(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
+// off or max=N [inactive=time] like in nginx
+static inline bool checkOpenFileCache(const string &ctx, const string &directive, Arguments &arguments) {
+    if (directive == "open_file_cache") {
+        ensureArity(ctx, directive, arguments, 1, 2);
+        if (arguments.size() == 1 && arguments[0] == "off")
+            return true;
+        bool hasMax = false, hasInactive = false;
+        for (Arguments::const_iterator arg = arguments.begin(); arg != arguments.end(); ++arg) {
+            if (arg->compare(0, 4, "max=") == 0 && !hasMax) {
+                ensureNumeric(ctx, directive, arg->substr(4));
+                hasMax = std::atol(arg->c_str() + 4) > 0;
+            } else if (arg->compare(0, 9, "inactive=") == 0 && !hasInactive) {
+                ensureValidTime(ctx, directive, arg->substr(9));
+                hasInactive = true;
+            } else
+                throw runtime_error(
+                    Errors::Config::InvalidDirectiveArgument(ctx, directive, *arg, VEC(string, "off", "max=N", "inactive=time")));
+        }
+        if (!hasMax)
+            throw runtime_error(Errors::Config::InvalidDirectiveArgument(ctx, directive, arguments[0], VEC(string, "off", "max=N")));
+        return true;
+    }
+    if (directive == "open_file_cache_errors") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureOnOff(ctx, directive, arguments[0]);
+        return true;
+    }
+    if (directive == "open_file_cache_min_uses") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureNumeric(ctx, directive, arguments[0]);
+        return true;
+    }
+    if (directive == "open_file_cache_valid") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidTime(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
+static inline bool checkResponseCache(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "response_cache_size" || directive == "response_cache_max_file_size") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureValidSize(ctx, directive, arguments[0]);
+        return true;
+    }
+    return false;
+}
+
+static inline bool checkMultiplex(const string &ctx, const string &directive, const Arguments &arguments) {
+    if (directive == "multiplex") {
+        ensureArity(ctx, directive, arguments, 1, 1);
+        ensureOneOfStrings(ctx, directive, arguments[0], VEC(string, "poll", "epoll", "epoll_et", "io_uring"));
+        return true;
+    }
+    return false;
+}
+
 static void checkHttpDirectives(Directives &directives) {
     map<string, unsigned int> counts;
     for (Directives::iterator kv = directives.begin(); kv != directives.end(); ++kv) {
@@ -401,10 +565,20 @@ static void checkHttpDirectives(Directives &directives) {
         CHECKFN("http", checkAutoindex);
         CHECKFN("http", checkCgiDir);
         CHECKFN_MULTI("http", checkCgiExt);
+        CHECKFN("http", checkClientBodyBufferSize);
         CHECKFN("http", checkClientMaxBodySize);
         CHECKFN_MULTI("http", checkErrorPage);
+        CHECKFN("http", checkGzip);
+        CHECKFN("http", checkGzipStatic);
         CHECKFN_MULTI("http", checkIndex);
+        CHECKFN("http", checkIoBudget);
+        CHECKFN("http", checkKeepaliveRequests);
+        CHECKFN("http", checkKeepaliveTimeout);
+        CHECKFN("http", checkMultiplex);
+        CHECKFN("http", checkOpenFileCache);
+        CHECKFN("http", checkResponseCache);
         CHECKFN("http", checkRoot);
+        CHECKFN("http", checkTimeout);
         CHECKFN("http", checkUploadDir);
         if (counts[directive] > 1)
             throw runtime_error(Errors::Config::DirectiveNotUnique("http", directive));
@@ -420,9 +594,14 @@ static void checkServerDirectives(Directives &directives) {
         CHECKFN("server", checkAutoindex);
         CHECKFN("server", checkCgiDir);
         CHECKFN_MULTI("server", checkCgiExt);
+        CHECKFN("server", checkClientBodyBufferSize);
         CHECKFN("server", checkClientMaxBodySize);
         CHECKFN_MULTI("server", checkErrorPage);
+        CHECKFN("server", checkGzip);
+        CHECKFN("server", checkGzipStatic);
         CHECKFN_MULTI("server", checkIndex);
+        CHECKFN("server", checkKeepaliveRequests);
+        CHECKFN("server", checkKeepaliveTimeout);
         CHECKFN("server", checkListen);
         CHECKFN("server", checkRoot);
         CHECKFN("server", checkServerName);
@@ -442,9 +621,14 @@ static void checkLocationDirectives(Directives &directives) {
         CHECKFN("location", checkAutoindex);
         CHECKFN("location", checkCgiDir);
         CHECKFN_MULTI("location", checkCgiExt);
+        CHECKFN("location", checkClientBodyBufferSize);
         CHECKFN("location", checkClientMaxBodySize);
         CHECKFN_MULTI("location", checkErrorPage);
+        CHECKFN("location", checkGzip);
+        CHECKFN("location", checkGzipStatic);
         CHECKFN_MULTI("location", checkIndex);
+        CHECKFN("location", checkKeepaliveRequests);
+        CHECKFN("location", checkKeepaliveTimeout);
         CHECKFN("location", checkLimitExcept);
         CHECKFN("location", checkReturn);
         CHECKFN("location", checkRoot);
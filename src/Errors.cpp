@@ -82,6 +82,10 @@ const string Errors::Config::DirectiveInvalidSizeArgument(const string &ctx, con
     return CONFIG_ERROR_PREFIX(ctx) + "Size argument " + repr(argument) + " for directive " + repr(directive) + " is invalid";
 }
 
+const string Errors::Config::DirectiveInvalidTimeArgument(const string &ctx, const string &directive, const string &argument) {
+    return CONFIG_ERROR_PREFIX(ctx) + "Time argument " + repr(argument) + " for directive " + repr(directive) + " is invalid";
+}
+
 const string Errors::Config::DirectiveInvalidStatusCodeArgument(const string &ctx, const string &directive, const string &argument) {
     return CONFIG_ERROR_PREFIX(ctx) + "Status code argument " + repr(argument) + " for directive " + repr(directive) + " is invalid";
 }
@@ -26,6 +26,7 @@ namespace Errors {
         const string DirectiveInvalidBooleanArgument(const string &ctx, const string &directive, const string &argument);
         const string DirectiveInvalidIpAddressArgument(const string &ctx, const string &directive, const string &argument);
         const string DirectiveInvalidSizeArgument(const string &ctx, const string &directive, const string &argument);
+        const string DirectiveInvalidTimeArgument(const string &ctx, const string &directive, const string &argument);
         const string DirectiveInvalidStatusCodeArgument(const string &ctx, const string &directive, const string &argument);
         const string InvalidDirectiveArgument(const string &ctx, const string &directive, const string &argument, const Arguments &options);
         const string InvalidDirectiveArgumentCount(const string &ctx, const string &directive, int count, int min, int max);
@@ -1,9 +1,10 @@
 #include <cerrno>
-
 #include <cstring>
+#include <ctime>
 #include <netinet/in.h>
 #include <ostream>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -16,53 +17,127 @@
 #include "Utils.hpp"
 
 using Constants::EPOLL;
+using Constants::IO_URING;
 using Constants::POLL;
 using Constants::SELECT;
 
-void HttpServer::addClientSocketToPollFds(MultPlexFds &monitorFds, int clientSocket) {
+void HttpServer::addFdToPollFds(MultPlexFds &monitorFds, int fd, short events) {
     struct pollfd pfd;
-    pfd.fd = clientSocket;
-    pfd.events = POLLIN | POLLOUT;
+    pfd.fd = fd;
+    pfd.events = events;
     pfd.revents = 0;
     log.debug() << "Adding pollfd " << pfd << " to monitoring FDs" << std::endl;
-    if (std::find(_monitorFds.pollFds.begin(), _monitorFds.pollFds.end(), pfd) != _monitorFds.pollFds.end())
+    Connection &c = conn(fd);
+    if (c.pollIndex < monitorFds.pollFds.size() && monitorFds.pollFds[c.pollIndex].fd == fd)
         log.error() << "ERROR3: pushing a pollfd " << repr(pfd.fd) << " that is already in the monitoring fds: " << repr(pfd) << std::endl;
+    c.pollIndex = monitorFds.pollFds.size();
     monitorFds.pollFds.push_back(pfd);
 }
 
-void HttpServer::addClientSocketToMonitorFds(MultPlexFds &monitorFds, int clientSocket) {
+void HttpServer::addFdToEpollFds(MultPlexFds &monitorFds, int fd, short events) {
+    struct epoll_event ev;
+    ev.events = pollEventsToEpollEvents(events, monitorFds.edgeTriggered);
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    log.debug() << "Adding epoll_event " << repr(ev) << " to monitoring FDs" << std::endl;
+    if (static_cast<size_t>(fd) >= monitorFds.epollRegs.size())
+        monitorFds.epollRegs.resize(static_cast<size_t>(fd) + 1, 0);
+    if (monitorFds.epollRegs[static_cast<size_t>(fd)] != 0)
+        log.error() << "ERROR3: adding an epoll_event " << repr(fd) << " that is already in the monitoring fds: " << repr(ev) << std::endl;
+    if (::epoll_ctl(monitorFds.epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        log.error() << "Error calling " << func("epoll_ctl") << punct("()") << " with " << num("EPOLL_CTL_ADD") << " on FD " << repr(fd)
+                    << ": " << ::strerror(errno) << std::endl;
+        return;
+    }
+    monitorFds.epollRegs[static_cast<size_t>(fd)] = ev.events;
+}
+
+void HttpServer::addFdToIoUringFds(MultPlexFds &monitorFds, int fd, short events) {
+    log.debug() << "Adding FD " << repr(fd) << " with poll events " << repr(pollevents_helper(events)) << " to the io_uring monitoring FDs"
+                << std::endl;
+    if (static_cast<size_t>(fd) >= monitorFds.uringRegs.size())
+        monitorFds.uringRegs.resize(static_cast<size_t>(fd) + 1);
+    UringReg &reg = monitorFds.uringRegs[static_cast<size_t>(fd)];
+    if (reg.events != 0)
+        log.error() << "ERROR3: adding FD " << repr(fd) << " that is already in the io_uring monitoring fds: " << repr(reg) << std::endl;
+    reg.events = static_cast<uint32_t>(static_cast<unsigned short>(events));
+    ConnectionKind kind = conn(fd).kind;
+    reg.input = kind == CONN_LISTENING ? URING_ACCEPT : kind == CONN_CLIENT ? URING_RECV : URING_POLL;
+    armIoUringPoll(monitorFds, fd);
+    armIoUringInput(monitorFds, fd);
+}
+
+void HttpServer::addFdToMonitorFds(MultPlexFds &monitorFds, int fd, short events) {
     switch (monitorFds.multPlexType) {
     case SELECT:
         throw std::logic_error("Adding select type FDs not implemented yet");
         break;
     case POLL:
-        addClientSocketToPollFds(monitorFds, clientSocket);
+        addFdToPollFds(monitorFds, fd, events);
         break;
     case EPOLL:
-        throw std::logic_error("Adding epoll type FDs not implemented yet");
+        addFdToEpollFds(monitorFds, fd, events);
+        break;
+    case IO_URING:
+        addFdToIoUringFds(monitorFds, fd, events);
         break;
     default:
         throw std::logic_error("Adding unknown type of fd not implemented");
     }
 }
 
-void HttpServer::addNewClient(int listeningSocket) {
+void HttpServer::addClientSocketToMonitorFds(MultPlexFds &monitorFds, int clientSocket) {
+    addFdToMonitorFds(monitorFds, clientSocket, POLLIN | POLLOUT);
+}
+
+// returns whether there might be more connections waiting to be accepted
+bool HttpServer::addNewClient(int listeningSocket) {
     struct sockaddr_in clientAddr;
     socklen_t clientLen = sizeof(clientAddr);
 
-    log.debug() << "Calling " << func("accept") << punct("()") << " on socket " << repr(listeningSocket) << std::endl;
-    int clientSocket = ::accept(listeningSocket, reinterpret_cast<struct sockaddr *>(&clientAddr), &clientLen);
+    log.debug() << "Calling " << func("accept4") << punct("()") << " on socket " << repr(listeningSocket) << std::endl;
+    int clientSocket =
+        ::accept4(listeningSocket, reinterpret_cast<struct sockaddr *>(&clientAddr), &clientLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
     log.debug() << "Got client socket FD back: " << repr(clientSocket) << std::endl;
     if (clientSocket < 0) {
-        log.error() << "Error calling " << func("accept") << punct("()") << ": " << ::strerror(errno) << std::endl;
-        return; // don't add client on this kind of failure
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            log.debug() << "No more pending connections on listening socket " << repr(listeningSocket) << std::endl;
+            return false;
+        }
+        log.error() << "Error calling " << func("accept4") << punct("()") << ": " << ::strerror(errno) << std::endl;
+        return false; // don't add client on this kind of failure
     }
 
-    addClientSocketToMonitorFds(_monitorFds, clientSocket);
-    if (!persistConns.insert(std::make_pair(clientSocket, std::time(NULL))).second) {
-        log.error() << "New client socket " << repr(clientSocket) << " is already in persistent connections map, this should never happen"
-                    << std::endl;
+    registerClient(clientSocket, clientAddr);
+    return true;
+}
+
+// a connection accepted by the multishot accept request of a listening socket (io_uring)
+void HttpServer::addAcceptedClient(int listeningSocket, const struct io_uring_cqe &cqe) {
+    if (cqe.res < 0) {
+        log.error() << "Error accepting a connection on listening socket " << repr(listeningSocket)
+                    << " with io_uring: " << ::strerror(-cqe.res) << std::endl;
+        return;
     }
+    int clientSocket = cqe.res;
+    log.debug() << "io_uring accepted client socket FD " << repr(clientSocket) << " on listening socket " << repr(listeningSocket)
+                << std::endl;
+    struct sockaddr_in clientAddr;
+    std::memset(&clientAddr, 0, sizeof(clientAddr));
+    socklen_t clientLen = sizeof(clientAddr);
+    if (log.isinfo()) // multishot accept can't report the peer address, it's only needed for the log
+        (void)::getpeername(clientSocket, reinterpret_cast<struct sockaddr *>(&clientAddr), &clientLen);
+    registerClient(clientSocket, clientAddr);
+}
+
+void HttpServer::registerClient(int clientSocket, const struct sockaddr_in &clientAddr) {
+    resetConnection(clientSocket, CONN_CLIENT);
+    Connection &c = conn(clientSocket);
+    c.persistent = true;
+    c.connectedSince = std::time(NULL);
+    c.keepAliveTimeout = _keepAliveTimeout;
+    addClientSocketToMonitorFds(_monitorFds, clientSocket);
+    armTimer(clientSocket, TIMER_HEADER);
     log.info();
     if (!ansi::noColor())
         log.info << ANSI_BLACK ANSI_GREEN_BG;
@@ -0,0 +1,267 @@
+#include <cstddef>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BYTESCAN_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#include "ByteScan.hpp"
+
+using std::string;
+
+// scalar versions, also used for the bytes behind the last full vector
+
+static inline bool stopsLine(unsigned char c) { return (c < 0x20 && c != '\t') || c == 0x7f; }
+
+static inline bool isTchar(unsigned char c) {
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+        return true;
+    switch (c) {
+    case '!': case '#': case '$': case '%': case '&': case '\'': case '*': case '+': case '-': case '.': case '^': case '_': case '`':
+    case '|': case '~':
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline bool isUriSpecial(unsigned char c) { return c == '%' || c <= 0x20 || c >= 0x7f; }
+
+static size_t findLineStopScalar(const char *data, size_t size) {
+    size_t i = 0;
+    while (i < size && !stopsLine(static_cast<unsigned char>(data[i])))
+        ++i;
+    return i;
+}
+
+static size_t lowerTokenScalar(const char *data, size_t size, char *out) {
+    size_t stop = size;
+    for (size_t i = 0; i < size; ++i) {
+        char c = data[i];
+        if (stop == size && !isTchar(static_cast<unsigned char>(c)))
+            stop = i;
+        out[i] = c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+    }
+    return stop;
+}
+
+static size_t findUriSpecialScalar(const char *data, size_t size) {
+    size_t i = 0;
+    while (i < size && !isUriSpecial(static_cast<unsigned char>(data[i])))
+        ++i;
+    return i;
+}
+
+// The vector versions compare signed bytes, bytes from 0x80 on are negative and thus below every ASCII range. The separators that
+// aren't tchars are ", (), ",", "/", ":;<=>?@", "[\]", "{" and "}".
+
+#if defined(__SSE2__)
+static inline __m128i byte16(int c) { return _mm_set1_epi8(static_cast<char>(c)); }
+
+static inline __m128i inRange16(__m128i v, int low, int high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, byte16(low - 1)), _mm_cmpgt_epi8(byte16(high + 1), v));
+}
+
+static inline __m128i notTchar16(__m128i v) {
+    __m128i bad = _mm_cmpeq_epi8(inRange16(v, 0x21, 0x7e), _mm_setzero_si128());
+    bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpeq_epi8(v, byte16('"')), _mm_cmpeq_epi8(v, byte16(','))));
+    bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpeq_epi8(v, byte16('/')), _mm_cmpeq_epi8(v, byte16('{'))));
+    bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpeq_epi8(v, byte16('}')), inRange16(v, '(', ')')));
+    return _mm_or_si128(bad, _mm_or_si128(inRange16(v, ':', '@'), inRange16(v, '[', ']')));
+}
+
+static inline unsigned mask16(__m128i v) { return static_cast<unsigned>(_mm_movemask_epi8(v)); }
+
+static inline __m128i load16(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+
+static size_t findLineStopSse2(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = load16(data + i);
+        __m128i stop = _mm_andnot_si128(_mm_cmpeq_epi8(v, byte16('\t')), inRange16(v, 0x00, 0x1f));
+        unsigned mask = mask16(_mm_or_si128(stop, _mm_cmpeq_epi8(v, byte16(0x7f))));
+        if (mask)
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+    return i + findLineStopScalar(data + i, size - i);
+}
+
+static size_t lowerTokenSse2(const char *data, size_t size, char *out) {
+    size_t i = 0, stop = size;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = load16(data + i);
+        unsigned mask = mask16(notTchar16(v));
+        if (mask && stop == size)
+            stop = i + static_cast<size_t>(__builtin_ctz(mask));
+        v = _mm_add_epi8(v, _mm_and_si128(inRange16(v, 'A', 'Z'), byte16('a' - 'A')));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), v);
+    }
+    size_t tail = lowerTokenScalar(data + i, size - i, out + i);
+    return stop != size ? stop : i + tail;
+}
+
+static size_t findUriSpecialSse2(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = load16(data + i);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, byte16('%')), _mm_cmpeq_epi8(inRange16(v, 0x21, 0x7e), _mm_setzero_si128()));
+        unsigned mask = mask16(special);
+        if (mask)
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+    return i + findUriSpecialScalar(data + i, size - i);
+}
+#endif
+
+#if defined(BYTESCAN_AVX2)
+static inline AVX2_TARGET __m256i byte32(int c) { return _mm256_set1_epi8(static_cast<char>(c)); }
+
+static inline AVX2_TARGET __m256i inRange32(__m256i v, int low, int high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, byte32(low - 1)), _mm256_cmpgt_epi8(byte32(high + 1), v));
+}
+
+static inline AVX2_TARGET __m256i notTchar32(__m256i v) {
+    __m256i bad = _mm256_cmpeq_epi8(inRange32(v, 0x21, 0x7e), _mm256_setzero_si256());
+    bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_cmpeq_epi8(v, byte32('"')), _mm256_cmpeq_epi8(v, byte32(','))));
+    bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_cmpeq_epi8(v, byte32('/')), _mm256_cmpeq_epi8(v, byte32('{'))));
+    bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_cmpeq_epi8(v, byte32('}')), inRange32(v, '(', ')')));
+    return _mm256_or_si256(bad, _mm256_or_si256(inRange32(v, ':', '@'), inRange32(v, '[', ']')));
+}
+
+static inline AVX2_TARGET unsigned mask32(__m256i v) { return static_cast<unsigned>(_mm256_movemask_epi8(v)); }
+
+static inline AVX2_TARGET __m256i load32(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+
+static AVX2_TARGET size_t findLineStopAvx2(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = load32(data + i);
+        __m256i stop = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, byte32('\t')), inRange32(v, 0x00, 0x1f));
+        unsigned mask = mask32(_mm256_or_si256(stop, _mm256_cmpeq_epi8(v, byte32(0x7f))));
+        if (mask)
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+    _mm256_zeroupper(); // the SSE2 code for the rest would pay for dirty upper halves on every instruction
+    return i + findLineStopSse2(data + i, size - i);
+}
+
+static AVX2_TARGET size_t lowerTokenAvx2(const char *data, size_t size, char *out) {
+    size_t i = 0, stop = size;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = load32(data + i);
+        unsigned mask = mask32(notTchar32(v));
+        if (mask && stop == size)
+            stop = i + static_cast<size_t>(__builtin_ctz(mask));
+        v = _mm256_add_epi8(v, _mm256_and_si256(inRange32(v, 'A', 'Z'), byte32('a' - 'A')));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), v);
+    }
+    _mm256_zeroupper();
+    size_t tail = lowerTokenSse2(data + i, size - i, out + i);
+    return stop != size ? stop : i + tail;
+}
+
+static AVX2_TARGET size_t findUriSpecialAvx2(const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = load32(data + i);
+        __m256i special =
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, byte32('%')), _mm256_cmpeq_epi8(inRange32(v, 0x21, 0x7e), _mm256_setzero_si256()));
+        unsigned mask = mask32(special);
+        if (mask)
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+    _mm256_zeroupper();
+    return i + findUriSpecialSse2(data + i, size - i);
+}
+#endif
+
+struct Kernels {
+    const char *name;
+    size_t (*findLineStop)(const char *, size_t);
+    size_t (*lowerToken)(const char *, size_t, char *);
+    size_t (*findUriSpecial)(const char *, size_t);
+};
+
+static const Kernels scalarKernels = {"scalar", findLineStopScalar, lowerTokenScalar, findUriSpecialScalar};
+#if defined(__SSE2__)
+static const Kernels sse2Kernels = {"sse2", findLineStopSse2, lowerTokenSse2, findUriSpecialSse2};
+#endif
+#if defined(BYTESCAN_AVX2)
+static const Kernels avx2Kernels = {"avx2", findLineStopAvx2, lowerTokenAvx2, findUriSpecialAvx2};
+#endif
+
+static bool cpuHasAvx2() {
+#if defined(BYTESCAN_AVX2)
+    __builtin_cpu_init(); // in case this runs before the constructor that usually takes care of it
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+static const Kernels *detectKernels() {
+#if defined(BYTESCAN_AVX2)
+    if (cpuHasAvx2())
+        return &avx2Kernels;
+#endif
+#if defined(__SSE2__)
+    return &sse2Kernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+// the first call of any scan picks the kernels, this way the choice doesn't depend on the order of static initialization
+static size_t findLineStopFirst(const char *data, size_t size);
+static size_t lowerTokenFirst(const char *data, size_t size, char *out);
+static size_t findUriSpecialFirst(const char *data, size_t size);
+static const Kernels firstCallKernels = {NULL, findLineStopFirst, lowerTokenFirst, findUriSpecialFirst};
+static const Kernels *kernels = &firstCallKernels;
+
+static size_t findLineStopFirst(const char *data, size_t size) {
+    kernels = detectKernels();
+    return kernels->findLineStop(data, size);
+}
+
+static size_t lowerTokenFirst(const char *data, size_t size, char *out) {
+    kernels = detectKernels();
+    return kernels->lowerToken(data, size, out);
+}
+
+static size_t findUriSpecialFirst(const char *data, size_t size) {
+    kernels = detectKernels();
+    return kernels->findUriSpecial(data, size);
+}
+
+size_t ByteScan::findLineStop(const char *data, size_t size) { return kernels->findLineStop(data, size); }
+
+size_t ByteScan::lowerToken(const char *data, size_t size, char *out) { return kernels->lowerToken(data, size, out); }
+
+size_t ByteScan::findUriSpecial(const char *data, size_t size) { return kernels->findUriSpecial(data, size); }
+
+const char *ByteScan::implementation() {
+    if (kernels == &firstCallKernels)
+        kernels = detectKernels();
+    return kernels->name;
+}
+
+bool ByteScan::use(const string &implementation) {
+    if (implementation == scalarKernels.name)
+        kernels = &scalarKernels;
+#if defined(__SSE2__)
+    else if (implementation == sse2Kernels.name)
+        kernels = &sse2Kernels;
+#endif
+#if defined(BYTESCAN_AVX2)
+    else if (implementation == avx2Kernels.name && cpuHasAvx2())
+        kernels = &avx2Kernels;
+#endif
+    else
+        return false;
+    return true;
+}
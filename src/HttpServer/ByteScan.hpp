@@ -0,0 +1,20 @@
+#pragma once /* ByteScan.hpp */
+
+#include <cstddef>
+#include <string>
+
+// Character class scans of the request parser, 16 or 32 bytes at a time where the CPU can do it, in the spirit of picohttpparser. The
+// implementation is chosen with cpuid when the first scan runs: AVX2, SSE2 (always there on x86-64), or plain loops everywhere else.
+// All of them return the same results.
+namespace ByteScan {
+    // index of the first byte that can't be part of a line of the request head: CR, LF, another control character except HTAB, or DEL
+    size_t findLineStop(const char *data, size_t size);
+    // writes data lowercased (ASCII letters only) to out, which may be data itself, and returns the index of the first byte that isn't
+    // a tchar (RFC 9110 5.6.2)
+    size_t lowerToken(const char *data, size_t size, char *out);
+    // index of the first '%' or byte outside of printable ASCII in a request target, i.e. the first byte decoding has to look at
+    size_t findUriSpecial(const char *data, size_t size);
+
+    const char *implementation();             // "avx2", "sse2" or "scalar"
+    bool use(const std::string &implementation); // false if the CPU can't run it, for tests and benchmarks
+} // namespace ByteScan
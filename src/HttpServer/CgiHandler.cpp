@@ -3,9 +3,11 @@
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <map>
 #include <new>
 #include <ostream>
+#include <signal.h>
 #include <sstream>
 #include <stdexcept>
 #include <stdlib.h>
@@ -29,7 +31,6 @@
 
 using std::string;
 using std::swap;
-typedef HttpServer::ClientFdToCgiMap CgiProcessMap; // not sure why `using' doesn't work with this one
 
 // De- & Constructors
 CgiHandler::~CgiHandler() { TRACE_DTOR; }
@@ -102,18 +103,24 @@ std::map<string, string> CgiHandler::setupEnvironment(const HttpServer::HttpRequ
     // env["REMOTE_ADDR"] = getHost(request); // NOTODO: @all: maybe a different time
     env["QUERY_STRING"] = request.rawQuery;
 
-    for (std::map<string, string>::const_iterator it = request.headers.begin(); it != request.headers.end(); ++it) {
-        string headerName = Utils::strToUpper("HTTP_" + it->first);
-        std::replace(headerName.begin(), headerName.end(), '-', '_');
-        env[headerName] = it->second;
+    // HTTP_ variables are written straight from the slices of the request head, names are already lowercase tokens
+    const RequestParser &parser = request.parser;
+    const HeaderTable &headers = parser.headers();
+    for (size_t i = 0; i < headers.size(); ++i) {
+        const char *name = parser.data(headers[i].name);
+        string variable("HTTP_");
+        variable.reserve(5 + headers[i].name.length);
+        for (size_t j = 0; j < headers[i].name.length; ++j)
+            variable += name[j] == '-' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(name[j])));
+        env[variable].assign(parser.data(headers[i].value), headers[i].value.length);
     }
 
     if (request.method == "POST") {
-        if (request.headers.find("content-length") != request.headers.end()) {
-            env["CONTENT_LENGTH"] = request.headers.at("content-length");
+        if (const RequestParser::Span *contentLength = parser.header(HeaderTable::CONTENT_LENGTH)) {
+            env["CONTENT_LENGTH"].assign(parser.data(*contentLength), contentLength->length);
         }
-        if (request.headers.find("content-type") != request.headers.end()) {
-            env["CONTENT_TYPE"] = request.headers.at("content-type");
+        if (const RequestParser::Span *contentType = parser.header(HeaderTable::CONTENT_TYPE)) {
+            env["CONTENT_TYPE"].assign(parser.data(*contentType), contentType->length);
         }
     }
 
@@ -203,6 +210,13 @@ bool CgiHandler::validateHeaders(const string &headers) {
     return true;
 }
 
+void CgiHandler::setNonBlockingAndCloseOnExec(int fd) {
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 || ::fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+        log.error() << "Error calling " << func("fcntl") << punct("()") << " on CGI pipe FD " << repr(fd) << ": " << ::strerror(errno)
+                    << std::endl;
+}
+
 void CgiHandler::execute(int clientSocket, const HttpServer::HttpRequest &request, const LocationCtx &location) {
     log.debug() << "Trying to execute CGI process, executable is " << repr(_program) << std::endl;
     log.trace() << "Request is " << repr(request) << std::endl;
@@ -253,6 +267,11 @@ void CgiHandler::execute(int clientSocket, const HttpServer::HttpRequest &reques
         (void)::close(toCgi[PIPE_READ]);
         (void)::close(fromCgi[PIPE_WRITE]);
 
+        sigset_t mask; // the server reads SIGCHLD from a signalfd, the CGI program must not inherit it blocked
+        ::sigemptyset(&mask);
+        ::sigaddset(&mask, SIGCHLD);
+        (void)::sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
 #if DEBUG_CHILD
         log.debug() << "Child: Changing dir to: " << repr(rootPath + cgiDir) << std::endl;
 #endif
@@ -313,45 +332,17 @@ void CgiHandler::execute(int clientSocket, const HttpServer::HttpRequest &reques
     (void)::close(fromCgi[PIPE_WRITE]); // parent process should only read from cgi process
     int cgiWriteFd = toCgi[PIPE_WRITE];
     int cgiReadFd = fromCgi[PIPE_READ];
+    // the parent's ends must never block the event loop, nor leak into other CGI processes
+    setNonBlockingAndCloseOnExec(cgiWriteFd);
+    setNonBlockingAndCloseOnExec(cgiReadFd);
 
-    std::pair<CgiProcessMap::iterator, bool> result;
-    result = _server._clientToCgi.insert(
-        std::make_pair(clientSocket, HttpServer::CgiProcess(pid, cgiReadFd, cgiWriteFd, clientSocket, &location)));
-    log.debug() << "Parent: Adding new clientSocket->CgiProcess mapping to clientToCgi map: "
-                << repr(static_cast<std::pair<int, HttpServer::CgiProcess> >(*result.first)) << std::endl;
-    (void)result;
-
-    // from timo: commented out for now
-    // if (!result.second) {
-    // 	// If key already exists, update the existing entry
-    // 	// NOTODO: @discuss: is this even correct? what happens to the old CgiProcess entry?
-    // 	result.first->second = HttpServer::CgiProcess(pid, cgiReadFd, clientSocket,
-    // &location);
-    // }
-
-    struct pollfd pfd;
-    pfd.fd = cgiReadFd;
-    pfd.events = POLLIN; // get notified when CGI has data ready to send
-    pfd.revents = 0;
-    log.debug() << "Parent: Add new mapping from cgiReadFd to clientSocket: " << repr(cgiReadFd) << "->" << repr(clientSocket) << std::endl;
-    _server._cgiToClient[cgiReadFd] = clientSocket;
-    if (std::find(_server._monitorFds.pollFds.begin(), _server._monitorFds.pollFds.end(), pfd) != _server._monitorFds.pollFds.end())
-        log.error() << "ERROR1: pushing a pollfd " << repr(pfd.fd) << " that is already in the monitoring fds: " << repr(pfd) << std::endl;
-    _server._monitorFds.pollFds.push_back(pfd);
-
-    struct pollfd pfd2;
-    pfd2.fd = cgiWriteFd;
-    pfd2.events = POLLOUT; // for the pendingWrite
-    pfd2.revents = 0;
-    log.debug() << "Parent: Add new mapping from cgiWriteFd to clientSocket: " << repr(cgiWriteFd) << "->" << repr(clientSocket)
-                << std::endl;
-    _server._cgiToClient[cgiWriteFd] = clientSocket;
-    if (std::find(_server._monitorFds.pollFds.begin(), _server._monitorFds.pollFds.end(), pfd2) != _server._monitorFds.pollFds.end())
-        log.error() << "ERROR2: pushing a pollfd " << repr(pfd2.fd) << " that is already in the monitoring fds: " << repr(pfd2)
-                    << std::endl;
-    _server._monitorFds.pollFds.push_back(pfd2);
+    log.debug() << "Parent: Attaching CGI process to client " << repr(clientSocket) << " (read FD: " << repr(cgiReadFd)
+                << ", write FD: " << repr(cgiWriteFd) << ")" << std::endl;
+    _server.attachCgiProcess(clientSocket, HttpServer::CgiProcess(pid, cgiReadFd, cgiWriteFd, clientSocket, &location));
+    _server.addFdToMonitorFds(_server._monitorFds, cgiReadFd, POLLIN);   // get notified when CGI has data ready to send
+    _server.addFdToMonitorFds(_server._monitorFds, cgiWriteFd, POLLOUT); // for the pendingWrite
 
     log.debug() << "Parent: Queueing data to write to CGI process (write FD: " << repr(cgiWriteFd) << "): " << repr(request.body)
                 << std::endl;
-    _server.queueWrite(cgiWriteFd, request.body);
+    _server.queueBody(cgiWriteFd, request.body);
 }
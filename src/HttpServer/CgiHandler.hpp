@@ -37,6 +37,7 @@ class CgiHandler {
 
     char **exportEnvironment(const std::map<string, string> &env, size_t &n);
     std::map<string, string> setupEnvironment(const HttpServer::HttpRequest &request, const LocationCtx &location);
+    void setNonBlockingAndCloseOnExec(int fd);
 };
 
 void swap(CgiHandler &, CgiHandler &) /* noexcept */;
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <string>
+
+#include "ByteScan.hpp"
+#include "ChunkedDecoder.hpp"
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+ChunkedDecoder::~ChunkedDecoder() {}
+
+ChunkedDecoder::ChunkedDecoder() : _state(SIZE), _status(DECODE_INCOMPLETE), _size(0), _digits(0), _remaining(0), _lineLength(0) {}
+
+ChunkedDecoder::ChunkedDecoder(const ChunkedDecoder &other)
+    : _state(other._state), _status(other._status), _size(other._size), _digits(other._digits), _remaining(other._remaining),
+      _lineLength(other._lineLength) {}
+
+ChunkedDecoder &ChunkedDecoder::operator=(const ChunkedDecoder &other) {
+    if (this == &other)
+        return *this;
+    _state = other._state;
+    _status = other._status;
+    _size = other._size;
+    _digits = other._digits;
+    _remaining = other._remaining;
+    _lineLength = other._lineLength;
+    return *this;
+}
+
+void ChunkedDecoder::reset() { *this = ChunkedDecoder(); }
+
+ChunkedDecoder::Status ChunkedDecoder::status() const { return _status; }
+
+size_t ChunkedDecoder::remaining() const { return _remaining; }
+
+// the last chunk (size 0) is followed by the trailer section instead of data
+void ChunkedDecoder::endOfSizeLine() {
+    _remaining = _size;
+    _state = _size == 0 ? TRAILER : DATA;
+    _lineLength = 0;
+}
+
+// one pass over data, each byte is looked at once. Chunk data is appended in one piece per call, extensions and trailer fields are
+// skipped with ByteScan, which also rejects control characters in them
+ChunkedDecoder::Status ChunkedDecoder::decode(const char *data, size_t size, RequestBody &body, size_t &consumed) {
+    size_t i = 0;
+    while (_status == DECODE_INCOMPLETE && i < size) {
+        char c = data[i];
+        switch (_state) {
+        case SIZE: {
+            int digit = hexValue(c);
+            if (digit >= 0) {
+                if (_size > (static_cast<size_t>(-1) >> 4)) {
+                    _status = DECODE_ERROR; // doesn't fit into a size_t, no body is that big anyway
+                    break;
+                }
+                _size = (_size << 4) | static_cast<size_t>(digit);
+                ++_digits;
+                ++i;
+                break;
+            }
+            if (_digits == 0) {
+                _status = DECODE_ERROR;
+                break;
+            }
+            _state = SIZE_BLANK; // the byte is looked at there
+            break;
+        }
+        case SIZE_BLANK:
+            ++i;
+            if (c == ' ' || c == '\t')
+                break;
+            if (c == ';')
+                _state = EXTENSION;
+            else if (c == '\r')
+                _state = SIZE_LF;
+            else if (c == '\n')
+                endOfSizeLine();
+            else
+                _status = DECODE_ERROR;
+            break;
+        case EXTENSION: {
+            size_t length = ByteScan::findLineStop(data + i, size - i);
+            _lineLength += length;
+            i += length;
+            if (_lineLength > MAX_LINE_LENGTH)
+                _status = DECODE_ERROR;
+            else if (i == size)
+                break;
+            else if (data[i] == '\r') {
+                ++i;
+                _state = SIZE_LF;
+            } else if (data[i] == '\n') {
+                ++i;
+                endOfSizeLine();
+            } else
+                _status = DECODE_ERROR;
+            break;
+        }
+        case SIZE_LF:
+            ++i;
+            if (c == '\n')
+                endOfSizeLine();
+            else
+                _status = DECODE_ERROR;
+            break;
+        case DATA: {
+            size_t length = std::min(_remaining, size - i);
+            body.append(data + i, length);
+            _remaining -= length;
+            i += length;
+            if (_remaining == 0)
+                _state = DATA_CR;
+            break;
+        }
+        case DATA_CR:
+        case DATA_LF:
+            ++i;
+            if (c == '\r' && _state == DATA_CR)
+                _state = DATA_LF;
+            else if (c == '\n') {
+                _state = SIZE;
+                _size = 0;
+                _digits = 0;
+            } else
+                _status = DECODE_ERROR;
+            break;
+        case TRAILER:
+            if (c == '\r') {
+                ++i;
+                _state = LAST_LF;
+            } else if (c == '\n') {
+                ++i;
+                _state = DONE;
+                _status = DECODE_COMPLETE;
+            } else
+                _state = TRAILER_FIELD; // the byte is looked at there
+            break;
+        case TRAILER_FIELD: {
+            size_t length = ByteScan::findLineStop(data + i, size - i);
+            _lineLength += length;
+            i += length;
+            if (_lineLength > MAX_LINE_LENGTH)
+                _status = DECODE_ERROR;
+            else if (i == size)
+                break;
+            else if (data[i] == '\r') {
+                ++i;
+                _state = TRAILER_LF;
+            } else if (data[i] == '\n') {
+                ++i;
+                _state = TRAILER;
+            } else
+                _status = DECODE_ERROR;
+            break;
+        }
+        case TRAILER_LF:
+        case LAST_LF:
+            ++i;
+            if (c != '\n')
+                _status = DECODE_ERROR;
+            else if (_state == TRAILER_LF)
+                _state = TRAILER;
+            else {
+                _state = DONE;
+                _status = DECODE_COMPLETE;
+            }
+            break;
+        case DONE:
+            break;
+        }
+    }
+    consumed = i;
+    return _status;
+}
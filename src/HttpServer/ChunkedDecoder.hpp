@@ -0,0 +1,53 @@
+#pragma once /* ChunkedDecoder.hpp */
+
+#include <cstddef>
+
+#include "RequestBody.hpp"
+
+// Resumable decoder for a request body sent with Transfer-Encoding: chunked (RFC 9112 7.1). It is fed the received pieces as they
+// are and appends the chunk data straight to the body, nothing is buffered in between: the chunk size is accumulated digit by digit
+// and the decoder remembers how much of the current chunk is still missing. Chunk extensions and trailer fields are skipped (a server
+// may discard them), lines end in CRLF or a bare LF as in the head. Extensions and the trailer section are limited to MAX_LINE_LENGTH
+// bytes each, so a client can't keep the decoder busy without sending any data.
+class ChunkedDecoder {
+  public:
+    enum Status { DECODE_INCOMPLETE, DECODE_COMPLETE, DECODE_ERROR };
+    enum { MAX_LINE_LENGTH = 8192 };
+
+    ~ChunkedDecoder();
+    ChunkedDecoder();
+    ChunkedDecoder(const ChunkedDecoder &other);
+    ChunkedDecoder &operator=(const ChunkedDecoder &other);
+
+    // continues where the last call stopped and appends the chunk data to body. consumed is set to the number of bytes of data that
+    // belonged to the chunked body, which is less than size only if the body ended within data (the rest is the next request)
+    Status decode(const char *data, size_t size, RequestBody &body, size_t &consumed);
+    void reset();
+    Status status() const;
+    size_t remaining() const; // bytes of the current chunk that haven't been received yet
+
+  private:
+    enum State {
+        SIZE,           // hex digits of the chunk size
+        SIZE_BLANK,     // blanks between the chunk size and an extension
+        EXTENSION,      // chunk extensions up to the end of the line
+        SIZE_LF,        // LF of the chunk size line
+        DATA,           // chunk data
+        DATA_CR,        // CR after the chunk data
+        DATA_LF,        // LF after the chunk data
+        TRAILER,        // start of a trailer field line or of the final empty line
+        TRAILER_FIELD,  // trailer field up to the end of the line
+        TRAILER_LF,     // LF of a trailer field line
+        LAST_LF,        // LF of the final empty line
+        DONE
+    };
+
+    State _state;
+    Status _status;
+    size_t _size;       // of the current chunk, as far as its digits have been received
+    size_t _digits;     // of the chunk size received so far
+    size_t _remaining;  // of the current chunk's data
+    size_t _lineLength; // of the extensions of the current chunk size line or of the trailer section so far
+
+    void endOfSizeLine();
+};
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <sys/resource.h>
+
+#include "Constants.hpp"
+#include "HttpServer.hpp"
+#include "Logger.hpp"
+#include "Repr.hpp"
+
+// The table is indexed by fd, so it can never need more slots than the process may have FDs.
+// Reserving that upfront means growing it never reallocates, i.e. references into it stay valid
+// even when e.g. CGI pipes are created while a request is being handled.
+void HttpServer::setupConnections() {
+    struct rlimit limit;
+    size_t maxFds = Constants::maxFds;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) < 0)
+        log.warning() << "Error calling " << func("getrlimit") << punct("()") << ": " << ::strerror(errno) << std::endl;
+    else if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < maxFds)
+        maxFds = static_cast<size_t>(limit.rlim_cur);
+    else {
+        log.debug() << "Lowering " << num("RLIMIT_NOFILE") << " to " << repr(maxFds) << std::endl;
+        limit.rlim_cur = maxFds;
+        if (::setrlimit(RLIMIT_NOFILE, &limit) < 0)
+            throw std::runtime_error(string("Failed to lower RLIMIT_NOFILE: ") + ::strerror(errno));
+    }
+    log.debug() << "Reserving connection table for " << repr(maxFds) << " FDs" << std::endl;
+    _conns.reserve(maxFds);
+}
+
+HttpServer::Connection &HttpServer::conn(int fd) {
+    size_t idx = static_cast<size_t>(fd);
+    if (idx >= _conns.size())
+        _conns.resize(idx + 1);
+    return _conns[idx];
+}
+
+void HttpServer::resetConnection(int fd, ConnectionKind kind) {
+    log.trace() << "Resetting connection table entry for FD " << repr(fd) << " to kind " << repr(kind) << std::endl;
+    detachCgi(fd);
+    cancelTimers(fd);
+    conn(fd) = Connection(kind);
+}
+
+HttpServer::CgiProcess *HttpServer::cgiOf(int clientSocket) {
+    Connection &c = conn(clientSocket);
+    return c.hasCgi ? &c.cgi : NULL;
+}
+
+int HttpServer::cgiClientOf(int fd) { return conn(fd).cgiClient; }
+
+void HttpServer::detachCgi(int clientSocket) {
+    Connection &c = conn(clientSocket);
+    if (!c.hasCgi)
+        return;
+    c.hasCgi = false;
+    cancelCgiTimer(clientSocket);
+    vector<int>::iterator it = std::find(_cgiClients.begin(), _cgiClients.end(), clientSocket);
+    if (it != _cgiClients.end())
+        _cgiClients.erase(it);
+}
+
+void HttpServer::attachCgiProcess(int clientSocket, const CgiProcess &process) {
+    Connection &client = conn(clientSocket);
+    if (client.hasCgi)
+        log.warning() << "Client " << repr(clientSocket) << " already has a CGI process attached: " << repr(client.cgi) << std::endl;
+    else {
+        log.debug() << "Attaching CGI process " << repr(process) << " to client " << repr(clientSocket) << std::endl;
+        client.hasCgi = true;
+        client.cgi = process;
+        _cgiClients.push_back(clientSocket);
+        armCgiTimer(clientSocket);
+    }
+    log.debug() << "Mapping CGI pipe FDs " << repr(process.readFd) << " and " << repr(process.writeFd) << " to client "
+                << repr(clientSocket) << std::endl;
+    resetConnection(process.readFd, CONN_CGI_PIPE);
+    conn(process.readFd).cgiClient = clientSocket;
+    resetConnection(process.writeFd, CONN_CGI_PIPE);
+    conn(process.writeFd).cgiClient = clientSocket;
+}
+
+// unless the pipe has been closed already, then its FD may belong to another connection by now
+void HttpServer::closeCgiPipe(int clientSocket, int pipeFd) {
+    if (pipeFd < 0 || cgiClientOf(pipeFd) != clientSocket)
+        return;
+    log.debug() << "Closing CGI pipe FD " << repr(pipeFd) << " of client " << repr(clientSocket) << std::endl;
+    Connection &pipe = conn(pipeFd);
+    pipe.hasPendingWrite = false;
+    closeAndRemoveMultPlexFd(_monitorFds, pipeFd);
+    pipe.cgiClient = -1;
+}
@@ -1,9 +1,9 @@
-#include <algorithm>
 #include <cerrno>
 #include <cstddef>
 #include <cstring>
 #include <ostream>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <sys/poll.h>
 
 #include "Constants.hpp"
@@ -12,25 +12,37 @@
 #include "Utils.hpp"
 
 using Constants::EPOLL;
+using Constants::IO_URING;
 using Constants::POLL;
 using Constants::SELECT;
 using std::runtime_error;
 
-HttpServer::MultPlexFds HttpServer::getReadyPollFds(MultPlexFds &monitorFds, int nReady, struct pollfd *pollFds, nfds_t nPollFds) {
-    MultPlexFds readyFds(POLL);
-    vector<int> pollFdsToRemove;
+// A hangup or error on an FD that is read from is handled as readable, so the read handler runs into the EOF/error and cleans up
+// like it always does (e.g. a CGI process closing its stdout after we've already read everything it wrote)
+static inline bool readableOrHungUp(uint32_t revents, uint32_t events) {
+    return (revents & POLLIN) || ((events & POLLIN) && (revents & (POLLHUP | POLLERR)));
+}
+
+void HttpServer::getReadyPollFds(MultPlexFds &monitorFds, MultPlexFds &readyFds, int nReady, struct pollfd *pollFds, nfds_t nPollFds) {
+    vector<int> &pollFdsToRemove = _fdsToRemove;
+    pollFdsToRemove.clear();
 
     (void)nReady;
-    log.trace() << "Determining readyFds from the following pollfds: " << reprArr(pollFds, nPollFds) << std::endl;
+    if (log.istrace())
+        log.trace() << "Determining readyFds from the following pollfds: " << reprArr(pollFds, nPollFds) << std::endl;
     for (size_t i = 0; i < nPollFds; ++i) {
-        log.trace2() << "Value if i: " << repr(i) << std::endl;
-        log.trace2() << "Checking the following pollfd: " << repr(pollFds[i]) << std::endl;
-        if (pollFds[i].revents & POLLIN) {
-            log.trace2() << "Poll revents contains POLLIN: " << repr(pollFds[i]) << std::endl;
+        if (log.istrace2()) {
+            log.trace2() << "Value if i: " << repr(i) << std::endl;
+            log.trace2() << "Checking the following pollfd: " << repr(pollFds[i]) << std::endl;
+        }
+        if (readableOrHungUp(static_cast<uint16_t>(pollFds[i].revents), static_cast<uint16_t>(pollFds[i].events))) {
+            if (log.istrace2())
+                log.trace2() << "Poll revents contains POLLIN: " << repr(pollFds[i]) << std::endl;
             readyFds.pollFds.push_back(pollFds[i]);
             readyFds.fdStates.push_back(FD_READABLE);
         } else if (pollFds[i].revents & POLLOUT) {
-            log.trace2() << "Poll revents contains POLLOUT: " << repr(pollFds[i]) << std::endl;
+            if (log.istrace2())
+                log.trace2() << "Poll revents contains POLLOUT: " << repr(pollFds[i]) << std::endl;
             readyFds.pollFds.push_back(pollFds[i]);
             readyFds.fdStates.push_back(FD_WRITEABLE);
         } else if (pollFds[i].revents != 0) {
@@ -44,26 +56,170 @@ HttpServer::MultPlexFds HttpServer::getReadyPollFds(MultPlexFds &monitorFds, int
         log.debug() << "Removing FD " << repr(*fd) << " from monitoring FDs" << std::endl;
         closeAndRemoveMultPlexFd(monitorFds, *fd);
     }
-    return readyFds;
 }
 
-HttpServer::MultPlexFds HttpServer::doPoll(MultPlexFds &monitorFds) {
+void HttpServer::doPoll(MultPlexFds &monitorFds, MultPlexFds &readyFds, int timeoutMs) {
     struct pollfd *pollFds = multPlexFdsToPollFds(monitorFds);
     nfds_t nPollFds = getNumberOfPollFds(monitorFds);
-    int nReady = ::poll(pollFds, nPollFds, Constants::multiplexTimeout);
+    int nReady = ::poll(pollFds, nPollFds, timeoutMs);
 
     if (nReady < 0) {
         if (errno == EINTR) // NOTODO: @all: why is EINTR okay? What about the other codes?
                             // What about EAGAIN?
-            return MultPlexFds(POLL);
+            return;
         throw runtime_error(string("poll failed: ") + ::strerror(errno)); // NOTODO: @timo: make Errors::...
     }
 
-    return getReadyPollFds(monitorFds, nReady, pollFds, nPollFds);
+    getReadyPollFds(monitorFds, readyFds, nReady, pollFds, nPollFds);
 }
 
-HttpServer::MultPlexFds HttpServer::determineRemoteClients(const MultPlexFds &m, vector<int> ls, const CgiFdToClientMap &cgiToClient) {
-    MultPlexFds remaining;
+void HttpServer::getReadyEpollFds(MultPlexFds &monitorFds, MultPlexFds &readyFds, int nReady) {
+    vector<int> &epollFdsToRemove = _fdsToRemove;
+    epollFdsToRemove.clear();
+
+    if (log.istrace())
+        log.trace() << "Determining readyFds from the following epoll_events: " << repr(monitorFds.epollFds) << std::endl;
+    for (size_t i = 0; i < static_cast<size_t>(nReady); ++i) {
+        const struct epoll_event &ev = monitorFds.epollFds[i];
+        if (log.istrace2())
+            log.trace2() << "Checking the following epoll_event: " << repr(ev) << std::endl;
+        bool readable = readableOrHungUp(ev.events, monitorFds.epollRegs[static_cast<size_t>(ev.data.fd)]);
+        if (readable) {
+            if (log.istrace2())
+                log.trace2() << "Epoll events contains EPOLLIN: " << repr(ev) << std::endl;
+            readyFds.epollFds.push_back(ev);
+            readyFds.fdStates.push_back(FD_READABLE);
+            // an edge-triggered write event is not reported again, so it can't be deferred to the next round
+            if (!monitorFds.edgeTriggered || !(ev.events & EPOLLOUT))
+                continue;
+        }
+        if (ev.events & EPOLLOUT) {
+            if (log.istrace2())
+                log.trace2() << "Epoll events contains EPOLLOUT: " << repr(ev) << std::endl;
+            readyFds.epollFds.push_back(ev);
+            readyFds.fdStates.push_back(FD_WRITEABLE);
+        } else if (!readable && ev.events != 0) {
+            log.debug() << "Epoll events contains an event that is neither EPOLLIN nor EPOLLOUT: " << repr(ev) << std::endl;
+            log.debug() << "Queueing for removal" << std::endl;
+            epollFdsToRemove.push_back(ev.data.fd);
+        }
+    }
+
+    monitorFds.epollFds.clear();
+    for (vector<int>::const_iterator fd = epollFdsToRemove.begin(); fd != epollFdsToRemove.end(); ++fd) {
+        log.debug() << "Removing FD " << repr(*fd) << " from monitoring FDs" << std::endl;
+        closeAndRemoveMultPlexFd(monitorFds, *fd);
+    }
+}
+
+void HttpServer::doEpoll(MultPlexFds &monitorFds, MultPlexFds &readyFds, int timeoutMs) {
+    // epollFds is only scratch space for the kernel, keep it empty otherwise (capacity is retained)
+    monitorFds.epollFds.resize(static_cast<size_t>(Constants::epollMaxEvents));
+    int nReady = ::epoll_wait(monitorFds.epollFd, &monitorFds.epollFds[0], Constants::epollMaxEvents, timeoutMs);
+
+    if (nReady < 0) {
+        monitorFds.epollFds.clear();
+        if (errno == EINTR)
+            return;
+        throw runtime_error(string("epoll_wait failed: ") + ::strerror(errno));
+    }
+
+    monitorFds.epollFds.resize(static_cast<size_t>(nReady));
+    getReadyEpollFds(monitorFds, readyFds, nReady);
+}
+
+// Poll completions are reported as readable/writable, accept and recv completions carry their result along in uringCqes
+void HttpServer::getReadyIoUringFds(MultPlexFds &monitorFds, MultPlexFds &readyFds) {
+    vector<int> &uringFdsToRemove = _fdsToRemove;
+    uringFdsToRemove.clear();
+
+    struct io_uring_cqe cqe;
+    while (monitorFds.uring.popCqe(cqe)) {
+        if (cqe.user_data == IoUring::ignoredUserData) // completion of a poll update or a cancellation
+            continue;
+        int fd = static_cast<int>(cqe.user_data & 0x0fffffff);
+        UringOp op = static_cast<UringOp>((cqe.user_data >> 28) & 0xf);
+        if (!ioUringCompletionIsCurrent(monitorFds, cqe)) {
+            if (log.istrace2())
+                log.trace2() << "Ignoring stale io_uring completion for FD " << repr(fd) << " (result " << repr(cqe.res) << ")" << std::endl;
+            monitorFds.uring.recycleBuffer(cqe);
+            continue;
+        }
+        UringReg &reg = monitorFds.uringRegs[static_cast<size_t>(fd)];
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = static_cast<short>(reg.events);
+        pfd.revents = 0;
+        if (op != URING_POLL) {
+            bool more = cqe.flags & IORING_CQE_F_MORE;
+            if (!more)
+                reg.multishot = false;
+            if (op == URING_RECV && cqe.res == -ENOBUFS) { // all buffers are still queued for handling, try again next round
+                armIoUringInput(monitorFds, fd);
+                continue;
+            }
+            readyFds.pollFds.push_back(pfd);
+            readyFds.fdStates.push_back(op == URING_ACCEPT ? FD_ACCEPTED : FD_RECEIVED);
+            readyFds.uringCqes.push_back(cqe);
+            // a failed accept doesn't make the listening socket unusable, a recv result <= 0 ends the connection anyway
+            if (!more && (op == URING_ACCEPT || cqe.res > 0))
+                armIoUringInput(monitorFds, fd);
+            continue;
+        }
+        reg.armed = false;
+        pfd.revents = static_cast<short>(cqe.res);
+        if (log.istrace2())
+            log.trace2() << "Checking the following io_uring poll completion: " << repr(pfd) << std::endl;
+        if (cqe.res < 0) {
+            log.debug() << "io_uring poll request for FD " << repr(fd) << " failed: " << ::strerror(-cqe.res) << std::endl;
+            log.debug() << "Queueing for removal" << std::endl;
+            uringFdsToRemove.push_back(fd);
+            continue;
+        }
+        uint32_t events = ioUringPollEvents(reg);
+        if (events == 0) // the events were dropped while the request was in flight
+            continue;
+        if (readableOrHungUp(static_cast<uint32_t>(cqe.res), events)) {
+            readyFds.pollFds.push_back(pfd);
+            readyFds.fdStates.push_back(FD_READABLE);
+            readyFds.uringCqes.push_back(cqe);
+        } else if (pfd.revents & POLLOUT) {
+            readyFds.pollFds.push_back(pfd);
+            readyFds.fdStates.push_back(FD_WRITEABLE);
+            readyFds.uringCqes.push_back(cqe);
+        } else if (pfd.revents & (POLLHUP | POLLERR)) {
+            // a client socket's recv request reports the hangup, anything else is removed
+            if (reg.input == URING_POLL) {
+                log.debug() << "Poll completion contains an event that is neither POLLIN nor POLLOUT: " << repr(pfd) << std::endl;
+                log.debug() << "Queueing for removal" << std::endl;
+                uringFdsToRemove.push_back(fd);
+            }
+            continue;
+        }
+        armIoUringPoll(monitorFds, fd); // only submitted with the next wait, after the handlers had their go
+    }
+
+    for (vector<int>::const_iterator fd = uringFdsToRemove.begin(); fd != uringFdsToRemove.end(); ++fd) {
+        log.debug() << "Removing FD " << repr(*fd) << " from monitoring FDs" << std::endl;
+        closeAndRemoveMultPlexFd(monitorFds, *fd);
+    }
+}
+
+// submitting the queued (re-)arms and waiting for completions is a single io_uring_enter()
+void HttpServer::doIoUring(MultPlexFds &monitorFds, MultPlexFds &readyFds, int timeoutMs) {
+    int ret = monitorFds.uring.submitAndWait(timeoutMs);
+
+    if (ret < 0 && ret != -ETIME) {
+        if (ret == -EINTR)
+            return;
+        throw runtime_error(string("io_uring_enter failed: ") + ::strerror(-ret));
+    }
+
+    getReadyIoUringFds(monitorFds, readyFds);
+}
+
+HttpServer::MultPlexFds HttpServer::determineRemoteClients(const MultPlexFds &m) {
+    MultPlexFds remaining(m.multPlexType);
     log.trace() << "Determining remote clients" << std::endl;
     switch (m.multPlexType) {
     case SELECT:
@@ -72,7 +228,7 @@ HttpServer::MultPlexFds HttpServer::determineRemoteClients(const MultPlexFds &m,
     case POLL:
         for (size_t i = 0; i < m.pollFds.size(); ++i) {
             int fd = m.pollFds[i].fd;
-            if (std::find(ls.begin(), ls.end(), fd) == ls.end() && cgiToClient.count(fd) == 0 && _tmpCgiFds.count(fd) == 0) {
+            if (conn(fd).kind == CONN_CLIENT) {
                 remaining.pollFds.push_back(m.pollFds[i]);
                 if (i < m.fdStates.size())
                     remaining.fdStates.push_back(m.fdStates[i]);
@@ -80,7 +236,28 @@ HttpServer::MultPlexFds HttpServer::determineRemoteClients(const MultPlexFds &m,
         }
         break;
     case EPOLL:
-        throw std::logic_error("Filtering remote clients with epoll multiplex FDs is not implemented yet");
+        for (size_t i = 0; i < m.epollRegs.size(); ++i) {
+            int fd = static_cast<int>(i);
+            if (m.epollRegs[i] != 0 && conn(fd).kind == CONN_CLIENT) {
+                struct epoll_event ev;
+                ev.events = m.epollRegs[i];
+                ev.data.u64 = 0;
+                ev.data.fd = fd;
+                remaining.epollFds.push_back(ev);
+            }
+        }
+        break;
+    case IO_URING:
+        for (size_t i = 0; i < m.uringRegs.size(); ++i) {
+            int fd = static_cast<int>(i);
+            if (m.uringRegs[i].events != 0 && conn(fd).kind == CONN_CLIENT) {
+                struct pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = static_cast<short>(m.uringRegs[i].events);
+                pfd.revents = 0;
+                remaining.pollFds.push_back(pfd);
+            }
+        }
         break;
     default:
         throw std::logic_error("Filtering remote clients from unknown multiplex FDs is not implemented");
@@ -89,43 +266,76 @@ HttpServer::MultPlexFds HttpServer::determineRemoteClients(const MultPlexFds &m,
     return remaining;
 }
 
-HttpServer::MultPlexFds HttpServer::getReadyFds(MultPlexFds &monitorFds) {
-    log.debug() << "Trying to get ready FDs with multiplexing method " << repr(monitorFds.multPlexType) << std::endl;
-    log.trace() << "These are the monitoring FDs: " << repr(monitorFds) << std::endl;
-    MultPlexFds remotes = determineRemoteClients(monitorFds, _listeningSockets, _cgiToClient);
-    log.debug() << "Remote clients: " << repr(remotes) << std::endl;
+// the returned ready-list is reused by every call, so the steady-state mainloop doesn't allocate
+const HttpServer::MultPlexFds &HttpServer::getReadyFds(MultPlexFds &monitorFds) {
+    if (log.isdebug()) { // walks all monitored FDs, only worth it for the log
+        log.debug() << "Trying to get ready FDs with multiplexing method " << repr(monitorFds.multPlexType) << std::endl;
+        log.trace() << "These are the monitoring FDs: " << repr(monitorFds) << std::endl;
+        log.debug() << "Remote clients: " << repr(determineRemoteClients(monitorFds)) << std::endl;
+    }
+    MultPlexFds &readyFds = _readyFds;
+    readyFds.pollFds.clear(); // capacity is retained
+    readyFds.epollFds.clear();
+    readyFds.fdStates.clear();
+    readyFds.uringCqes.clear();
+    int timeoutMs = waitTimeout();
+    if (log.isdebug())
+        log.debug() << "Waiting for events for at most " << repr(timeoutMs) << " milliseconds (-1 is forever)" << std::endl;
     switch (monitorFds.multPlexType) {
     case SELECT:
         throw std::logic_error("Getting ready FDs from select not implemented yet");
         break;
     case POLL:
-        return doPoll(monitorFds);
+        doPoll(monitorFds, readyFds, timeoutMs);
         break;
     case EPOLL:
-        throw std::logic_error("Getting ready FDs from epoll not implemented yet");
+        doEpoll(monitorFds, readyFds, timeoutMs);
+        break;
+    case IO_URING:
+        doIoUring(monitorFds, readyFds, timeoutMs);
         break;
     default:
         throw std::logic_error("Getting ready FDs from unknown method not implemented");
     }
+    return readyFds;
 }
 
 void HttpServer::handleReadyFds(const MultPlexFds &readyFds) {
     size_t nReadyFds = readyFds.fdStates.size();
-    log.debug() << "Number of ready FDs: " << repr(nReadyFds) << std::endl;
+    if (log.isdebug())
+        log.debug() << "Number of ready FDs: " << repr(nReadyFds) << std::endl;
     if (nReadyFds == 0)
         return;
-    log.debug() << "Handling the following ready FDs: " << repr(readyFds) << std::endl;
+    if (log.isdebug())
+        log.debug() << "Handling the following ready FDs: " << repr(readyFds) << std::endl;
     for (size_t i = 0; i < nReadyFds; ++i) {
         int fd = multPlexFdToRawFd(readyFds, i);
+        // drain the FD until it would block, but at most _ioBudget bytes (or acceptBatchSize connections), so one busy
+        // connection can't starve the others
+        bool mightHaveMore = false;
+        size_t budget = _ioBudget;
         if (readyFds.fdStates[i] == FD_READABLE) {
-            if (isListeningSocket(fd))
-                addNewClient(fd);
+            if (isListeningSocket(fd)) {
+                size_t accepted = 0;
+                while ((mightHaveMore = addNewClient(fd)) && ++accepted < Constants::acceptBatchSize)
+                    ;
+            } else if (fd == _signalFd)
+                handleChildExits();
             else
-                readFromClient(fd);
+                while ((mightHaveMore = readFromClient(fd, budget)) && budget > 0)
+                    ;
         } else if (readyFds.fdStates[i] == FD_WRITEABLE)
-            writeToClient(fd);
+            while ((mightHaveMore = writeToClient(fd, budget)) && budget > 0)
+                ;
+        else if (readyFds.fdStates[i] == FD_ACCEPTED)
+            addAcceptedClient(fd, readyFds.uringCqes[i]);
+        else if (readyFds.fdStates[i] == FD_RECEIVED)
+            handleIoUringRecv(fd, readyFds.uringCqes[i]);
         else
             throw std::logic_error("Cannot handle fd other than readable or writable at "
                                    "this step"); // NOTODO: @timo: proper logging
+        // the budget ran out before the FD would block, edge-triggered epoll won't report it again by itself
+        if (mightHaveMore && isMonitoredFd(_monitorFds, fd))
+            rearmEdgeTriggeredFd(_monitorFds, fd);
     }
 }
@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <cctype>
 #include <cstddef>
+#include <cstdlib>
+#include <ctime>
 #include <ostream>
 #include <sstream>
 #include <sys/socket.h>
@@ -17,7 +21,7 @@ void HttpServer::redirectClient(int clientSocket, const string &newUri, int stat
     response << _httpVersionString << " " << statusCode << " " << statusTextFromCode(statusCode) << "\r\n"
              << "Location: " << newUri << "\r\n"
              << "Content-Length: " << body.length() << "\r\n"
-             << "Connection: keep-alive\r\n\r\n"
+             << "Connection: " << connectionHeader(clientSocket) << "\r\n\r\n"
              << body;
     string responseStr = response.str();
     log.debug() << "Sending redirection response immediately using " << func("send") << punct("()") << std::endl;
@@ -63,7 +67,7 @@ bool HttpServer::handleIndexes(int clientSocket, const string &diskPath, const H
 void HttpServer::handlePathWithSlash(int clientSocket, const string &diskPath, const HttpRequest &request, const LocationCtx &location,
                                      bool sendErrorMsg) {
     struct stat fileStat;
-    int fileExists = ::stat(diskPath.c_str(), &fileStat) == 0;
+    int fileExists = _fileCache.stat(diskPath, fileStat) == 0;
 
     log.debug() << "Handling disk path " << repr(diskPath) << " with trailing slash" << std::endl;
     if (!fileExists) {
@@ -90,7 +94,7 @@ void HttpServer::handlePathWithSlash(int clientSocket, const string &diskPath, c
         }
         log.debug() << "Autoindexing is enabled, indexing directory " << repr(diskPath) << std::endl;
         DirectoryIndexer di(log);
-        sendString(clientSocket, di.indexDirectory(request.path, diskPath), 200, "text/html", request.method == "HEAD");
+        sendString(clientSocket, di.indexDirectory(request.path, diskPath), 200, "text/html", request.method == "HEAD", &location);
         return;
     }
 }
@@ -98,7 +102,7 @@ void HttpServer::handlePathWithSlash(int clientSocket, const string &diskPath, c
 bool HttpServer::handlePathWithoutSlash(int clientSocket, const string &diskPath, const HttpRequest &request, const LocationCtx &location,
                                         bool sendErrorMsg) {
     struct stat fileStat;
-    int fileExists = ::stat(diskPath.c_str(), &fileStat) == 0;
+    int fileExists = _fileCache.stat(diskPath, fileStat) == 0;
 
     log.debug() << "Handling disk path " << repr(diskPath) << " without trailing slash" << std::endl;
     if (!fileExists) {
@@ -122,7 +126,16 @@ bool HttpServer::handlePathWithoutSlash(int clientSocket, const string &diskPath
         return true;
     } else if (S_ISREG(fileStat.st_mode)) {
         log.debug() << "File " << repr(diskPath) << " is a regular file" << std::endl;
-        return sendFileContent(clientSocket, diskPath, location, 200, "", request.method == "HEAD");
+        string servedPath = diskPath, extraHeaders;
+        selectStaticVariant(request, location, servedPath, fileStat, extraHeaders);
+        string contentType = servedPath == diskPath ? "" : getMimeType(diskPath);
+        if (isNotModified(request, fileStat)) {
+            sendNotModified(clientSocket, fileStat, extraHeaders);
+            return true;
+        }
+        if (request.parser.hasHeader(HeaderTable::RANGE))
+            return sendFileRanges(clientSocket, servedPath, request, location, contentType, extraHeaders);
+        return sendFileContent(clientSocket, servedPath, location, 200, contentType, request.method == "HEAD", extraHeaders);
     }
     log.debug() << "File " << repr(diskPath) << " is neither a directory nor a regular file, sending 403 Forbidden." << std::endl;
     if (sendErrorMsg)
@@ -132,6 +145,105 @@ bool HttpServer::handlePathWithoutSlash(int clientSocket, const string &diskPath
     return false;
 }
 
+static bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+static bool equalsNoCase(const char *begin, const char *end, const char *str) {
+    for (; begin != end; ++begin, ++str)
+        if (*str == '\0' || std::tolower(static_cast<unsigned char>(*begin)) != std::tolower(static_cast<unsigned char>(*str)))
+            return false;
+    return *str == '\0';
+}
+
+// whether the Accept-Encoding header allows coding, an explicit q=0 for it beats "*". The field is scanned where it lies in the request
+// head, a qvalue is nonzero if it has a nonzero digit (RFC 9110 12.4.2)
+bool HttpServer::acceptsEncoding(const RequestParser &parser, const char *coding) {
+    const RequestParser::Span *field = parser.header(HeaderTable::ACCEPT_ENCODING);
+    if (field == NULL)
+        return false;
+    static const char qParam[] = "q=";
+    const char *end = parser.data(*field) + field->length;
+    int accepted = -1, wildcard = -1;
+    for (const char *entry = parser.data(*field); entry < end; ++entry) {
+        const char *entryEnd = std::find(entry, end, ',');
+        const char *name = entry, *nameEnd = std::find(entry, entryEnd, ';');
+        while (name != nameEnd && isBlank(*name))
+            ++name;
+        while (nameEnd != name && isBlank(nameEnd[-1]))
+            --nameEnd;
+        const char *q = std::search(nameEnd, entryEnd, qParam, qParam + 2);
+        bool allowed = q == entryEnd;
+        if (!allowed)
+            for (q += 2; !allowed && q != entryEnd && *q != ';'; ++q)
+                allowed = '1' <= *q && *q <= '9';
+        if (equalsNoCase(name, nameEnd, coding))
+            accepted = allowed;
+        else if (equalsNoCase(name, nameEnd, "*"))
+            wildcard = allowed;
+        entry = entryEnd;
+    }
+    return accepted >= 0 ? accepted == 1 : wildcard == 1;
+}
+
+// gzip_static: a precompressed file.br or file.gz that's not older than the file itself is sent instead, if the client accepts its
+// encoding ("always" sends file.gz to every client). diskPath and fileStat are switched to the sidecar, extraHeaders gets
+// Content-Encoding and Vary
+void HttpServer::selectStaticVariant(const HttpRequest &request, const LocationCtx &location, string &diskPath, struct stat &fileStat,
+                                     string &extraHeaders) {
+    const string &mode = getFirstDirective(location.second, "gzip_static")[0];
+    if (mode == "off")
+        return;
+    static const char *const variants[][2] = {{"br", ".br"}, {"gzip", ".gz"}};
+    bool varies = false;
+    for (size_t i = 0; i < sizeof(variants) / sizeof(*variants); ++i) {
+        string variantPath = diskPath + variants[i][1];
+        struct stat variantStat;
+        if (_fileCache.stat(variantPath, variantStat) != 0 || !S_ISREG(variantStat.st_mode) || variantStat.st_mtime < fileStat.st_mtime)
+            continue;
+        varies = true;
+        if (!acceptsEncoding(request.parser, variants[i][0]) && !(mode == "always" && string(variants[i][0]) == "gzip"))
+            continue;
+        log.debug() << "Sending " << repr(variantPath) << " instead of " << repr(diskPath) << std::endl;
+        diskPath = variantPath;
+        fileStat = variantStat;
+        extraHeaders = string("Content-Encoding: ") + variants[i][0] + "\r\nVary: Accept-Encoding\r\n";
+        return;
+    }
+    if (varies)
+        extraHeaders = "Vary: Accept-Encoding\r\n";
+}
+
+// If-None-Match takes precedence over If-Modified-Since, ETags are compared weakly like RFC 9110 asks for GET and HEAD
+bool HttpServer::isNotModified(const HttpRequest &request, const struct stat &fileInfo) {
+    if (const RequestParser::Span *field = request.parser.header(HeaderTable::IF_NONE_MATCH)) {
+        string ifNoneMatch = request.parser.str(*field);
+        string etag = entityTag(fileInfo);
+        std::istringstream tags(ifNoneMatch);
+        string tag;
+        while (std::getline(tags, tag, ',')) {
+            size_t start = tag.find_first_not_of(" \t");
+            size_t end = tag.find_last_not_of(" \t");
+            if (start == string::npos)
+                continue;
+            tag = tag.substr(start, end - start + 1);
+            if (tag.compare(0, 2, "W/") == 0)
+                tag.erase(0, 2);
+            if (tag == "*" || tag == etag) {
+                log.debug() << "If-None-Match " << repr(ifNoneMatch) << " matches " << repr(etag) << std::endl;
+                return true;
+            }
+        }
+        return false;
+    }
+    const RequestParser::Span *field = request.parser.header(HeaderTable::IF_MODIFIED_SINCE);
+    if (field == NULL)
+        return false;
+    string ifModifiedSince = request.parser.str(*field);
+    std::time_t since = Utils::parseHttpDate(ifModifiedSince);
+    log.debug() << "If-Modified-Since " << repr(ifModifiedSince) << " is " << repr(since) << ", file was modified at "
+                << repr(fileInfo.st_mtime) << std::endl;
+    return since >= 0 && fileInfo.st_mtime <= since;
+}
+
 string HttpServer::determineDiskPath(const HttpRequest &request, const LocationCtx &location) {
     log.debug() << "Determining file to server for request " << repr(request) << " to location " << repr(location) << std::endl;
     string pathWithoutRoot;
@@ -0,0 +1,84 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "Constants.hpp"
+#include "GzipStream.hpp"
+
+using std::runtime_error;
+
+GzipStream::~GzipStream() { end(); }
+
+GzipStream::GzipStream() : _stream(NULL) {}
+
+GzipStream::GzipStream(const GzipStream &other) : _stream(NULL) { *this = other; }
+
+GzipStream &GzipStream::operator=(const GzipStream &other) {
+    if (this == &other)
+        return *this;
+    end();
+    if (other._stream == NULL)
+        return *this;
+    _stream = new z_stream;
+    if (::deflateCopy(_stream, other._stream) != Z_OK) {
+        delete _stream;
+        _stream = NULL;
+        throw runtime_error("Failed to copy gzip stream");
+    }
+    return *this;
+}
+
+void GzipStream::start(int level) {
+    end();
+    _stream = new z_stream;
+    std::memset(_stream, 0, sizeof(*_stream));
+    // 15 + 16: the largest window, with a gzip header and trailer instead of a zlib one
+    if (::deflateInit2(_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete _stream;
+        _stream = NULL;
+        throw runtime_error("Failed to initialize gzip stream");
+    }
+}
+
+bool GzipStream::active() const { return _stream != NULL; }
+
+string GzipStream::compress(const char *data, size_t size, bool finish) {
+    string compressed;
+    if (_stream == NULL)
+        return compressed;
+    char buffer[CONSTANTS_CHUNK_SIZE];
+    _stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    _stream->avail_in = static_cast<uInt>(size);
+    int ret;
+    do {
+        _stream->next_out = reinterpret_cast<Bytef *>(buffer);
+        _stream->avail_out = sizeof(buffer);
+        ret = ::deflate(_stream, finish ? Z_FINISH : Z_SYNC_FLUSH);
+        // Z_BUF_ERROR only means there was nothing left to flush, unless input is left over
+        if (ret == Z_STREAM_ERROR || (ret == Z_BUF_ERROR && _stream->avail_in != 0)) {
+            end();
+            throw runtime_error("Failed to compress gzip stream");
+        }
+        compressed.append(buffer, sizeof(buffer) - _stream->avail_out);
+    } while (_stream->avail_out == 0);
+    if (finish && ret != Z_STREAM_END) {
+        end();
+        throw runtime_error("Failed to finish gzip stream");
+    }
+    if (finish)
+        end();
+    return compressed;
+}
+
+string GzipStream::compress(const string &data, int level) {
+    GzipStream stream;
+    stream.start(level);
+    return stream.compress(data.data(), data.size(), true);
+}
+
+void GzipStream::end() {
+    if (_stream == NULL)
+        return;
+    ::deflateEnd(_stream);
+    delete _stream;
+    _stream = NULL;
+}
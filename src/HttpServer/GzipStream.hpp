@@ -0,0 +1,28 @@
+#pragma once /* GzipStream.hpp */
+
+#include <cstddef>
+#include <string>
+#include <zlib.h>
+
+using std::string;
+
+// gzip compression with zlib, of a whole string at once or of a stream of pieces, like the output of a CGI process. Every piece is
+// flushed, so what has been compressed so far can be sent right away instead of waiting for zlib's buffers to fill up. Copies continue
+// independently from the same state. If zlib fails, compress() ends the stream and throws, as the output would be truncated.
+class GzipStream {
+  public:
+    ~GzipStream();
+    GzipStream();
+    GzipStream(const GzipStream &other);
+    GzipStream &operator=(const GzipStream &other);
+
+    void start(int level);                                       // begins a new stream, level 1 (fastest) to 9 (smallest)
+    bool active() const;                                         // between start() and the piece that finishes the stream
+    string compress(const char *data, size_t size, bool finish); // finish writes the gzip trailer and ends the stream
+    static string compress(const string &data, int level);
+
+  private:
+    z_stream *_stream;
+
+    void end();
+};
@@ -0,0 +1,74 @@
+#include <cstring>
+
+#include "HeaderTable.hpp"
+
+HeaderTable::~HeaderTable() {}
+
+HeaderTable::HeaderTable() : _inline(), _overflow(), _size(0), _last() {}
+
+HeaderTable::HeaderTable(const HeaderTable &other) : _inline(), _overflow(), _size(0), _last() { *this = other; }
+
+HeaderTable &HeaderTable::operator=(const HeaderTable &other) {
+    if (this == &other)
+        return *this;
+    for (size_t i = 0; i < INLINE_ENTRIES && i < other._size; ++i)
+        _inline[i] = other._inline[i];
+    _overflow = other._overflow;
+    _size = other._size;
+    for (size_t i = 0; i < KNOWN_HEADERS; ++i)
+        _last[i] = other._last[i];
+    return *this;
+}
+
+struct KnownHeader {
+    const char *name;
+    size_t length;
+    HeaderTable::Id id;
+};
+
+static const KnownHeader knownHeaders[] = {
+    {"accept-encoding", 15, HeaderTable::ACCEPT_ENCODING},
+    {"connection", 10, HeaderTable::CONNECTION},
+    {"content-length", 14, HeaderTable::CONTENT_LENGTH},
+    {"content-type", 12, HeaderTable::CONTENT_TYPE},
+    {"expect", 6, HeaderTable::EXPECT},
+    {"host", 4, HeaderTable::HOST},
+    {"if-modified-since", 17, HeaderTable::IF_MODIFIED_SINCE},
+    {"if-none-match", 13, HeaderTable::IF_NONE_MATCH},
+    {"if-range", 8, HeaderTable::IF_RANGE},
+    {"range", 5, HeaderTable::RANGE},
+    {"transfer-encoding", 17, HeaderTable::TRANSFER_ENCODING},
+};
+
+// the lengths tell almost all of them apart already, so this is mostly one memcmp
+HeaderTable::Id HeaderTable::identify(const char *lowercaseName, size_t length) {
+    for (size_t i = 0; i < sizeof(knownHeaders) / sizeof(*knownHeaders); ++i)
+        if (knownHeaders[i].length == length && std::memcmp(knownHeaders[i].name, lowercaseName, length) == 0)
+            return knownHeaders[i].id;
+    return OTHER;
+}
+
+void HeaderTable::add(const Entry &entry) {
+    if (_size < INLINE_ENTRIES)
+        _inline[_size] = entry;
+    else
+        _overflow.push_back(entry);
+    ++_size;
+    if (entry.id != OTHER)
+        _last[entry.id] = _size;
+}
+
+void HeaderTable::clear() {
+    _overflow.clear();
+    _size = 0;
+    for (size_t i = 0; i < KNOWN_HEADERS; ++i)
+        _last[i] = 0;
+}
+
+size_t HeaderTable::size() const { return _size; }
+
+const HeaderTable::Entry &HeaderTable::operator[](size_t index) const {
+    return index < INLINE_ENTRIES ? _inline[index] : _overflow[index - INLINE_ENTRIES];
+}
+
+const HeaderTable::Entry *HeaderTable::find(Id id) const { return id == OTHER || _last[id] == 0 ? NULL : &(*this)[_last[id] - 1]; }
@@ -0,0 +1,64 @@
+#pragma once /* HeaderTable.hpp */
+
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+// The header fields of a request as slices of the buffer they were received in. Fields with one of the names the server looks at get
+// an id while they're parsed, so finding them is an array access instead of string compares. As with the map this replaces, the last
+// field of a name wins. The first INLINE_ENTRIES fields live in the table itself, only requests with more of them allocate.
+class HeaderTable {
+  public:
+    enum Id {
+        OTHER,
+        ACCEPT_ENCODING,
+        CONNECTION,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        EXPECT,
+        HOST,
+        IF_MODIFIED_SINCE,
+        IF_NONE_MATCH,
+        IF_RANGE,
+        RANGE,
+        TRANSFER_ENCODING,
+        KNOWN_HEADERS
+    };
+    struct Span {
+        size_t offset;
+        size_t length;
+
+        Span() : offset(0), length(0) {}
+        Span(size_t _offset, size_t _length) : offset(_offset), length(_length) {}
+    };
+    struct Entry {
+        Id id;
+        Span name;  // lowercase
+        Span value; // without surrounding whitespace
+
+        Entry() : id(OTHER), name(), value() {}
+        Entry(Id _id, const Span &_name, const Span &_value) : id(_id), name(_name), value(_value) {}
+    };
+
+    ~HeaderTable();
+    HeaderTable();
+    HeaderTable(const HeaderTable &other);
+    HeaderTable &operator=(const HeaderTable &other);
+
+    static Id identify(const char *lowercaseName, size_t length);
+
+    void add(const Entry &entry);
+    void clear();
+    size_t size() const;
+    const Entry &operator[](size_t index) const;
+    const Entry *find(Id id) const; // the last field with that id, NULL if there is none (or for OTHER)
+
+  private:
+    enum { INLINE_ENTRIES = 16 };
+
+    Entry _inline[INLINE_ENTRIES];
+    vector<Entry> _overflow;
+    size_t _size;
+    size_t _last[KNOWN_HEADERS]; // 1 + index of the last entry with each id, 0 if there is none
+};
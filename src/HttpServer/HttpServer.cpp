@@ -1,9 +1,14 @@
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <ostream>
 #include <signal.h>
+#include <stdexcept>
 #include <unistd.h>
 
+#include "AllocationCounter.hpp"
+#include "ByteScan.hpp"
 #include "Config.hpp"
 #include "Constants.hpp"
 #include "Exceptions.hpp"
@@ -16,15 +21,6 @@ HttpServer::~HttpServer() {
     closeAndRemoveAllMultPlexFd(_monitorFds);
 }
 
-void cgiDied(int signal) {
-    (void)signal;
-    if (Logger::lastInstance().isdebug()) {
-        if (write(1, "Some CGI process died\n", 22) < 0) {
-            /* ignore */
-        }
-    }
-}
-
 void finish(int signal) {
     (void)signal;
     HttpServer::_running = false;
@@ -38,16 +34,22 @@ void HttpServer::initSignals() {
     ::signal(SIGINT, &finish);
     log.debug() << "Handling SIGTERM to finish gracefully" << std::endl;
     ::signal(SIGTERM, &finish);
-    ::signal(SIGCHLD, &cgiDied);
+    log.debug() << "Blocking SIGCHLD, it's read from a signalfd instead" << std::endl;
+    sigset_t mask;
+    ::sigemptyset(&mask);
+    ::sigaddset(&mask, SIGCHLD);
+    if (::sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+        throw std::runtime_error(string("Failed to block SIGCHLD: ") + ::strerror(errno));
     //::signal(SIGCHLD, SIG_IGN); DON'T do this, because then things stop working, see stackoverflow
 }
 
 bool HttpServer::_running = true;
-HttpServer::HttpServer(const string &configPath, Logger &_log, size_t onlyCheckConfig)
-    : _monitorFds(Constants::defaultMultPlexType), _clientToCgi(), _cgiToClient(), _listeningSockets(),
-      _httpVersionString(Constants::httpVersionString), _rawConfig(removeComments(readConfig(configPath))),
-      _config(parseConfig(_rawConfig)), _mimeTypes(), _statusTexts(), _pendingWrites(), _pendingCloses(), _servers(), _defaultServers(),
-      _pendingRequests(), _tmpCgiFds(), persistConns(), log(_log) {
+HttpServer::HttpServer(const string &configPath, Logger &_log, size_t onlyCheckConfig, const string &multPlexMethod)
+    : _monitorFds(Constants::defaultMultPlexType), _listeningSockets(), _httpVersionString(Constants::httpVersionString),
+      _rawConfig(removeComments(readConfig(configPath))), _config(parseConfig(_rawConfig)), _mimeTypes(), _statusTexts(), _servers(),
+      _defaultServers(), _conns(), _cgiClients(), _signalFd(-1), _readyFds(), _fdsToRemove(), _ioBudget(), _keepAliveTimeout(),
+      _clientHeaderTimeout(), _clientBodyTimeout(), _sendTimeout(), _cgiTimeout(), _timers(), _expiredTimers(), _fileCache(),
+      _responseCache(), _mainloopStats(), log(_log) {
     TRACE_ARG_CTOR(const string &, configPath);
     if (onlyCheckConfig > 0) {
         if (onlyCheckConfig > 1)
@@ -58,6 +60,14 @@ HttpServer::HttpServer(const string &configPath, Logger &_log, size_t onlyCheckC
     initSignals();
     initStatusTexts(_statusTexts);
     initMimeTypes(_mimeTypes);
+    setupConnections();
+    setupMultPlexFds(_monitorFds, multPlexMethod.empty() ? getFirstDirective(_config.first, "multiplex")[0] : multPlexMethod);
+    setupReadyFds(_monitorFds);
+    setupSignalFd();
+    setupIoBudget(getFirstDirective(_config.first, "io_budget")[0]);
+    setupTimeouts(_config.first);
+    setupFileCache(_config.first);
+    setupResponseCache(_config.first);
     setupServers(_config);
 }
 
@@ -84,19 +94,32 @@ HttpServer::Server &HttpServer::Server::operator=(const Server &other) {
 
 // clang-format off
 void HttpServer::run() {
-    log.debug() << "Starting mainloop" << std::endl;
+    log.debug() << "Starting mainloop, request heads are scanned with the " << ByteScan::implementation() << " implementation" << std::endl;
+	MainloopStats &stats = _mainloopStats;
 	while (_running) {
-		MultPlexFds readyFds = getReadyFds(_monitorFds); // block until: 1) new client
-														 //              2) client that can be written to (response)
-														 //              3) client that can be read from (request)
-														 //              4) Constants::multiplexTimeout milliseconds is over
+		size_t allocsBefore = AllocationCounter::count();
+		const MultPlexFds &readyFds = getReadyFds(_monitorFds); // block until: 1) new client
+																// 2) client that can be written to (response)
+																// 3) client that can be read from (request)
+																// 4) the nearest timer is due
+		stats.waitAllocs += AllocationCounter::count() - allocsBefore;
 		handleReadyFds(readyFds); // 1) accept new client and add to pool
 								  // 2) write pending data for Constants::chunkSize bytes (and remove this disposition if done writing)
 								  // 3) read data for Constants::chunkSize bytes (or remove client if appropriate)
-								  // 4) do nothing
-		checkForInactiveClients(); // reset connection for timed out CGI's
+								  // 4) reap CGI processes that exited
+								  // 5) do nothing
+		expireTimers(); // header/body/send/keep-alive timeouts of clients and CGI timeouts
+		++stats.iterations;
+		if (readyFds.fdStates.empty() && _expiredTimers.empty()) { // nothing to do, e.g. interrupted by a signal
+			++stats.idleIterations;
+			stats.idleAllocs += AllocationCounter::count() - allocsBefore;
+		}
 		log.debug() << "Finished one mainloop iteration, the following line is intentionally left blank\n" << std::endl;
 	}
   log.warning() << "Shutting server down" << std::endl;
+	if (AllocationCounter::enabled())
+		log.info() << "Heap allocations while waiting for events: " << repr(stats.waitAllocs) << " in " << repr(stats.iterations)
+				   << " mainloop iterations, heap allocations in idle iterations: " << repr(stats.idleAllocs) << " in " << repr(stats.idleIterations)
+				   << " idle iterations" << std::endl;
 }
 // clang-format on
@@ -5,7 +5,7 @@
 #include <iostream>
 #include <map>
 #include <netinet/in.h>
-#include <set>
+#include <stdint.h>
 #include <string>
 #include <sys/epoll.h>
 #include <sys/poll.h>
@@ -15,35 +15,57 @@
 #include <utility>
 #include <vector>
 
+#include "ChunkedDecoder.hpp"
 #include "Config.hpp"
 #include "Constants.hpp"
+#include "GzipStream.hpp"
+#include "IoUring.hpp"
 #include "Logger.hpp"
+#include "OpenFileCache.hpp"
+#include "OutputQueue.hpp"
+#include "RequestBody.hpp"
+#include "RequestParser.hpp"
+#include "ResponseCache.hpp"
+#include "TimerWheel.hpp"
 #include "Utils.hpp"
 
 using Constants::MultPlexType;
 using std::map;
 using std::pair;
-using std::set;
 using std::string;
 using std::vector;
 
 class HttpServer {
   public:
     ~HttpServer();
-    HttpServer(const string &configPath, Logger &log, size_t onlyCheckConfig = 0);
+    HttpServer(const string &configPath, Logger &log, size_t onlyCheckConfig = 0, const string &multPlexMethod = "");
     operator string() const;
 
     // entry point, will run forever unless interrupted by signals or exceptions
     void run();
 
+    // heap allocations of the mainloop, only counted with COUNT_ALLOCS=1
+    struct MainloopStats {
+        size_t iterations;
+        size_t idleIterations; // woken up without a ready FD or an expired timer, e.g. by a signal or early by the timer wheel
+        size_t waitAllocs;     // made by getReadyFds in all iterations
+        size_t idleAllocs;     // made by idle iterations as a whole
+
+        MainloopStats() : iterations(0), idleIterations(0), waitAllocs(0), idleAllocs(0) {}
+    };
+
     //// forward decls ////
     struct Server;
     struct AddrPortCompare;
     struct HttpRequest;
     struct CgiProcess;
-    enum FdState { FD_READABLE, FD_WRITEABLE, FD_OTHER_STATE };
-    enum ChunkParsingState { PARSE_CHUNK, PARSE_CHUNK_SIZE };
+    struct Connection;
+    struct UringReg;
+    enum FdState { FD_READABLE, FD_WRITEABLE, FD_ACCEPTED, FD_RECEIVED, FD_OTHER_STATE }; // accepted/received: io_uring completions
+    enum UringOp { URING_POLL, URING_ACCEPT, URING_RECV };
     enum RequestState { READING_HEADERS, READING_BODY, REQUEST_COMPLETE, REQUEST_ERROR };
+    enum ConnectionKind { CONN_UNUSED, CONN_LISTENING, CONN_CLIENT, CONN_CGI_PIPE, CONN_SIGNAL };
+    enum ConnectionTimer { TIMER_NONE, TIMER_HEADER, TIMER_BODY, TIMER_SEND, TIMER_KEEPALIVE };
 
     //// typedefs ////
     typedef pair<struct in_addr, in_port_t_helper> AddrPort;
@@ -52,17 +74,14 @@ class HttpServer {
     typedef vector<Server> Servers;
     typedef vector<struct pollfd> PollFds;
     typedef vector<struct epoll_event> EpollFds;
+    typedef vector<uint32_t> EpollRegs; // indexed by fd, registered epoll events (0 means not registered)
+    typedef vector<UringReg> UringRegs; // indexed by fd
+    typedef vector<struct io_uring_cqe> UringCqes;
     typedef vector<FdState> FdStates;
     typedef map<string, string> MimeTypes;
-    typedef map<string, string> Headers;
     typedef map<int, string> StatusTexts;
-    typedef string PendingWrite;
-    typedef map<int, PendingWrite> PendingWriteMap;
-    typedef map<int, CgiProcess> ClientFdToCgiMap;
-    typedef map<int, int> CgiFdToClientMap;
-    typedef set<int> PendingCloses;
-    typedef map<int, HttpRequest> PendingRequests;
-    typedef map<int, std::time_t> PersistConns;
+    typedef OutputQueue PendingWrite;
+    typedef vector<Connection> Connections; // indexed by fd
 
     //// structs and other constructs ////
     struct HttpRequest {
@@ -70,21 +89,23 @@ class HttpServer {
         string path;
         string rawQuery;
         string httpVersion;
-        Headers headers;
-        string body;
+        RequestBody body;
         RequestState state;
         size_t contentLength;
         bool chunkedTransfer;
         size_t bytesRead;
-        string temporaryBuffer;
+        string temporaryBuffer; // bytes received behind the body, i.e. the start of the next request
+        RequestParser parser; // the head of the request including the header fields, its buffer also holds the first body bytes
+                              // received along with it
         bool pathParsed;
-        ChunkParsingState chunkParsingState;
-        size_t thisChunkSize;
+        ChunkedDecoder chunkedDecoder;
+        size_t bodySizeLimit; // client_max_body_size of the location, looked up once the head is complete (along with
+                              // client_body_buffer_size, which goes to the body)
 
         HttpRequest()
-            : method(), path("/"), rawQuery(), httpVersion(), headers(), body(), state(READING_HEADERS), contentLength(0),
-              chunkedTransfer(false), bytesRead(0), temporaryBuffer(), pathParsed(false), chunkParsingState(PARSE_CHUNK_SIZE),
-              thisChunkSize() {}
+            : method(), path("/"), rawQuery(), httpVersion(), body(), state(READING_HEADERS), contentLength(0),
+              chunkedTransfer(false), bytesRead(0), temporaryBuffer(), parser(), pathParsed(false), chunkedDecoder(),
+              bodySizeLimit(0) {}
     };
 
     struct Server {        // Basically just a thin wrapper around ServerCtx, but with some
@@ -113,6 +134,15 @@ class HttpServer {
             return a.second.port < b.second.port;
         }
     };
+    struct UringReg {
+        uint32_t events; // registered poll events (0 means not registered)
+        uint32_t gen;    // bumped on removal, so stale completions for a reused FD number can be recognized
+        bool armed;      // whether a poll request for the FD is in flight
+        UringOp input;   // how readable data is handled: polled for, or accepted/received by a multishot request instead of POLLIN
+        bool multishot;  // whether the multishot accept/recv request for the FD is in flight
+
+        UringReg() : events(0), gen(0), armed(false), input(URING_POLL), multishot(false) {}
+    };
     struct MultPlexFds {
         MultPlexType multPlexType;
 
@@ -121,16 +151,26 @@ class HttpServer {
 
         PollFds pollFds;
 
+        int epollFd;
+        bool edgeTriggered;
         EpollFds epollFds;
+        EpollRegs epollRegs;
+
+        IoUring uring; // ready FDs are reported in pollFds, along with their completion in uringCqes
+        UringRegs uringRegs;
+        UringCqes uringCqes;
 
         FdStates fdStates;
 
         MultPlexFds(MultPlexType initMultPlexType)
-            : multPlexType(initMultPlexType), selectFdSet(), selectFds(), pollFds(), epollFds(), fdStates() {
+            : multPlexType(initMultPlexType), selectFdSet(), selectFds(), pollFds(), epollFd(-1), edgeTriggered(false), epollFds(),
+              epollRegs(), uring(), uringRegs(), uringCqes(), fdStates() {
             FD_ZERO(&selectFdSet);
         }
         // private: //should be private, but can't because of Repr.hpp
-        MultPlexFds() : multPlexType(Constants::defaultMultPlexType), selectFdSet(), selectFds(), pollFds(), epollFds(), fdStates() {}
+        MultPlexFds()
+            : multPlexType(Constants::defaultMultPlexType), selectFdSet(), selectFds(), pollFds(), epollFd(-1), edgeTriggered(false),
+              epollFds(), epollRegs(), uring(), uringRegs(), uringCqes(), fdStates() {}
     };
     struct CgiProcess {
         pid_t pid;
@@ -141,23 +181,63 @@ class HttpServer {
         int clientSocket;
         const LocationCtx *location;
         bool headersSent;
-        std::time_t lastActive;
         bool dead;
-        bool noRecentReadEvent;
+        int status; // wait status, valid once dead
         bool done;
+        GzipStream gzip;    // active if the output is compressed on its way to the client
+        bool chunked;       // whether the body is sent with Transfer-Encoding: chunked
+        size_t contentLeft; // body bytes still to send according to the script's Content-Length, npos without one
 
+        CgiProcess()
+            : pid(-1), readFd(-1), writeFd(-1), response(), totalSize(0), clientSocket(-1), location(NULL), headersSent(false),
+              dead(false), status(0), done(false), gzip(), chunked(false), contentLeft(string::npos) {}
         CgiProcess(pid_t _pid, int _readFd, int _writeFd, int _clientSocket, const LocationCtx *_location)
             : pid(_pid), readFd(_readFd), writeFd(_writeFd), response(), totalSize(0), clientSocket(_clientSocket), location(_location),
-              headersSent(false), lastActive(std::time(NULL)), dead(false), noRecentReadEvent(true), done(false) {}
+              headersSent(false), dead(false), status(0), done(false), gzip(), chunked(false), contentLeft(string::npos) {}
         CgiProcess(const CgiProcess &other)
             : pid(other.pid), readFd(other.readFd), writeFd(other.writeFd), response(other.response), totalSize(other.totalSize),
-              clientSocket(other.clientSocket), location(other.location), headersSent(other.headersSent), lastActive(other.lastActive),
-              dead(other.dead), noRecentReadEvent(other.noRecentReadEvent), done(other.done) {}
-        CgiProcess &operator=(const CgiProcess &) {
+              clientSocket(other.clientSocket), location(other.location), headersSent(other.headersSent), dead(other.dead),
+              status(other.status), done(other.done), gzip(other.gzip), chunked(other.chunked), contentLeft(other.contentLeft) {}
+        CgiProcess &operator=(const CgiProcess &other) {
+            pid = other.pid;
+            readFd = other.readFd;
+            writeFd = other.writeFd;
+            response = other.response;
+            totalSize = other.totalSize;
+            clientSocket = other.clientSocket;
+            location = other.location;
+            headersSent = other.headersSent;
+            dead = other.dead;
+            status = other.status;
+            done = other.done;
+            gzip = other.gzip;
+            chunked = other.chunked;
+            contentLeft = other.contentLeft;
             return *this;
-        } // forgot the reason why we have define a copy constructor and copy assignment
-          // operator, but I think it was because we use CgiProcess in a map and something
-          // with references or so
+        }
+    };
+    struct Connection { // everything the server knows about one FD, stored at index fd in _conns
+        ConnectionKind kind;
+        bool hasRequest; // request parser state
+        HttpRequest request;
+        string pipelined; // bytes received behind the current request, parsed once its response is queued
+        bool hasPendingWrite; // output queue
+        PendingWrite pendingWrite;
+        bool pendingClose;
+        bool persistent; // keep the connection open after the current response (keep-alive)
+        std::time_t connectedSince;
+        ConnectionTimer timer;        // what the client is given time for, see armTimer()
+        std::time_t keepAliveTimeout; // from the location of the last request, 0 disables keep-alive
+        size_t requestsServed;        // for keepalive_requests
+        bool hasCgi; // for remote clients: the CGI process producing the response
+        CgiProcess cgi;
+        int cgiClient;   // for CGI pipe FDs: the remote client they belong to, -1 if none
+        size_t pollIndex; // slot in MultPlexFds::pollFds (POLL only)
+
+        Connection(ConnectionKind _kind = CONN_UNUSED)
+            : kind(_kind), hasRequest(false), request(), pipelined(), hasPendingWrite(false), pendingWrite(), pendingClose(false), persistent(false),
+              connectedSince(0), timer(TIMER_NONE), keepAliveTimeout(0), requestsServed(0), hasCgi(false), cgi(), cgiClient(-1),
+              pollIndex(0) {}
     };
 
     const vector<int> &get_listeningSockets() const { return _listeningSockets; }
@@ -166,19 +246,15 @@ class HttpServer {
     const Config &get_config() const { return _config; }
     const MimeTypes &get_mimeTypes() const { return _mimeTypes; }
     const StatusTexts &get_statusTexts() const { return _statusTexts; }
-    const PendingWriteMap &get_pendingWrites() const { return _pendingWrites; }
-    const PendingCloses &get_pendingCloses() const { return _pendingCloses; }
     const Servers &get_servers() const { return _servers; }
     const DefaultServers &get_defaultServers() const { return _defaultServers; }
-    const PendingRequests &get_pendingRequests() const { return _pendingRequests; }
     const MultPlexFds &get_monitorFds() const { return _monitorFds; }
-    const ClientFdToCgiMap &get_clientToCgi() const { return _clientToCgi; }
-    const CgiFdToClientMap &get_cgiToClient() const { return _cgiToClient; }
+    const Connections &get_conns() const { return _conns; }
+    const vector<int> &get_cgiClients() const { return _cgiClients; }
+    const MainloopStats &get_mainloopStats() const { return _mainloopStats; }
 
     static bool _running;
     MultPlexFds _monitorFds;
-    ClientFdToCgiMap _clientToCgi;
-    CgiFdToClientMap _cgiToClient;
 
   private:
     //// private members ////
@@ -188,42 +264,74 @@ class HttpServer {
     const Config _config;
     MimeTypes _mimeTypes;
     StatusTexts _statusTexts;
-    PendingWriteMap _pendingWrites;
-    PendingCloses _pendingCloses;
     Servers _servers;
     DefaultServers _defaultServers;
-    PendingRequests _pendingRequests;
-    set<int> _tmpCgiFds;
-    PersistConns persistConns;
+    Connections _conns;
+    vector<int> _cgiClients;          // remote clients that currently have a CGI process attached
+    int _signalFd;                    // reports SIGCHLD, see handleChildExits
+    MultPlexFds _readyFds;            // ready-list, refilled by every mainloop iteration
+    vector<int> _fdsToRemove;         // scratch space for getReadyFds
+    size_t _ioBudget;                 // max bytes read from/written to one FD per readiness event
+    std::time_t _keepAliveTimeout;    // http-level keepalive_timeout, for clients that haven't sent a request yet
+    std::time_t _clientHeaderTimeout; // all timeouts are in seconds
+    std::time_t _clientBodyTimeout;
+    std::time_t _sendTimeout;
+    std::time_t _cgiTimeout;
+    TimerWheel _timers;               // two timers per FD: the connection timer and the CGI timer of a client
+    vector<size_t> _expiredTimers;    // scratch space for expireTimers
+    OpenFileCache _fileCache;         // stat results and open FDs of static files, see open_file_cache
+    ResponseCache _responseCache;     // serialised responses of small static files, see response_cache_size
+    MainloopStats _mainloopStats;
     Logger &log;
 
     //// private methods ////
     // HttpServer must always be constructed with a config
     HttpServer()
-        : _monitorFds(Constants::defaultMultPlexType), _clientToCgi(), _cgiToClient(), _listeningSockets(), _httpVersionString(),
-          _rawConfig(), _config(), _mimeTypes(), _statusTexts(), _pendingWrites(), _pendingCloses(), _servers(), _defaultServers(),
-          _pendingRequests(), _tmpCgiFds(), persistConns(), log(Logger::lastInstance()) {};
+        : _monitorFds(Constants::defaultMultPlexType), _listeningSockets(), _httpVersionString(), _rawConfig(), _config(), _mimeTypes(),
+          _statusTexts(), _servers(), _defaultServers(), _conns(), _cgiClients(), _signalFd(-1), _readyFds(), _fdsToRemove(), _ioBudget(),
+          _keepAliveTimeout(), _clientHeaderTimeout(), _clientBodyTimeout(), _sendTimeout(), _cgiTimeout(), _timers(), _expiredTimers(),
+          _fileCache(), _responseCache(), _mainloopStats(), log(Logger::lastInstance()) {};
     // Copying HttpServer is forbidden, since that would violate the 1-1 mapping between a
     // server and its config
     HttpServer(const HttpServer &)
-        : _monitorFds(Constants::defaultMultPlexType), _clientToCgi(), _cgiToClient(), _listeningSockets(), _httpVersionString(),
-          _rawConfig(), _config(), _mimeTypes(), _statusTexts(), _pendingWrites(), _pendingCloses(), _servers(), _defaultServers(),
-          _pendingRequests(), _tmpCgiFds(), persistConns(), log(Logger::lastInstance()) {};
+        : _monitorFds(Constants::defaultMultPlexType), _listeningSockets(), _httpVersionString(), _rawConfig(), _config(), _mimeTypes(),
+          _statusTexts(), _servers(), _defaultServers(), _conns(), _cgiClients(), _signalFd(-1), _readyFds(), _fdsToRemove(), _ioBudget(),
+          _keepAliveTimeout(), _clientHeaderTimeout(), _clientBodyTimeout(), _sendTimeout(), _cgiTimeout(), _timers(), _expiredTimers(),
+          _fileCache(), _responseCache(), _mainloopStats(), log(Logger::lastInstance()) {};
     // HttpServer cannot be assigned to
     HttpServer &operator=(const HttpServer &) { return *this; };
 
     // Setup
     void setupServers(const Config &config);
     void setupListeningSocket(const Server &server);
+    void setupMultPlexFds(MultPlexFds &monitorFds, const string &multPlexMethod);
+    void setupConnections();
+    void setupReadyFds(const MultPlexFds &monitorFds);
+    void setupIoBudget(const string &ioBudget);
+    void setupSignalFd();
+    void setupTimeouts(const Directives &httpDirectives);
+    void setupFileCache(const Directives &httpDirectives);
+    void setupResponseCache(const Directives &httpDirectives);
     void initSignals();
 
     // Adding a client
-    void addNewClient(int listeningSocket);
-    void addClientSocketToPollFds(MultPlexFds &monitorFds, int clientSocket);
+    bool addNewClient(int listeningSocket);
+    void addAcceptedClient(int listeningSocket, const struct io_uring_cqe &cqe);
+    void registerClient(int clientSocket, const struct sockaddr_in &clientAddr);
+    void addFdToPollFds(MultPlexFds &monitorFds, int fd, short events);
+    void addFdToEpollFds(MultPlexFds &monitorFds, int fd, short events);
+    void addFdToIoUringFds(MultPlexFds &monitorFds, int fd, short events);
     void addClientSocketToMonitorFds(MultPlexFds &monitorFds, int clientSocket);
 
+  public:
+    void addFdToMonitorFds(MultPlexFds &monitorFds, int fd, short events);
+    void attachCgiProcess(int clientSocket, const CgiProcess &process);
+
+  private:
     // Reading from a client
-    void readFromClient(int clientSocket);
+    bool readFromClient(int clientSocket, size_t &budget);
+    bool receivedFromClient(int clientSocket, char *buffer, ssize_t bytesRead);
+    void handleIoUringRecv(int clientSocket, const struct io_uring_cqe &cqe);
 
     // request parsing
     size_t findMatchingServer(const string &host, const struct in_addr &addr, in_port_t port) const;
@@ -237,13 +345,16 @@ class HttpServer {
     string resolveDots(const string &str);
 
     // request handling
-    void handleRequest(int clientSocket, const HttpRequest &request, const LocationCtx &location);
-    void handleRequestInternally(int clientSocket, const HttpRequest &request, const LocationCtx &location);
-    bool methodAllowed(int clientSocket, const HttpRequest &request, const LocationCtx &location);
+    void handleRequest(int clientSocket, HttpRequest &request, const LocationCtx &location);
+    void applyKeepAlive(int clientSocket, const LocationCtx &location);
+    void handleRequestInternally(int clientSocket, HttpRequest &request, const LocationCtx &location);
+    bool methodAllowed(int clientSocket, const HttpRequest &request, const LocationCtx &location, bool sendErrorMsg = true);
+    bool requestIsHandledInternally(const HttpRequest &request, const LocationCtx &location);
     void handleDelete(int clientSocket, const HttpRequest &request, const LocationCtx &location);
     void rewriteRequest(int clientSocket, int statusCode, const string &urlOrText, const LocationCtx &location);
     void redirectClient(int clientSocket, const string &newUri, int statusCode = 301);
-    void handleUpload(int clientSocket, const HttpRequest &request, const LocationCtx &location, bool overwrite);
+    void handleUpload(int clientSocket, HttpRequest &request, const LocationCtx &location, bool overwrite);
+    void startUpload(int clientSocket, HttpRequest &request, const LocationCtx &location);
 
     // static file serving
     void serveStaticContent(int clientSocket, const HttpRequest &request, const LocationCtx &location);
@@ -254,49 +365,96 @@ class HttpServer {
                              bool sendErrorMsg = true);
     bool handleIndexes(int clientSocket, const string &diskPath, const HttpRequest &request, const LocationCtx &location);
     bool handleDirectoryRedirect(int clientSocket, const string &uri);
+    bool isNotModified(const HttpRequest &request, const struct stat &fileInfo);
+    static bool acceptsEncoding(const RequestParser &parser, const char *coding);
+    bool ifRangeMatches(const HttpRequest &request, const struct stat &fileInfo);
+    bool sendFileRanges(int clientSocket, const string &filePath, const HttpRequest &request, const LocationCtx &location,
+                        const string &contentType = "", const string &extraHeaders = "");
+    void selectStaticVariant(const HttpRequest &request, const LocationCtx &location, string &diskPath, struct stat &fileStat,
+                             string &extraHeaders);
 
     // CGI
     bool requestIsForCgi(const HttpRequest &request, const LocationCtx &location);
-    void handleCgiRead(int fd);
+    bool handleCgiRead(int fd, size_t &budget);
+    void finishCgiResponse(int clientSocket, int cgiFd);
+    void queueCgiBody(int clientSocket, const char *data, size_t size, bool finish);
+    static bool cgiHeaderValue(const string &lowercaseHeaders, const string &name, string &value);
+    void handleChildExits();
+    void handleCgiExit(int clientSocket, int status);
 
     // Timeout
-    void checkForInactiveClients();
+    void armTimer(int clientSocket, ConnectionTimer timer);
+    void armCgiTimer(int clientSocket);
+    void cancelCgiTimer(int clientSocket);
+    void cancelTimers(int fd);
+    void expireTimers();
+    int waitTimeout();
+    void handleConnectionTimeout(int clientSocket);
+    void handleCgiTimeout(int clientSocket);
 
     // Writing to a client
-    void writeToClient(int clientSocket);
+    bool writeToClient(int clientSocket, size_t &budget);
     void sendString(int clientSocket, const string &payload, int statusCode = 200, const string &contentType = "text/html",
-                    bool onlyHeaders = false);
+                    bool onlyHeaders = false, const LocationCtx *location = NULL);
+    int gzipLevel(int clientSocket, const LocationCtx *location, const string &contentType, size_t length, bool &varies);
 
   public:
     void sendError(int clientSocket, int statusCode, const LocationCtx *const location);
     void queueWrite(int clientSocket, const string &data);
+    void queueFile(int clientSocket, int fd, off_t offset, size_t length);
+    void queueBody(int clientSocket, const RequestBody &body);
 
   private:
     bool sendErrorPage(int clientSocket, int statusCode, const LocationCtx &location);
     bool sendFileContent(int clientSocket, const string &filePath, const LocationCtx &location, int statusCode = 200,
-                         const string &contentType = "", bool onlyHeaders = false);
+                         const string &contentType = "", bool onlyHeaders = false, const string &extraHeaders = "");
+    void queueFileResponse(int clientSocket, int fd, const struct stat &fileInfo, const string &filePath, int statusCode,
+                           const string &contentType = "", bool onlyHeaders = false, const string &extraHeaders = "");
+    bool sendCachedResponse(int clientSocket, const string &filePath, const LocationCtx &location, bool onlyHeaders);
+    string entityTag(const struct stat &fileInfo);
+    string validatorHeaders(const struct stat &fileInfo, bool weak = false);
+    void sendNotModified(int clientSocket, const struct stat &fileInfo, const string &extraHeaders = "");
+    void queueCachedResponse(int clientSocket, const ResponseCache::Response &response, bool onlyHeaders);
     PendingWrite &updatePendingWrite(PendingWrite &pw);
 
     // Removing a client
     void removeClient(int clientSocket);
     void closeAndRemoveMultPlexFd(MultPlexFds &monitorFds, int fd);
     void removePollFd(MultPlexFds &monitorFds, int fd);
+    void removeEpollFd(MultPlexFds &monitorFds, int fd);
+    void removeIoUringFd(MultPlexFds &monitorFds, int fd);
     void closeAndRemoveAllMultPlexFd(MultPlexFds &monitorFds);
     void closeAndRemoveAllPollFd(MultPlexFds &monitorFds);
-    bool maybeTerminateConnection(PendingWriteMap::iterator it, int clientSocket);
-    void terminateIfNoPendingDataAndNoCgi(PendingWriteMap::iterator &it, int clientSocket, ssize_t bytesSent);
+    void closeAndRemoveAllEpollFd(MultPlexFds &monitorFds);
+    void closeAndRemoveAllIoUringFd(MultPlexFds &monitorFds);
+    bool maybeTerminateConnection(int clientSocket);
+    void terminateIfNoPendingDataAndNoCgi(int clientSocket, ssize_t bytesSent);
     void terminatePendingCloses(int clientSocket);
+    const char *connectionHeader(int clientSocket);
 
     // Monitor sockets (the blocking part)
-    MultPlexFds getReadyFds(MultPlexFds &monitorFds);
-    MultPlexFds doPoll(MultPlexFds &monitorFds);
-    MultPlexFds getReadyPollFds(MultPlexFds &monitorFds, int nReady, struct pollfd *pollFds, nfds_t nPollFds);
+    const MultPlexFds &getReadyFds(MultPlexFds &monitorFds);
+    void doPoll(MultPlexFds &monitorFds, MultPlexFds &readyFds, int timeoutMs);
+    void getReadyPollFds(MultPlexFds &monitorFds, MultPlexFds &readyFds, int nReady, struct pollfd *pollFds, nfds_t nPollFds);
+    void doEpoll(MultPlexFds &monitorFds, MultPlexFds &readyFds, int timeoutMs);
+    void getReadyEpollFds(MultPlexFds &monitorFds, MultPlexFds &readyFds, int nReady);
+    void doIoUring(MultPlexFds &monitorFds, MultPlexFds &readyFds, int timeoutMs);
+    void getReadyIoUringFds(MultPlexFds &monitorFds, MultPlexFds &readyFds);
 
     // Handle monitoring state for socket (i.e. for POLL, add/remove the POLLOUT event,
     // etc.)
     void stopMonitoringForWriteEvents(MultPlexFds &monitorFds, int clientSocket);
     void startMonitoringForWriteEvents(MultPlexFds &monitorFds, int clientSocket);
     void updatePollEvents(MultPlexFds &monitorFds, int clientSocket, short events, bool add);
+    void updateEpollEvents(MultPlexFds &monitorFds, int clientSocket, short events, bool add);
+    void updateIoUringEvents(MultPlexFds &monitorFds, int clientSocket, short events, bool add);
+    static void armIoUringPoll(MultPlexFds &monitorFds, int fd);
+    static void armIoUringInput(MultPlexFds &monitorFds, int fd);
+    static uint32_t ioUringPollEvents(const UringReg &reg);
+    static uint64_t ioUringUserData(int fd, uint32_t gen, UringOp op);
+    static bool ioUringCompletionIsCurrent(const MultPlexFds &monitorFds, const struct io_uring_cqe &cqe);
+    void rearmEdgeTriggeredFd(MultPlexFds &monitorFds, int fd);
+    static uint32_t pollEventsToEpollEvents(short events, bool edgeTriggered);
 
     // Multiplex I/O file descriptor helpers
     void handleReadyFds(const MultPlexFds &readyFds);
@@ -304,25 +462,35 @@ class HttpServer {
     nfds_t getNumberOfPollFds(const MultPlexFds &fds);
     int multPlexFdToRawFd(const MultPlexFds &readyFds, size_t i);
     vector<int> multPlexFdsToRawFds(const MultPlexFds &readyFds);
-    MultPlexFds determineRemoteClients(const MultPlexFds &m, vector<int> ls, const CgiFdToClientMap &cgiToClient);
+    MultPlexFds determineRemoteClients(const MultPlexFds &m);
+
+    // Connection table
+    Connection &conn(int fd);
+    void resetConnection(int fd, ConnectionKind kind);
+    CgiProcess *cgiOf(int clientSocket);
+    int cgiClientOf(int fd);
+    void detachCgi(int clientSocket);
+    void closeCgiPipe(int clientSocket, int pipeFd);
 
     // helpers
     string getMimeType(const string &path);
     string statusTextFromCode(int statusCode);
     string generateServerMessage(const string &text);
     bool isListeningSocket(int socket);
+    bool isMonitoredFd(const MultPlexFds &monitorFds, int fd);
 
     // POST related
     bool isHeaderComplete(const HttpRequest &request) const;
     bool updateSomeThingsBasedOnHeaders(int clientSocket, HttpRequest &request);
     bool validateRequest(const HttpRequest &request, int clientSocket);
-    bool parseRequestLine(int clientSocket, const string &line, HttpRequest &request);
-    bool parseHeader(const string &line, HttpRequest &request);
-    size_t getRequestSizeLimit(int clientSocket, const HttpRequest &request);
+    bool parseRequestLine(int clientSocket, HttpRequest &request);
+    void prepareBody(int clientSocket, HttpRequest &request);
 
     // Request processing stages
     void handleIncomingData(int clientSocket, const char *buffer, ssize_t bytesRead);
-    bool processRequestHeaders(int clientSocket, HttpRequest &request, const string &rawData);
+    void parseIncomingData(int clientSocket, const char *buffer, size_t bytesRead);
+    void resumePipelinedRequests(int clientSocket);
+    bool processRequestHeaders(int clientSocket, HttpRequest &request);
     bool processRequestBody(int clientSocket, HttpRequest &request, const char *buffer, size_t bytesRead);
     void finalizeRequest(int clientSocket, HttpRequest &request);
     void removeClientAndRequest(int clientSocket);
@@ -330,9 +498,8 @@ class HttpServer {
     bool checkRequestSizeWithoutBody(int clientSocket, size_t currentSize);
 
     // chunked request
-    bool processChunkedData(int clientSocket, HttpRequest &request);
-    bool getChunkAndConsume(string &buffer, size_t chunkSize, string &retChunk);
-    bool getChunkSizeStrAndConsume(string &buffer, string &chunkSizeStr);
+    bool processChunkedData(int clientSocket, HttpRequest &request, const char *data, size_t size);
+    bool processUnchunkedData(int clientSocket, HttpRequest &request, const char *data, size_t size);
 };
 
 std::ostream &operator<<(std::ostream &, const HttpServer &);
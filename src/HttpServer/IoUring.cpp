@@ -0,0 +1,265 @@
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "IoUring.hpp"
+
+using std::runtime_error;
+using std::string;
+
+const uint64_t IoUring::ignoredUserData = ~static_cast<uint64_t>(0);
+const uint16_t IoUring::bufferGroup = 0;
+
+IoUring::~IoUring() {}
+
+IoUring::IoUring()
+    : _fd(-1), _ring(NULL), _ringSize(0), _sqes(NULL), _sqesSize(0), _sqEntries(0), _sqMask(0), _sqHead(NULL), _sqTail(NULL), _cqMask(0),
+      _cqHead(NULL), _cqTail(NULL), _cqes(NULL), _bufRing(NULL), _buffers(NULL), _bufMapSize(0), _bufCount(0), _bufSize(0), _bufTail(0) {}
+
+IoUring::IoUring(const IoUring &other)
+    : _fd(other._fd), _ring(other._ring), _ringSize(other._ringSize), _sqes(other._sqes), _sqesSize(other._sqesSize),
+      _sqEntries(other._sqEntries), _sqMask(other._sqMask), _sqHead(other._sqHead), _sqTail(other._sqTail), _cqMask(other._cqMask),
+      _cqHead(other._cqHead), _cqTail(other._cqTail), _cqes(other._cqes), _bufRing(other._bufRing), _buffers(other._buffers),
+      _bufMapSize(other._bufMapSize), _bufCount(other._bufCount), _bufSize(other._bufSize), _bufTail(other._bufTail) {}
+
+IoUring &IoUring::operator=(const IoUring &other) {
+    if (this == &other)
+        return *this;
+    _fd = other._fd;
+    _ring = other._ring;
+    _ringSize = other._ringSize;
+    _sqes = other._sqes;
+    _sqesSize = other._sqesSize;
+    _sqEntries = other._sqEntries;
+    _sqMask = other._sqMask;
+    _sqHead = other._sqHead;
+    _sqTail = other._sqTail;
+    _cqMask = other._cqMask;
+    _cqHead = other._cqHead;
+    _cqTail = other._cqTail;
+    _cqes = other._cqes;
+    _bufRing = other._bufRing;
+    _buffers = other._buffers;
+    _bufMapSize = other._bufMapSize;
+    _bufCount = other._bufCount;
+    _bufSize = other._bufSize;
+    _bufTail = other._bufTail;
+    return *this;
+}
+
+template <typename T> static T *ringField(void *ring, uint32_t offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+}
+
+void IoUring::setup(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    _fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (_fd < 0)
+        throw runtime_error(string("io_uring_setup failed: ") + ::strerror(errno));
+    // a single mmap for both rings and waiting with a timeout without an extra SQE (Linux 5.11)
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        close();
+        throw runtime_error("io_uring is too old, IORING_FEAT_SINGLE_MMAP and IORING_FEAT_EXT_ARG are required");
+    }
+
+    size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    _ringSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize;
+    _ring = ::mmap(NULL, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_ring == MAP_FAILED) {
+        _ring = NULL;
+        close();
+        throw runtime_error(string("Failed to map the io_uring rings: ") + ::strerror(errno));
+    }
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = ::mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        close();
+        throw runtime_error(string("Failed to map the io_uring SQEs: ") + ::strerror(errno));
+    }
+    _sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    _sqEntries = params.sq_entries;
+    _sqMask = *ringField<unsigned>(_ring, params.sq_off.ring_mask);
+    _sqHead = ringField<unsigned>(_ring, params.sq_off.head);
+    _sqTail = ringField<unsigned>(_ring, params.sq_off.tail);
+    _cqMask = *ringField<unsigned>(_ring, params.cq_off.ring_mask);
+    _cqHead = ringField<unsigned>(_ring, params.cq_off.head);
+    _cqTail = ringField<unsigned>(_ring, params.cq_off.tail);
+    _cqes = ringField<struct io_uring_cqe>(_ring, params.cq_off.cqes);
+
+    // SQE i always lives in slot i, so the indirection array never changes
+    unsigned *sqArray = ringField<unsigned>(_ring, params.sq_off.array);
+    for (unsigned i = 0; i < _sqEntries; ++i)
+        sqArray[i] = i;
+}
+
+// Registers count buffers of size bytes each, which multishot recv requests pick from (Linux 5.19). The last byte of every buffer is
+// not handed to the kernel, so received data can always be NUL-terminated.
+void IoUring::setupBufferRing(unsigned count, unsigned size) {
+    size_t ringSize = count * sizeof(struct io_uring_buf);
+    _bufMapSize = ringSize + static_cast<size_t>(count) * size;
+    void *map = ::mmap(NULL, _bufMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (map == MAP_FAILED)
+        throw runtime_error(string("Failed to map the io_uring buffer ring: ") + ::strerror(errno));
+    _bufRing = static_cast<struct io_uring_buf_ring *>(map);
+    _buffers = static_cast<char *>(map) + ringSize;
+    _bufCount = count;
+    _bufSize = size;
+    _bufTail = 0;
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(_bufRing));
+    reg.ring_entries = count;
+    reg.bgid = bufferGroup;
+    if (::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int error = errno;
+        close();
+        throw runtime_error(string("Failed to register the io_uring buffer ring (Linux 5.19 is required): ") + ::strerror(error));
+    }
+    for (unsigned bid = 0; bid < count; ++bid)
+        addBuffer(static_cast<uint16_t>(bid));
+    __atomic_store_n(&_bufRing->tail, _bufTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::addBuffer(uint16_t bid) {
+    // not _bufRing->bufs, the flexible array of the kernel header doesn't start at offset 0 when compiled as C++
+    struct io_uring_buf &buf = reinterpret_cast<struct io_uring_buf *>(_bufRing)[_bufTail & (_bufCount - 1)];
+    buf.addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(_buffers + static_cast<size_t>(bid) * _bufSize));
+    buf.len = _bufSize - 1;
+    buf.bid = bid;
+    ++_bufTail;
+}
+
+char *IoUring::buffer(const struct io_uring_cqe &cqe) const {
+    if (!(cqe.flags & IORING_CQE_F_BUFFER))
+        return NULL;
+    return _buffers + static_cast<size_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT) * _bufSize;
+}
+
+// hands the buffer of a completion back to the kernel, completions without one are ignored
+void IoUring::recycleBuffer(const struct io_uring_cqe &cqe) {
+    if (!(cqe.flags & IORING_CQE_F_BUFFER))
+        return;
+    addBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+    __atomic_store_n(&_bufRing->tail, _bufTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::close() {
+    if (_bufRing != NULL)
+        ::munmap(_bufRing, _bufMapSize);
+    if (_sqes != NULL)
+        ::munmap(_sqes, _sqesSize);
+    if (_ring != NULL)
+        ::munmap(_ring, _ringSize);
+    if (_fd >= 0)
+        ::close(_fd);
+    *this = IoUring();
+}
+
+int IoUring::fd() const { return _fd; }
+
+// the kernel advances the SQ head while consuming, we own the tail
+unsigned IoUring::pendingSqes() const { return *_sqTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE); }
+
+struct io_uring_sqe &IoUring::nextSqe() {
+    if (pendingSqes() >= _sqEntries && submit() < 0)
+        throw runtime_error(string("io_uring submission queue is full and submitting failed: ") + ::strerror(errno));
+    unsigned tail = *_sqTail;
+    struct io_uring_sqe &sqe = _sqes[tail & _sqMask];
+    std::memset(&sqe, 0, sizeof(sqe));
+    return sqe;
+}
+
+void IoUring::prepPollAdd(int fd, uint32_t events, uint64_t userData) {
+    struct io_uring_sqe &sqe = nextSqe();
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd;
+    sqe.poll32_events = events;
+    sqe.user_data = userData;
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+}
+
+void IoUring::prepPollUpdate(uint64_t userData, uint32_t events) {
+    struct io_uring_sqe &sqe = nextSqe();
+    sqe.opcode = IORING_OP_POLL_REMOVE;
+    sqe.fd = -1;
+    sqe.addr = userData;
+    sqe.len = IORING_POLL_UPDATE_EVENTS;
+    sqe.poll32_events = events;
+    sqe.user_data = ignoredUserData;
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+}
+
+// one accept request keeps producing a completion for every new connection (Linux 5.19), the client sockets are non-blocking
+void IoUring::prepMultishotAccept(int fd, uint64_t userData) {
+    struct io_uring_sqe &sqe = nextSqe();
+    sqe.opcode = IORING_OP_ACCEPT;
+    sqe.fd = fd;
+    sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe.user_data = userData;
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+}
+
+// one recv request keeps producing a completion for every piece of data that arrives (Linux 6.0)
+void IoUring::prepMultishotRecv(int fd, uint64_t userData) {
+    struct io_uring_sqe &sqe = nextSqe();
+    sqe.opcode = IORING_OP_RECV;
+    sqe.fd = fd;
+    sqe.ioprio = IORING_RECV_MULTISHOT;
+    sqe.flags = IOSQE_BUFFER_SELECT;
+    sqe.buf_group = bufferGroup;
+    sqe.user_data = userData;
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+}
+
+void IoUring::prepCancelFd(int fd) {
+    struct io_uring_sqe &sqe = nextSqe();
+    sqe.opcode = IORING_OP_ASYNC_CANCEL;
+    sqe.fd = fd;
+    sqe.cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe.user_data = ignoredUserData;
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize) {
+    long ret = ::syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, arg, argSize);
+    return ret < 0 ? -errno : static_cast<int>(ret);
+}
+
+int IoUring::submit() {
+    unsigned toSubmit = pendingSqes();
+    if (toSubmit == 0)
+        return 0;
+    return enter(toSubmit, 0, 0, NULL, 0);
+}
+
+int IoUring::submitAndWait(int timeoutMs) {
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+    struct io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    if (timeoutMs >= 0) // without a timespec the kernel waits until something completes
+        arg.ts = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&ts));
+    return enter(pendingSqes(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+bool IoUring::popCqe(struct io_uring_cqe &cqe) {
+    unsigned head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE))
+        return false;
+    cqe = _cqes[head & _cqMask];
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
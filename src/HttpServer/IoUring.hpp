@@ -0,0 +1,63 @@
+#pragma once /* IoUring.hpp */
+
+#include <cstddef>
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+// Minimal io_uring submission/completion ring on top of the raw syscalls (no liburing needed).
+// Copies refer to the same ring, it's only released by close().
+class IoUring {
+  public:
+    ~IoUring();
+    IoUring();
+    IoUring(const IoUring &other);
+    IoUring &operator=(const IoUring &other);
+
+    void setup(unsigned entries);
+    void setupBufferRing(unsigned count, unsigned size); // count must be a power of two
+    void close();
+    int fd() const;
+
+    // the SQEs are only queued, submit() or submitAndWait() hands them to the kernel
+    void prepPollAdd(int fd, uint32_t events, uint64_t userData);
+    void prepPollUpdate(uint64_t userData, uint32_t events);
+    void prepMultishotAccept(int fd, uint64_t userData);
+    void prepMultishotRecv(int fd, uint64_t userData); // into the buffers of the buffer ring
+    void prepCancelFd(int fd);                         // cancels all requests for the FD
+    int submit();                                      // returns the number of submitted SQEs or -errno
+    int submitAndWait(int timeoutMs); // timeoutMs < 0 waits forever, returns -ETIME if nothing completed in time, -errno on error
+    bool popCqe(struct io_uring_cqe &cqe);
+
+    // a buffer picked by the kernel for a recv completion belongs to us until it's recycled. It has room for a terminating NUL
+    char *buffer(const struct io_uring_cqe &cqe) const;
+    void recycleBuffer(const struct io_uring_cqe &cqe);
+
+    static const uint64_t ignoredUserData; // for SQEs whose completion is of no interest
+    static const uint16_t bufferGroup;
+
+  private:
+    int _fd;
+    void *_ring;
+    size_t _ringSize;
+    struct io_uring_sqe *_sqes;
+    size_t _sqesSize;
+    unsigned _sqEntries;
+    unsigned _sqMask;
+    unsigned *_sqHead;
+    unsigned *_sqTail;
+    unsigned _cqMask;
+    unsigned *_cqHead;
+    unsigned *_cqTail;
+    struct io_uring_cqe *_cqes;
+    struct io_uring_buf_ring *_bufRing;
+    char *_buffers;     // behind the buffer ring in the same mapping
+    size_t _bufMapSize; // of the buffer ring and the buffers
+    unsigned _bufCount;
+    unsigned _bufSize;
+    uint16_t _bufTail;
+
+    struct io_uring_sqe &nextSqe();
+    unsigned pendingSqes() const;
+    void addBuffer(uint16_t bid);
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize);
+};
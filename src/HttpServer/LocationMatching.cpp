@@ -110,14 +110,10 @@ string getHost(const HttpServer::HttpRequest &request) {
     Logger::lastInstance().debug() << "Getting host value from request " << repr(request) << std::endl;
     string host;
     bool notFound = true;
-    if (request.headers.find("host") != request.headers.end()) {
-        if (request.headers.find("host") != request.headers.end()) {
-            host = request.headers.at("host");
-            notFound = false;
-            size_t colonPos = host.find(':');
-            if (colonPos != string::npos)
-                host = host.substr(0, colonPos);
-        }
+    if (const RequestParser::Span *field = request.parser.header(HeaderTable::HOST)) {
+        const char *value = request.parser.data(*field);
+        host.assign(value, std::find(value, value + field->length, ':'));
+        notFound = false;
     }
     if (notFound)
         Logger::lastInstance().debug() << "Host header not found in request, leaving empty" << std::endl;
@@ -0,0 +1,139 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "OpenFileCache.hpp"
+#include "TimerWheel.hpp"
+
+OpenFileCache::~OpenFileCache() {
+    while (!_lru.empty())
+        evict(_lru.begin());
+}
+
+OpenFileCache::OpenFileCache()
+    : _lru(), _index(), _miss(), _maxEntries(0), _inactiveMs(0), _validMs(0), _minUses(1), _cacheErrors(false) {}
+
+void OpenFileCache::configure(size_t maxEntries, uint64_t inactiveMs, uint64_t validMs, unsigned minUses, bool cacheErrors) {
+    while (!_lru.empty())
+        evict(_lru.begin());
+    _maxEntries = maxEntries;
+    _inactiveMs = inactiveMs;
+    _validMs = validMs;
+    _minUses = minUses > 0 ? minUses : 1;
+    _cacheErrors = cacheErrors;
+}
+
+int OpenFileCache::stat(const string &path, struct stat &info) {
+    Entry *entry = lookup(path);
+    if (entry == NULL)
+        return ::stat(path.c_str(), &info) < 0 ? errno : 0;
+    info = entry->info;
+    return entry->err;
+}
+
+int OpenFileCache::open(const string &path, struct stat &info) {
+    Entry *entry = lookup(path);
+    if (entry == NULL) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        int err = 0;
+        if (::fstat(fd, &info) < 0)
+            err = errno;
+        else if (!S_ISREG(info.st_mode)) // like the cached path, only regular files are opened
+            err = S_ISDIR(info.st_mode) ? EISDIR : EACCES;
+        if (err != 0) {
+            ::close(fd);
+            errno = err;
+            return -1;
+        }
+        return fd;
+    }
+    if (entry->err != 0) {
+        errno = entry->err;
+        return -1;
+    }
+    info = entry->info;
+    if (entry->fd < 0) { // not a regular file
+        errno = S_ISDIR(info.st_mode) ? EISDIR : EACCES;
+        return -1;
+    }
+    return ::fcntl(entry->fd, F_DUPFD_CLOEXEC, 0);
+}
+
+size_t OpenFileCache::size() const { return _lru.size(); }
+
+// NULL if the file system has to be asked directly: without a cache or while a path wasn't used minUses times yet
+OpenFileCache::Entry *OpenFileCache::lookup(const string &path) {
+    if (_maxEntries == 0)
+        return NULL;
+    uint64_t now = TimerWheel::now();
+    evictInactive(now);
+
+    Entries::iterator entry;
+    map<string, Entries::iterator>::iterator found = _index.find(path);
+    if (found != _index.end()) {
+        entry = found->second;
+        _lru.splice(_lru.begin(), _lru, entry);
+    } else {
+        if (_lru.size() >= _maxEntries)
+            evict(--_lru.end());
+        _lru.push_front(Entry());
+        _lru.front().path = path;
+        entry = _lru.begin();
+        _index[path] = entry;
+    }
+    entry->lastUse = now;
+    if (entry->uses < _minUses)
+        ++entry->uses;
+    if (entry->uses < _minUses)
+        return NULL;
+
+    if (entry->validUntil == 0 || now >= entry->validUntil)
+        refresh(*entry, now);
+    if (entry->err != 0 && !_cacheErrors) {
+        _miss.err = entry->err;
+        evict(entry);
+        return &_miss;
+    }
+    return &*entry;
+}
+
+// checks the path again, an open FD is only kept as long as the path still refers to the same, unchanged file
+void OpenFileCache::refresh(Entry &entry, uint64_t now) {
+    struct stat info;
+    std::memset(&info, 0, sizeof(info));
+    entry.validUntil = now + _validMs;
+    if (::stat(entry.path.c_str(), &info) < 0)
+        entry.err = errno;
+    else
+        entry.err = 0;
+    if (entry.fd >= 0 && (entry.err != 0 || info.st_dev != entry.info.st_dev || info.st_ino != entry.info.st_ino ||
+                          info.st_size != entry.info.st_size || info.st_mtime != entry.info.st_mtime)) {
+        ::close(entry.fd);
+        entry.fd = -1;
+    }
+    entry.info = info;
+    if (entry.err != 0 || entry.fd >= 0 || !S_ISREG(info.st_mode))
+        return;
+    entry.fd = ::open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (entry.fd < 0 || ::fstat(entry.fd, &entry.info) < 0) {
+        entry.err = errno;
+        if (entry.fd >= 0)
+            ::close(entry.fd);
+        entry.fd = -1;
+    }
+}
+
+void OpenFileCache::evict(Entries::iterator entry) {
+    if (entry->fd >= 0)
+        ::close(entry->fd);
+    _index.erase(entry->path);
+    _lru.erase(entry);
+}
+
+void OpenFileCache::evictInactive(uint64_t now) {
+    while (_inactiveMs > 0 && !_lru.empty() && _lru.back().lastUse + _inactiveMs <= now)
+        evict(--_lru.end());
+}
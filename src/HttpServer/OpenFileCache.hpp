@@ -0,0 +1,59 @@
+#pragma once /* OpenFileCache.hpp */
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+
+using std::list;
+using std::map;
+using std::string;
+
+// Like nginx' open_file_cache: remembers stat() results, open FDs of regular files and (optionally) failed lookups per path, so
+// serving a hot file doesn't cost a stat() and an open() every time. Entries are kept in LRU order, the least recently used one is
+// dropped when the cache is full, entries unused for longer than inactive are dropped as well. Results older than valid are checked
+// against the file system again. A path is only served from the cache once it was looked up minUses times, without a configured maximum
+// every lookup goes straight to the file system.
+class OpenFileCache {
+  public:
+    ~OpenFileCache();
+    OpenFileCache();
+
+    void configure(size_t maxEntries, uint64_t inactiveMs, uint64_t validMs, unsigned minUses, bool cacheErrors);
+    int stat(const string &path, struct stat &info); // 0 or the errno of the failed stat()
+    int open(const string &path, struct stat &info); // a new FD the caller owns for regular files, otherwise -1 with errno set
+    size_t size() const;
+
+  private:
+    struct Entry {
+        string path;
+        int err; // errno of the failed lookup, 0 for a file that exists
+        struct stat info;
+        int fd; // only for regular files
+        unsigned uses;
+        uint64_t validUntil;
+        uint64_t lastUse;
+
+        Entry() : path(), err(0), info(), fd(-1), uses(0), validUntil(0), lastUse(0) {}
+    };
+    typedef list<Entry> Entries;
+
+    Entries _lru; // most recently used first
+    map<string, Entries::iterator> _index;
+    Entry _miss; // result of a failed lookup that isn't cached
+    size_t _maxEntries;
+    uint64_t _inactiveMs;
+    uint64_t _validMs;
+    unsigned _minUses;
+    bool _cacheErrors;
+
+    OpenFileCache(const OpenFileCache &other);            // not copyable, it owns FDs
+    OpenFileCache &operator=(const OpenFileCache &other); // not copyable, it owns FDs
+
+    Entry *lookup(const string &path);
+    void refresh(Entry &entry, uint64_t now);
+    void evict(Entries::iterator entry);
+    void evictInactive(uint64_t now);
+};
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "Constants.hpp"
+#include "OutputQueue.hpp"
+
+using std::runtime_error;
+
+OutputQueue::~OutputQueue() { closeFiles(); }
+
+OutputQueue::OutputQueue() : _segments(), _offset(0), _size(0) {}
+
+OutputQueue::OutputQueue(const OutputQueue &other) : _segments(), _offset(0), _size(0) { *this = other; }
+
+OutputQueue &OutputQueue::operator=(const OutputQueue &other) {
+    if (this == &other)
+        return *this;
+    clear();
+    _segments = other._segments;
+    _offset = other._offset;
+    _size = other._size;
+    for (deque<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        if (it->fd < 0)
+            continue;
+        it->fd = ::fcntl(it->fd, F_DUPFD_CLOEXEC, 0);
+        if (it->fd < 0) {
+            clear();
+            throw runtime_error(string("Failed to duplicate a queued file: ") + ::strerror(errno));
+        }
+    }
+    return *this;
+}
+
+void OutputQueue::append(const string &data) {
+    if (data.empty())
+        return;
+    Segment *last = _segments.empty() ? NULL : &_segments.back();
+    if (last != NULL && last->fd < 0 && last->shared.empty() && last->data.size() + data.size() <= CONSTANTS_CHUNK_SIZE)
+        last->data += data;
+    else {
+        Segment segment = {data, -1, 0, 0, SharedBuffer()};
+        _segments.push_back(segment);
+    }
+    _size += data.size();
+}
+
+void OutputQueue::appendShared(const SharedBuffer &buffer, size_t offset, size_t length) {
+    if (length == 0)
+        return;
+    if (offset + length > buffer.size())
+        throw runtime_error("Range outside of the shared buffer");
+    Segment segment = {"", -1, static_cast<off_t>(offset), length, buffer};
+    _segments.push_back(segment);
+    _size += length;
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t length) {
+    if (length == 0) {
+        ::close(fd);
+        return;
+    }
+    Segment segment = {"", fd, offset, length, SharedBuffer()};
+    _segments.push_back(segment);
+    _size += length;
+}
+
+size_t OutputQueue::size() const { return _size; }
+
+bool OutputQueue::empty() const { return _size == 0; }
+
+void OutputQueue::clear() {
+    closeFiles();
+    _segments.clear();
+    _offset = 0;
+    _size = 0;
+}
+
+void OutputQueue::closeFiles() {
+    for (deque<Segment>::iterator it = _segments.begin(); it != _segments.end(); ++it) {
+        if (it->fd >= 0) {
+            ::close(it->fd);
+            it->fd = -1;
+        }
+    }
+}
+
+int OutputQueue::gather(struct iovec *iov, int maxIov, size_t maxBytes, size_t &bytes) const {
+    int count = 0;
+    size_t offset = _offset;
+    bytes = 0;
+    for (deque<Segment>::const_iterator it = _segments.begin(); it != _segments.end() && it->fd < 0 && count < maxIov && bytes < maxBytes;
+         ++it) {
+        const char *base;
+        size_t len = std::min(inMemory(*it, offset, base), maxBytes - bytes);
+        iov[count].iov_base = const_cast<char *>(base);
+        iov[count].iov_len = len;
+        bytes += len;
+        offset = 0;
+        ++count;
+    }
+    return count;
+}
+
+bool OutputQueue::frontFile(int &fd, off_t &offset, size_t &length) const {
+    if (_segments.empty() || _segments.front().fd < 0)
+        return false;
+    fd = _segments.front().fd;
+    offset = _segments.front().offset;
+    length = _segments.front().length;
+    return true;
+}
+
+void OutputQueue::consume(size_t bytes) {
+    bytes = std::min(bytes, _size);
+    _size -= bytes;
+    while (bytes > 0) {
+        Segment &front = _segments.front();
+        bool plain = front.fd < 0 && front.shared.empty();
+        size_t left = plain ? front.data.size() - _offset : front.length;
+        if (bytes < left) {
+            if (plain)
+                _offset += bytes;
+            else {
+                front.offset += static_cast<off_t>(bytes);
+                front.length -= bytes;
+            }
+            return;
+        }
+        bytes -= left;
+        if (front.fd >= 0)
+            ::close(front.fd);
+        _segments.pop_front();
+        _offset = 0;
+    }
+}
+
+string OutputQueue::peek(size_t maxBytes) const {
+    string data;
+    size_t offset = _offset;
+    for (deque<Segment>::const_iterator it = _segments.begin(); it != _segments.end() && it->fd < 0 && data.size() < maxBytes; ++it) {
+        const char *bytes;
+        size_t len = inMemory(*it, offset, bytes);
+        data.append(bytes, std::min(len, maxBytes - data.size()));
+        offset = 0;
+    }
+    return data;
+}
+
+size_t OutputQueue::inMemory(const Segment &segment, size_t offset, const char *&bytes) {
+    if (segment.shared.empty()) {
+        bytes = segment.data.data() + offset;
+        return segment.data.size() - offset;
+    }
+    bytes = segment.shared.data() + segment.offset;
+    return segment.length;
+}
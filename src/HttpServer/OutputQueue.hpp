@@ -0,0 +1,57 @@
+#pragma once /* OutputQueue.hpp */
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "SharedBuffer.hpp"
+
+using std::deque;
+using std::string;
+
+// Output of a connection as a list of segments, drained front to back with writev() and sendfile(). A segment is either memory,
+// a range of a SharedBuffer (which stays shared with whoever else queued it) or a range of an open file, which the queue owns (copies
+// dup() it). Sent bytes are consumed by advancing an offset into the first
+// segment, so nothing that's queued is ever copied again. Small pieces are merged into the last segment (up to CONSTANTS_CHUNK_SIZE),
+// so headers and the like don't cost an iovec each.
+class OutputQueue {
+  public:
+    struct Segment {
+        string data;
+        int fd;              // -1 for memory segments
+        off_t offset;        // next byte of the file or the shared buffer to send
+        size_t length;       // bytes of the file or the shared buffer left to send
+        SharedBuffer shared; // empty unless the segment is a range of a shared buffer
+    };
+
+    ~OutputQueue();
+    OutputQueue();
+    OutputQueue(const OutputQueue &other);
+    OutputQueue &operator=(const OutputQueue &other);
+
+    void append(const string &data);
+    void appendShared(const SharedBuffer &buffer, size_t offset, size_t length);
+    void appendFile(int fd, off_t offset, size_t length); // takes ownership of fd
+    size_t size() const;                                  // bytes not sent yet
+    bool empty() const;
+    void clear();
+    // fills iov with the memory segments (at most maxBytes) up to the first file segment, returns the number of iovecs used
+    int gather(struct iovec *iov, int maxIov, size_t maxBytes, size_t &bytes) const;
+    bool frontFile(int &fd, off_t &offset, size_t &length) const; // whether the next bytes to send come from a file
+    void consume(size_t bytes);                                   // drops bytes that have been sent from the front
+    string peek(size_t maxBytes) const;                           // copy of the next bytes to send from memory, for logging
+
+    const deque<Segment> &get_segments() const { return _segments; }
+    const size_t &get_offset() const { return _offset; }
+    const size_t &get_size() const { return _size; }
+
+  private:
+    deque<Segment> _segments;
+    size_t _offset; // bytes of the first segment that have been sent already, if it's in memory
+    size_t _size;
+
+    void closeFiles();
+    static size_t inMemory(const Segment &segment, size_t offset, const char *&bytes); // bytes left of a segment that isn't a file
+};
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "Constants.hpp"
+#include "HttpServer.hpp"
+#include "Logger.hpp"
+#include "Repr.hpp"
+#include "Utils.hpp"
+
+using std::pair;
+using std::vector;
+
+typedef vector<pair<off_t, off_t> > ByteRanges; // first and last byte, both inclusive
+enum RangeParsing { RANGES_IGNORED, RANGES_UNSATISFIABLE, RANGES_SATISFIABLE };
+
+static bool parseOffset(const string &digits, off_t &value) {
+    if (digits.empty() || digits.size() > 18 || digits.find_first_not_of("0123456789") != string::npos)
+        return false;
+    value = 0;
+    for (string::const_iterator c = digits.begin(); c != digits.end(); ++c)
+        value = value * 10 + (*c - '0');
+    return true;
+}
+
+// RFC 9110 14.1.2, a Range header that can't be parsed (or asks for too many ranges) is ignored and the whole file is sent
+static RangeParsing parseRanges(const string &header, off_t size, ByteRanges &ranges) {
+    if (header.size() < 6 || Utils::strToLower(header.substr(0, 6)) != "bytes=")
+        return RANGES_IGNORED;
+    std::istringstream specs(header.substr(6));
+    string spec;
+    size_t count = 0;
+    while (std::getline(specs, spec, ',')) {
+        spec.erase(0, spec.find_first_not_of(" \t"));
+        spec.erase(spec.find_last_not_of(" \t") + 1);
+        if (spec.empty())
+            continue;
+        if (++count > Constants::maxRanges)
+            return RANGES_IGNORED;
+        size_t dash = spec.find('-');
+        if (dash == string::npos)
+            return RANGES_IGNORED;
+        off_t first, last;
+        if (dash == 0) { // suffix range, the last N bytes
+            if (!parseOffset(spec.substr(1), last))
+                return RANGES_IGNORED;
+            if (last == 0 || size == 0)
+                continue;
+            first = size > last ? size - last : 0;
+            last = size - 1;
+        } else {
+            if (!parseOffset(spec.substr(0, dash), first))
+                return RANGES_IGNORED;
+            if (dash + 1 == spec.size())
+                last = size - 1;
+            else if (!parseOffset(spec.substr(dash + 1), last) || last < first)
+                return RANGES_IGNORED;
+            if (first >= size)
+                continue;
+            last = std::min(last, size - 1);
+        }
+        ranges.push_back(std::make_pair(first, last));
+    }
+    if (count == 0)
+        return RANGES_IGNORED;
+    return ranges.empty() ? RANGES_UNSATISFIABLE : RANGES_SATISFIABLE;
+}
+
+static string contentRange(const pair<off_t, off_t> &range, off_t size) {
+    std::ostringstream oss;
+    oss << "bytes " << range.first << "-" << range.second << "/" << size;
+    return oss.str();
+}
+
+// If-Range only lets the ranges through while the file is still the one the client has parts of: its ETag (compared strongly) or its
+// exact Last-Modified date
+bool HttpServer::ifRangeMatches(const HttpRequest &request, const struct stat &fileInfo) {
+    const RequestParser::Span *field = request.parser.header(HeaderTable::IF_RANGE);
+    if (field == NULL)
+        return true;
+    string ifRange = request.parser.str(*field);
+    if (!ifRange.empty() && (ifRange[0] == '"' || ifRange.compare(0, 2, "W/") == 0))
+        return ifRange == entityTag(fileInfo);
+    return ifRange == Utils::httpDate(fileInfo.st_mtime);
+}
+
+// serves the ranges of a Range request as 206 Partial Content, every range is a file segment of its own. Falls back to the whole file
+// when the Range header is ignored
+bool HttpServer::sendFileRanges(int clientSocket, const string &filePath, const HttpRequest &request, const LocationCtx &location,
+                                const string &contentType, const string &extraHeaders) {
+    bool onlyHeaders = request.method == "HEAD";
+    if (conn(clientSocket).pendingClose)
+        return true;
+    struct stat fileInfo;
+    int fd = _fileCache.open(filePath, fileInfo);
+    if (fd < 0) {
+        log.debug() << "Could not open file " << repr(filePath) << " as a regular file: " << ::strerror(errno) << std::endl;
+        sendError(clientSocket, 403, &location);
+        return false;
+    }
+    ByteRanges ranges;
+    RangeParsing parsed = RANGES_IGNORED;
+    const RequestParser::Span *field = request.parser.header(HeaderTable::RANGE);
+    string rangeHeader = field == NULL ? string() : request.parser.str(*field);
+    if (ifRangeMatches(request, fileInfo))
+        parsed = parseRanges(rangeHeader, fileInfo.st_size, ranges);
+    log.debug() << "Range " << repr(rangeHeader) << " of " << repr(filePath) << " is "
+                << (parsed == RANGES_IGNORED ? "ignored" : parsed == RANGES_UNSATISFIABLE ? "unsatisfiable" : "satisfiable")
+                << std::endl;
+    if (parsed == RANGES_IGNORED) {
+        queueFileResponse(clientSocket, fd, fileInfo, filePath, 200, contentType, onlyHeaders, extraHeaders);
+        return true;
+    }
+
+    std::ostringstream headers;
+    headers << _httpVersionString << " " << (parsed == RANGES_SATISFIABLE ? 206 : 416) << " "
+            << statusTextFromCode(parsed == RANGES_SATISFIABLE ? 206 : 416) << "\r\n";
+    if (parsed == RANGES_UNSATISFIABLE) {
+        ::close(fd);
+        headers << "Content-Range: bytes */" << fileInfo.st_size << "\r\n"
+                << "Content-Length: 0\r\n"
+                << "Connection: " << connectionHeader(clientSocket) << "\r\n\r\n";
+        queueWrite(clientSocket, headers.str());
+        conn(clientSocket).pendingClose = true;
+        return true;
+    }
+
+    string partType = contentType.empty() ? getMimeType(filePath) : contentType;
+    headers << validatorHeaders(fileInfo) << extraHeaders;
+    if (ranges.size() == 1) {
+        off_t length = ranges[0].second - ranges[0].first + 1;
+        headers << "Content-Length: " << length << "\r\n"
+                << "Content-Type: " << partType << "\r\n"
+                << "Content-Range: " << contentRange(ranges[0], fileInfo.st_size) << "\r\n"
+                << "Connection: " << connectionHeader(clientSocket) << "\r\n\r\n";
+        queueWrite(clientSocket, headers.str());
+        if (onlyHeaders)
+            ::close(fd);
+        else
+            queueFile(clientSocket, fd, ranges[0].first, static_cast<size_t>(length));
+        conn(clientSocket).pendingClose = true;
+        return true;
+    }
+
+    // multipart/byteranges, the part headers are small memory segments between the file segments
+    static unsigned long boundaryCounter = 0;
+    std::ostringstream boundary;
+    boundary << std::setfill('0') << std::setw(20) << ++boundaryCounter;
+    vector<string> partHeaders;
+    size_t contentLength = 0;
+    for (ByteRanges::const_iterator range = ranges.begin(); range != ranges.end(); ++range) {
+        partHeaders.push_back("\r\n--" + boundary.str() + "\r\nContent-Type: " + partType +
+                              "\r\nContent-Range: " + contentRange(*range, fileInfo.st_size) + "\r\n\r\n");
+        contentLength += partHeaders.back().size() + static_cast<size_t>(range->second - range->first + 1);
+    }
+    string closingBoundary = "\r\n--" + boundary.str() + "--\r\n";
+    contentLength += closingBoundary.size();
+    headers << "Content-Length: " << contentLength << "\r\n"
+            << "Content-Type: multipart/byteranges; boundary=" << boundary.str() << "\r\n"
+            << "Connection: " << connectionHeader(clientSocket) << "\r\n\r\n";
+    queueWrite(clientSocket, headers.str());
+    if (!onlyHeaders) {
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            int rangeFd = i + 1 == ranges.size() ? fd : ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (rangeFd < 0) {
+                log.error() << "Failed to duplicate FD of " << repr(filePath) << ": " << ::strerror(errno) << std::endl;
+                ::close(fd);
+                conn(clientSocket).persistent = false; // the response is cut short, the client must not wait for the rest
+                conn(clientSocket).pendingClose = true;
+                return true;
+            }
+            queueWrite(clientSocket, partHeaders[i]);
+            queueFile(clientSocket, rangeFd, ranges[i].first, static_cast<size_t>(ranges[i].second - ranges[i].first + 1));
+        }
+        queueWrite(clientSocket, closingBoundary);
+    } else
+        ::close(fd);
+    conn(clientSocket).pendingClose = true;
+    return true;
+}
@@ -1,6 +1,8 @@
-#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <ostream>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include "Ansi.hpp"
@@ -10,16 +12,21 @@
 #include "Repr.hpp"
 
 using Constants::EPOLL;
+using Constants::IO_URING;
 using Constants::POLL;
 using Constants::SELECT;
 
+// swap-remove, so the slot of the last pollfd has to be updated
 void HttpServer::removePollFd(MultPlexFds &monitorFds, int fd) {
-    for (PollFds::iterator pollFd = monitorFds.pollFds.begin(); pollFd != monitorFds.pollFds.end(); ++pollFd) {
-        if (pollFd->fd == fd) {
-            monitorFds.pollFds.erase(pollFd);
-            break;
-        }
+    size_t i = conn(fd).pollIndex;
+    if (i >= monitorFds.pollFds.size() || monitorFds.pollFds[i].fd != fd)
+        return;
+    size_t last = monitorFds.pollFds.size() - 1;
+    if (i != last) {
+        monitorFds.pollFds[i] = monitorFds.pollFds[last];
+        conn(monitorFds.pollFds[i].fd).pollIndex = i;
     }
+    monitorFds.pollFds.pop_back();
 }
 
 void HttpServer::closeAndRemoveAllPollFd(MultPlexFds &monitorFds) {
@@ -32,12 +39,62 @@ void HttpServer::closeAndRemoveAllPollFd(MultPlexFds &monitorFds) {
     monitorFds.pollFds.clear();
 }
 
+void HttpServer::removeEpollFd(MultPlexFds &monitorFds, int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= monitorFds.epollRegs.size() || monitorFds.epollRegs[static_cast<size_t>(fd)] == 0)
+        return;
+    if (::epoll_ctl(monitorFds.epollFd, EPOLL_CTL_DEL, fd, NULL) < 0)
+        log.error() << "Error calling " << func("epoll_ctl") << punct("()") << " with " << num("EPOLL_CTL_DEL") << " on FD " << repr(fd)
+                    << ": " << ::strerror(errno) << std::endl;
+    monitorFds.epollRegs[static_cast<size_t>(fd)] = 0;
+}
+
+void HttpServer::closeAndRemoveAllEpollFd(MultPlexFds &monitorFds) {
+    for (size_t fd = 0; fd < monitorFds.epollRegs.size(); ++fd) {
+        if (monitorFds.epollRegs[fd] != 0) {
+            ::close(static_cast<int>(fd));
+            monitorFds.epollRegs[fd] = 0;
+        }
+    }
+    if (monitorFds.epollFd >= 0) {
+        ::close(monitorFds.epollFd);
+        monitorFds.epollFd = -1;
+    }
+}
+
+void HttpServer::removeIoUringFd(MultPlexFds &monitorFds, int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= monitorFds.uringRegs.size() || monitorFds.uringRegs[static_cast<size_t>(fd)].events == 0)
+        return;
+    UringReg &reg = monitorFds.uringRegs[static_cast<size_t>(fd)];
+    if (reg.armed || reg.multishot) {
+        monitorFds.uring.prepCancelFd(fd);
+        // an in-flight request holds a reference to the file, a closed socket wouldn't be shut down before the request is gone
+        int ret = monitorFds.uring.submit();
+        if (ret < 0)
+            log.error() << "Error calling " << func("io_uring_enter") << punct("()") << " to cancel the requests of FD " << repr(fd)
+                        << ": " << ::strerror(-ret) << std::endl;
+    }
+    reg.events = 0;
+    reg.armed = false;
+    reg.multishot = false;
+    ++reg.gen;
+}
+
+void HttpServer::closeAndRemoveAllIoUringFd(MultPlexFds &monitorFds) {
+    for (size_t fd = 0; fd < monitorFds.uringRegs.size(); ++fd) {
+        if (monitorFds.uringRegs[fd].events != 0) {
+            ::close(static_cast<int>(fd));
+            monitorFds.uringRegs[fd] = UringReg();
+        }
+    }
+    monitorFds.uring.close();
+}
+
 void HttpServer::closeAndRemoveMultPlexFd(MultPlexFds &monitorFds, int fd) {
-    vector<int> rawClientFds = multPlexFdsToRawFds(determineRemoteClients(_monitorFds, _listeningSockets, _cgiToClient));
-    bool isClientSocket = std::find(rawClientFds.begin(), rawClientFds.end(), fd) != rawClientFds.end();
+    Connection &c = conn(fd);
+    bool isClientSocket = c.kind == CONN_CLIENT && isMonitoredFd(monitorFds, fd);
     log.trace() << "Is FD " << repr(fd) << " a remote client FD?: " << repr(isClientSocket) << std::endl;
 
-    if (persistConns.count(fd) > 0) {
+    if (c.persistent) {
         log.debug() << "Connection on FD " << repr(fd) << " has handled a response, but is persistent, therefore not closing" << std::endl;
         return;
     }
@@ -58,8 +115,7 @@ void HttpServer::closeAndRemoveMultPlexFd(MultPlexFds &monitorFds, int fd) {
 
     out << std::endl;
 
-    ::close(fd); // TODO: @timo: guard every syscall
-    _tmpCgiFds.erase(fd);
+    // remove from the multiplexer first, epoll would silently keep a closed FD registered if it was dup'ed
     log.debug() << "Removing FD " << repr(fd) << " from monitoring FDs" << std::endl;
     switch (monitorFds.multPlexType) {
     case SELECT:
@@ -69,11 +125,18 @@ void HttpServer::closeAndRemoveMultPlexFd(MultPlexFds &monitorFds, int fd) {
         removePollFd(monitorFds, fd);
         break;
     case EPOLL:
-        throw std::logic_error("Removing epoll type FDs not implemented yet");
+        removeEpollFd(monitorFds, fd);
+        break;
+    case IO_URING:
+        removeIoUringFd(monitorFds, fd);
         break;
     default:
         throw std::logic_error("Removing unknown type of fd not implemented");
     }
+    ::close(fd); // TODO: @timo: guard every syscall
+    c.pendingWrite.clear(); // closes the files of a response that won't be sent anymore
+    c.request.body.clear(); // and removes an upload that won't complete anymore
+    cancelTimers(fd);
 }
 
 void HttpServer::closeAndRemoveAllMultPlexFd(MultPlexFds &monitorFds) {
@@ -85,7 +148,10 @@ void HttpServer::closeAndRemoveAllMultPlexFd(MultPlexFds &monitorFds) {
         closeAndRemoveAllPollFd(monitorFds);
         break;
     case EPOLL:
-        throw std::logic_error("Removing all epoll type FDs not implemented yet");
+        closeAndRemoveAllEpollFd(monitorFds);
+        break;
+    case IO_URING:
+        closeAndRemoveAllIoUringFd(monitorFds);
         break;
     default:
         throw std::logic_error("Removing all unknown types of fd not implemented");
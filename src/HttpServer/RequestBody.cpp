@@ -0,0 +1,191 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Constants.hpp"
+#include "RequestBody.hpp"
+
+using std::runtime_error;
+
+RequestBody::~RequestBody() {
+    if (_fd >= 0)
+        ::close(_fd);
+    if (!_tmpPath.empty()) // an upload that never completed
+        ::unlink(_tmpPath.c_str());
+}
+
+RequestBody::RequestBody() : _memory(), _fd(-1), _size(0), _bufferSize(string::npos), _path(), _tmpPath() {}
+
+RequestBody::RequestBody(const RequestBody &other) : _memory(), _fd(-1), _size(0), _bufferSize(string::npos), _path(), _tmpPath() {
+    *this = other;
+}
+
+RequestBody &RequestBody::operator=(const RequestBody &other) {
+    if (this == &other)
+        return *this;
+    clear();
+    if (other._fd >= 0 && (_fd = ::fcntl(other._fd, F_DUPFD_CLOEXEC, 0)) < 0)
+        throw runtime_error(string("Failed to duplicate the spool file of a request body: ") + ::strerror(errno));
+    _memory = other._memory;
+    _size = other._size;
+    _bufferSize = other._bufferSize; // an upload stays with other, only one of them may move or remove its file
+    return *this;
+}
+
+void RequestBody::setBufferSize(size_t bufferSize) {
+    _bufferSize = bufferSize;
+    if (_fd < 0 && _size > _bufferSize)
+        spool();
+}
+
+void RequestBody::append(const char *data, size_t size) {
+    if (size == 0)
+        return;
+    if (_fd >= 0)
+        writeAll(_fd, data, size);
+    else
+        _memory.append(data, size);
+    _size += size;
+    if (_fd < 0 && _size > _bufferSize)
+        spool();
+}
+
+void RequestBody::clear() {
+    if (_fd >= 0)
+        ::close(_fd);
+    if (!_tmpPath.empty()) // an upload that didn't complete (or was refused)
+        ::unlink(_tmpPath.c_str());
+    _path.clear();
+    _tmpPath.clear();
+    _fd = -1;
+    _memory.clear();
+    _size = 0;
+}
+
+size_t RequestBody::size() const { return _size; }
+
+bool RequestBody::empty() const { return _size == 0; }
+
+bool RequestBody::inMemory() const { return _fd < 0; }
+
+const string &RequestBody::memory() const { return _memory; }
+
+int RequestBody::fd() const { return _fd; }
+
+// the file has no name from the start (or loses it right away), so it disappears with the last FD, however the request ends
+void RequestBody::spool() {
+    const string &dir = Constants::clientBodyTempPath;
+    int fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0 && (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)) { // the file system (or kernel) can't do O_TMPFILE
+        string path = dir + "/webserv_body_XXXXXX";
+        fd = ::mkstemp(&path[0]);
+        if (fd >= 0) {
+            ::unlink(path.c_str());
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    if (fd < 0)
+        throw runtime_error("Failed to create a spool file for a request body in " + dir + ": " + ::strerror(errno));
+    try {
+        writeAll(fd, _memory.data(), _memory.size());
+    } catch (const runtime_error &) {
+        ::close(fd);
+        throw;
+    }
+    _fd = fd;
+    string().swap(_memory); // give the memory back, not just its contents
+}
+
+void RequestBody::writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            throw runtime_error(string("Failed to write a request body: ") + ::strerror(errno));
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void RequestBody::appendTo(OutputQueue &queue) const {
+    if (_fd < 0) {
+        queue.append(_memory);
+        return;
+    }
+    int fd = ::fcntl(_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+        throw runtime_error(string("Failed to duplicate the spool file of a request body: ") + ::strerror(errno));
+    queue.appendFile(fd, 0, _size);
+}
+
+// a spooled body is copied by the kernel, without passing through user space
+void RequestBody::writeTo(int fd) const {
+    if (_fd < 0) {
+        writeAll(fd, _memory.data(), _memory.size());
+        return;
+    }
+    off_t offset = 0;
+    while (static_cast<size_t>(offset) < _size) {
+        ssize_t copied = ::sendfile(fd, _fd, &offset, _size - static_cast<size_t>(offset));
+        if (copied < 0 && errno == EINTR)
+            continue;
+        if (copied <= 0)
+            throw runtime_error(string("Failed to copy a spooled request body: ") + ::strerror(errno));
+    }
+}
+
+// the file is created in the directory of path, so commit() is a rename within one file system. It gets the permissions files created
+// with open() get
+void RequestBody::streamTo(const string &path) {
+    string tmpPath = path + ".tmp.XXXXXX";
+    int fd = ::mkstemp(&tmpPath[0]);
+    if (fd < 0)
+        throw runtime_error("Failed to create a file for the upload to " + path + ": " + ::strerror(errno));
+    mode_t mask = ::umask(0);
+    ::umask(mask);
+    try {
+        if (::fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 || ::fchmod(fd, 0666 & ~mask) < 0)
+            throw runtime_error("Failed to set up the file for the upload to " + path + ": " + ::strerror(errno));
+        writeTo(fd); // whatever has been received already
+    } catch (const runtime_error &) {
+        ::close(fd);
+        ::unlink(tmpPath.c_str());
+        throw;
+    }
+    size_t size = _size;
+    clear();
+    _size = size;
+    _fd = fd;
+    _path = path;
+    _tmpPath = tmpPath;
+    _bufferSize = 0;
+}
+
+bool RequestBody::streaming() const { return !_tmpPath.empty(); }
+
+// link() doesn't replace an existing file, so a POST can't clobber a file that was created while the upload was running
+bool RequestBody::commit(bool overwrite) {
+    if (_tmpPath.empty())
+        throw runtime_error("No upload to commit");
+    if (overwrite ? ::rename(_tmpPath.c_str(), _path.c_str()) < 0 : ::link(_tmpPath.c_str(), _path.c_str()) < 0) {
+        if (!overwrite && errno == EEXIST) {
+            clear();
+            return false;
+        }
+        string error = "Failed to move the upload to " + _path + ": " + ::strerror(errno);
+        clear();
+        throw runtime_error(error);
+    }
+    if (!overwrite)
+        ::unlink(_tmpPath.c_str());
+    _tmpPath.clear(); // it's not temporary anymore
+    clear();
+    return true;
+}
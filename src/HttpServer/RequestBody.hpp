@@ -0,0 +1,56 @@
+#pragma once /* RequestBody.hpp */
+
+#include <cstddef>
+#include <string>
+
+#include "OutputQueue.hpp"
+
+using std::string;
+
+// The body of a request. It's kept in memory until it grows beyond the buffer size (client_body_buffer_size), then everything is moved
+// to an unnamed spool file (O_TMPFILE in Constants::clientBodyTempPath, an unlinked mkstemp() file where that isn't supported) and
+// the rest is written there as it arrives, so a large upload costs disk space instead of memory. Consumers don't need to know where
+// the body is: appendTo() queues it for writing to a pipe or socket, writeTo() copies it to a file. An upload is streamed to its
+// destination instead: streamTo() creates a file next to it right away, which commit() renames once the body is complete, and
+// clear() removes if it never is. Errors of the files are thrown as runtime_error.
+class RequestBody {
+  public:
+    ~RequestBody();
+    RequestBody();
+    RequestBody(const RequestBody &other); // copies share the spool file (dup), an upload file only as if it was one
+    RequestBody &operator=(const RequestBody &other);
+
+    void setBufferSize(size_t bufferSize); // npos (the default) never spools
+    void append(const char *data, size_t size);
+    void clear();
+    size_t size() const;
+    bool empty() const;
+    bool inMemory() const;
+    const string &memory() const; // the body if it's in memory, empty otherwise
+    int fd() const;               // the spool file, -1 if the body is in memory
+
+    void appendTo(OutputQueue &queue) const; // a spooled body is queued as a file segment, never read into memory
+    void writeTo(int fd) const;              // blocking, for regular files
+
+    void streamTo(const string &path); // the body goes to path.tmp.XXXXXX from now on
+    bool streaming() const;
+    // moves the file to the path given to streamTo(). An existing file is replaced only if overwrite, otherwise false is returned and
+    // the file is removed
+    bool commit(bool overwrite);
+
+    const string &get_memory() const { return _memory; } // for repr
+    const int &get_fd() const { return _fd; }
+    const size_t &get_size() const { return _size; }
+    const string &get_tmpPath() const { return _tmpPath; }
+
+  private:
+    string _memory;
+    int _fd;
+    size_t _size;
+    size_t _bufferSize;
+    string _path;    // of an upload
+    string _tmpPath; // where the upload is written, removed unless committed
+
+    void spool();
+    static void writeAll(int fd, const char *data, size_t size);
+};
@@ -1,11 +1,12 @@
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <ctime>
 #include <exception>
-#include <fstream>
+#include <fcntl.h>
 #include <ios>
+#include <limits>
 #include <ostream>
 #include <signal.h>
 #include <sstream>
@@ -13,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -52,31 +54,31 @@ bool HttpServer::requestIsForCgi(const HttpRequest &request, const LocationCtx &
     return true;
 }
 
-void HttpServer::handleCgiRead(int cgiFd) {
-    int clientSocket = _cgiToClient[cgiFd]; // guaranteed to work because of the checks
-                                            // before this function is called
+// returns whether there might be more data to read from the CGI pipe right away
+bool HttpServer::handleCgiRead(int cgiFd, size_t &budget) {
+    int clientSocket = cgiClientOf(cgiFd); // guaranteed to work because of the checks
+                                           // before this function is called
     log.debug() << "Pipe FD for the stdout of the CGI process: " << repr(cgiFd) << std::endl;
     log.debug() << "Remote client socket FD for the CGI process: " << repr(clientSocket) << std::endl;
-    ClientFdToCgiMap::iterator it = _clientToCgi.find(clientSocket);
-    if (it == _clientToCgi.end()) {
+    CgiProcess *cgi = cgiOf(clientSocket);
+    if (cgi == NULL) {
         // CGI process not found, should never happen
-        log.debug() << "During invalidation of cgiToClient map, CGI process "
+        log.debug() << "During invalidation of the CGI pipe FD, CGI process "
                        "doesn't exist anymore, cleaning up"
                     << std::endl;
-        _cgiToClient.erase(cgiFd);
+        conn(cgiFd).cgiClient = -1;
         // sendError(cgiFd /* cgiFd??? doesn't make sense */, 502, NULL);
-        return;
+        return false;
     }
-    CgiProcess &process = it->second;
-    process.noRecentReadEvent = false;
+    CgiProcess &process = *cgi;
     log.debug() << "CGI process PID: " << repr(process.pid) << std::endl;
     log.debug() << "Pipe FD for the stdin of the CGI process: " << repr(process.writeFd) << std::endl;
 
-    if (_cgiToClient.count(process.writeFd) > 0 && _cgiToClient[process.writeFd] == clientSocket) {
+    if (cgiClientOf(process.writeFd) == clientSocket) {
         log.debug() << "Client still has data to send, let's handle the read only when "
                        "all data has been sent (half-duplex)"
                     << std::endl;
-        return; // there's still pending writes (from client POST) to this CGI process
+        return false; // there's still pending writes (from client POST) to this CGI process
     }
 
     char buffer[CONSTANTS_CHUNK_SIZE + 1];
@@ -84,60 +86,46 @@ void HttpServer::handleCgiRead(int cgiFd) {
                 << " bytes" << std::endl;
     ssize_t bytesRead = ::read(cgiFd, buffer, sizeof(buffer) - 1);
     log.debug() << "Actually read " << repr(bytesRead) << " bytes" << std::endl;
+    if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        log.debug() << "No more data available on the CGI pipe FD " << repr(cgiFd) << " for now" << std::endl;
+        if (process.dead) {
+            log.debug() << "Stdout of the exited CGI process is still open elsewhere, not waiting for EOF" << std::endl;
+            finishCgiResponse(clientSocket, cgiFd);
+        }
+        return false;
+    }
     if (bytesRead < 0) {
         log.debug() << "Error while reading from the CGI pipe FD " << repr(cgiFd) << ": " << ::strerror(errno) << std::endl;
         log.debug() << "Sending " << num("SIGKILL") << " using " << func("kill") << punct("()") << " to the CGI process with PID "
                     << repr(process.pid) << std::endl;
         ::kill(process.pid, SIGKILL);
-        sendError(clientSocket, 502, process.location);
         log.debug() << "Removing remote client " << repr(clientSocket) << " from persistent connections" << std::endl;
-        persistConns.erase(clientSocket);
+        conn(clientSocket).persistent = false;
+        sendError(clientSocket, 502, process.location);
         closeAndRemoveMultPlexFd(_monitorFds, cgiFd);
-        log.debug() << "Removing remote client " << repr(clientSocket) << " from clientToCgi map" << std::endl;
-        _clientToCgi.erase(clientSocket); // NOTODO: @all couple _cgiToClient and _clientToCgi as as to
-        log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from cgiToClient map" << std::endl;
-        _cgiToClient.erase(cgiFd);
-        return;
+        log.debug() << "Removing remote client " << repr(clientSocket) << " from the CGI registry" << std::endl;
+        detachCgi(clientSocket);
+        log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from its client" << std::endl;
+        conn(cgiFd).cgiClient = -1;
+        return false;
     }
 
     if (bytesRead == 0) { // EOF - CGI process finished writing
-        log.debug() << "Read 0 bytes from the CGI pipe FD, which is odd since I/O "
-                       "multiplexing said there's a read event, but whatever"
-                    << std::endl;
-
-        // not sure, since checkForInactiveClients function already does everything for us
-        // {
-        //	process.dead = true;
-        //	log.debug() << "Calling " << func("waitpid") << punct("()") << " on pid " << repr(process.pid) << " with flags " <<
-        // num("WNOHANG") << std::endl; 	int status; 	(void)::waitpid(process.pid, &status, WNOHANG);
-        // }
-        process.done = true;
-
-        if (!process.headersSent) {
-            log.warning() << "CGI process " << repr(process)
-                          << " didn't send any data (not even headers), sending 502 Bad "
-                             "Gateway to client"
-                          << std::endl;
-            sendError(clientSocket, 502, process.location);
-        } else if (!process.response.empty()) {
-            log.debug() << "CGI process is done, queueing remaining data" << std::endl;
-            log.trace() << "The data is: " << repr(process.response) << std::endl;
-            queueWrite(clientSocket, process.response);
+        log.debug() << "Read 0 bytes from the CGI pipe FD, the CGI process closed its stdout" << std::endl;
+        if (process.dead)
+            finishCgiResponse(clientSocket, cgiFd);
+        else {
+            // how the body ends depends on the exit status, so the response is finished once the process has been reaped
+            log.debug() << "CGI process hasn't been reaped yet, finishing the response once it has" << std::endl;
+            closeAndRemoveMultPlexFd(_monitorFds, cgiFd);
+            conn(cgiFd).cgiClient = -1;
+            process.readFd = -1;
         }
-
-        log.debug() << "Removing remote client " << repr(clientSocket) << " from persistent connections" << std::endl;
-        persistConns.erase(clientSocket);
-        closeAndRemoveMultPlexFd(_monitorFds, cgiFd);
-        log.debug() << "Removing remote client " << repr(clientSocket) << " from clientToCgi map" << std::endl;
-        _clientToCgi.erase(clientSocket);
-        log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from cgiToClient map" << std::endl;
-        _cgiToClient.erase(cgiFd);
-        return;
+        return false;
     }
 
-    process.lastActive = std::time(NULL);
-    log.debug() << "Updating lastActive time for CGI process " << repr(process) << " to " << Utils::formattedTimestamp(process.lastActive)
-                << std::endl;
+    budget -= std::min(budget, static_cast<size_t>(bytesRead));
+    armCgiTimer(clientSocket);
     buffer[bytesRead] = '\0';
     process.totalSize += static_cast<unsigned long>(bytesRead);
 
@@ -155,11 +143,11 @@ void HttpServer::handleCgiRead(int cgiFd) {
                   process.location); // TODO: @timo: Use macros for status codes instead
                                      // of magic numbers
         closeAndRemoveMultPlexFd(_monitorFds, cgiFd);
-        log.debug() << "Removing remote client " << repr(clientSocket) << " from clientToCgi map" << std::endl;
-        _clientToCgi.erase(clientSocket);
-        log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from cgiToClient map" << std::endl;
-        _cgiToClient.erase(cgiFd);
-        return;
+        log.debug() << "Removing remote client " << repr(clientSocket) << " from the CGI registry" << std::endl;
+        detachCgi(clientSocket);
+        log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from its client" << std::endl;
+        conn(cgiFd).cgiClient = -1;
+        return false;
     }
 
     if (!process.headersSent) {
@@ -177,13 +165,43 @@ void HttpServer::handleCgiRead(int cgiFd) {
             fullResponse << "HTTP/1.1 200 OK\r\n";
 
             // Add Content-Type if not present
-            if (Utils::strToLower(headers).find("content-type:") == string::npos)
+            string lowercaseHeaders = "\r\n" + Utils::strToLower(headers);
+            string type, length;
+            if (!cgiHeaderValue(lowercaseHeaders, "content-type", type)) {
                 fullResponse << "Content-Type: text/html\r\n";
+                type = "text/html";
+            }
 
-            fullResponse << headers << "\r\n\r\n" << body;
+            // the output is compressed as it arrives, unless the script took care of the encoding or the length itself
+            bool hasLength = cgiHeaderValue(lowercaseHeaders, "content-length", length);
+            if (!hasLength && lowercaseHeaders.find("\r\ncontent-encoding:") == string::npos) {
+                bool varies;
+                int level = gzipLevel(clientSocket, process.location, type, string::npos, varies);
+                if (level > 0) {
+                    log.debug() << "Compressing the CGI output with gzip level " << repr(level) << std::endl;
+                    process.gzip.start(level);
+                    fullResponse << "Content-Encoding: gzip\r\n";
+                }
+                if (varies)
+                    fullResponse << "Vary: Accept-Encoding\r\n";
+            }
 
+            // framing: the script's Content-Length, chunks for HTTP/1.1 clients, otherwise closing the connection ends the body
+            if (hasLength && length.find_first_not_of("0123456789") == string::npos && !length.empty())
+                process.contentLeft = static_cast<size_t>(std::strtoul(length.c_str(), NULL, 10));
+            else if (hasLength || lowercaseHeaders.find("\r\ntransfer-encoding:") != string::npos ||
+                     conn(clientSocket).request.httpVersion != "HTTP/1.1")
+                conn(clientSocket).persistent = false;
+            else {
+                process.chunked = true;
+                fullResponse << "Transfer-Encoding: chunked\r\n";
+            }
+            fullResponse << "Connection: " << connectionHeader(clientSocket) << "\r\n";
+
+            fullResponse << headers << "\r\n\r\n";
             process.headersSent = true;
             queueWrite(clientSocket, fullResponse.str());
+            queueCgiBody(clientSocket, body.data(), body.size(), false);
             log.debug() << "Clearing response buffer" << std::endl;
             process.response.clear();
 
@@ -200,46 +218,181 @@ void HttpServer::handleCgiRead(int cgiFd) {
             sendError(clientSocket, 413, process.location);
             // TODO: @all: not sure if the following line is correct
             closeAndRemoveMultPlexFd(_monitorFds, cgiFd);
-            log.debug() << "Removing remote client " << repr(clientSocket) << " from clientToCgi map" << std::endl;
-            _clientToCgi.erase(clientSocket);
-            log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from cgiToClient map" << std::endl;
-            _cgiToClient.erase(cgiFd);
-            return;
+            log.debug() << "Removing remote client " << repr(clientSocket) << " from the CGI registry" << std::endl;
+            detachCgi(clientSocket);
+            log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from its client" << std::endl;
+            conn(cgiFd).cgiClient = -1;
+            return false;
         } else {
             log.debug() << "End of header fields marker not yet found, buffering data further" << std::endl;
         }
     } else {
         log.debug() << "Queueing data for sending from CGI stdout (headers are already sent): "
                     << repr(const_cast<char *>(string(buffer, static_cast<size_t>(bytesRead)).c_str())) << std::endl;
-        queueWrite(clientSocket, string(buffer, static_cast<size_t>(bytesRead)));
+        queueCgiBody(clientSocket, buffer, static_cast<size_t>(bytesRead), false);
     }
+    return true;
 }
 
-bool HttpServer::parseRequestLine(int clientSocket, const string &_line, HttpRequest &request) {
-    string line = _line;
-    line.erase(0, line.find_first_not_of(" \t\r\n"));
-    line.erase(line.find_last_not_of(" \t\r\n") + 1);
-    log.trace() << "Trimmed original line " << repr(_line) << " to this: " << repr(line) << std::endl;
-    log.debug() << "Parsing request line: " << repr(line) << std::endl;
-    if (line.length() > Constants::clientMaxRequestSizeWithoutBody) {
-        log.debug() << "Request line is too large: " << repr(line) << std::endl;
-        // should only the request.path be checked? Or the entire request line? who knows
-        sendError(clientSocket, 414, NULL);
+// the value of a header field in the CGI output, lowercaseHeaders has to start with CRLF so every field name follows one
+bool HttpServer::cgiHeaderValue(const string &lowercaseHeaders, const string &name, string &value) {
+    size_t start = lowercaseHeaders.find("\r\n" + name + ":");
+    if (start == string::npos)
         return false;
+    start += name.size() + 3;
+    size_t end = lowercaseHeaders.find("\r\n", start);
+    value = lowercaseHeaders.substr(start, end == string::npos ? string::npos : end - start);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t") + 1);
+    return true;
+}
+
+// queues a piece of the CGI output's body, compressed and framed as announced in the headers. finish ends the body, which is only
+// done for CGI processes that exited successfully
+void HttpServer::queueCgiBody(int clientSocket, const char *data, size_t size, bool finish) {
+    CgiProcess &process = conn(clientSocket).cgi;
+    string piece;
+    if (process.gzip.active()) {
+        try {
+            piece = process.gzip.compress(data, size, finish);
+        } catch (const runtime_error &error) {
+            // the rest of the output is dropped and the body is never terminated, so the client can tell it's incomplete
+            log.error() << "Failed to compress the CGI output for client " << repr(clientSocket) << ": " << ansi::red(error.what())
+                        << std::endl;
+            conn(clientSocket).persistent = false;
+            process.contentLeft = 0;
+            process.chunked = false;
+            return;
+        }
+    } else if (process.contentLeft != string::npos) {
+        if (size > process.contentLeft)
+            log.warning() << "CGI output is longer than its Content-Length, dropping " << repr(size - process.contentLeft) << " bytes"
+                          << std::endl;
+        piece.assign(data, std::min(size, process.contentLeft));
+        process.contentLeft -= piece.size();
+    } else
+        piece.assign(data, size);
+    if (process.chunked && !piece.empty()) {
+        std::ostringstream chunkSize;
+        chunkSize << std::hex << piece.size() << "\r\n";
+        piece = chunkSize.str() + piece + "\r\n";
     }
-    std::istringstream iss(line);
-    if (!(iss >> request.method >> request.path >> request.httpVersion)) { // NOTODO: @all: technically, only space is allowed as a
-                                                                           // separator, not just any whitespace
-        log.debug() << "Failed to parse request line: " << repr(line) << std::endl;
-        sendError(clientSocket, 400, NULL);
-        return false;
+    if (process.chunked && finish)
+        piece += "0\r\n\r\n";
+    if (!piece.empty())
+        queueWrite(clientSocket, piece);
+}
+
+// The CGI process has exited and has no more output: queue what's left of it and detach the process from its client. If it failed,
+// the body is left unterminated and the connection is closed, so the client can tell that the response is incomplete. cgiFd is -1 if
+// the pipe has already been closed.
+void HttpServer::finishCgiResponse(int clientSocket, int cgiFd) {
+    CgiProcess &process = conn(clientSocket).cgi;
+    process.done = true;
+
+    if (!process.headersSent) {
+        log.debug() << "Removing remote client " << repr(clientSocket) << " from persistent connections" << std::endl;
+        conn(clientSocket).persistent = false;
+        log.warning() << "CGI process " << repr(process)
+                      << " didn't send any data (not even headers), sending 502 Bad "
+                         "Gateway to client"
+                      << std::endl;
+        sendError(clientSocket, 502, process.location);
+    } else if (!WIFEXITED(process.status) || WEXITSTATUS(process.status) != 0) {
+        log.warning() << "CGI process " << repr(process) << " failed, not ending the body and closing the connection afterwards"
+                      << std::endl;
+        queueCgiBody(clientSocket, process.response.data(), process.response.size(), false);
+        conn(clientSocket).persistent = false;
+    } else {
+        log.debug() << "CGI process is done, queueing remaining data and ending the body" << std::endl;
+        log.trace() << "The data is: " << repr(process.response) << std::endl;
+        queueCgiBody(clientSocket, process.response.data(), process.response.size(), true);
+        if (process.contentLeft != string::npos && process.contentLeft > 0) {
+            log.debug() << "CGI output is shorter than its Content-Length, closing the connection afterwards" << std::endl;
+            conn(clientSocket).persistent = false;
+        }
     }
 
-    if (iss.rdbuf()->in_avail()) { // this is to check that there are no additional fields
-        log.debug() << "Failed to parse request line (too many fields): " << repr(line) << std::endl;
-        sendError(clientSocket, 400, NULL);
+    if (cgiFd >= 0)
+        closeAndRemoveMultPlexFd(_monitorFds, cgiFd);
+    log.debug() << "Removing remote client " << repr(clientSocket) << " from the CGI registry" << std::endl;
+    detachCgi(clientSocket);
+    if (cgiFd >= 0) {
+        log.debug() << "Removing CGI pipe FD " << repr(cgiFd) << " from its client" << std::endl;
+        conn(cgiFd).cgiClient = -1;
+    }
+    Connection &client = conn(clientSocket);
+    if (client.pendingWrite.empty()) { // everything has been sent already, no write event will finish the response
+        client.hasPendingWrite = false;
+        stopMonitoringForWriteEvents(_monitorFds, clientSocket);
+        terminatePendingCloses(clientSocket);
+    }
+}
+
+// SIGCHLD is only delivered through the signalfd, so child exits are handled like any other event of the multiplexer
+void HttpServer::handleChildExits() {
+    struct signalfd_siginfo info;
+    while (::read(_signalFd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) // pending SIGCHLDs coalesce, reap them all
+        ;
+    int status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+        log.debug() << "Reaped child process " << repr(pid) << " with wait status " << repr(status) << std::endl;
+        for (size_t i = 0; i < _cgiClients.size(); ++i) {
+            if (conn(_cgiClients[i]).cgi.pid == pid) {
+                handleCgiExit(_cgiClients[i], status);
+                break;
+            }
+        }
+    }
+}
+
+// Whatever the CGI process wrote before exiting is still in the pipe and read right away, at most io_budget bytes of it like for any
+// readiness event. The rest is left to the readiness path. Either way the pipe normally ends with EOF, which finishes the response,
+// otherwise something else (e.g. a background process) holds its stdout open and the response is finished once the pipe is empty.
+void HttpServer::handleCgiExit(int clientSocket, int status) {
+    CgiProcess &process = conn(clientSocket).cgi;
+    process.dead = true;
+    process.status = status;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        log.debug() << "CGI process exited successfully: " << repr(process) << std::endl;
+    else if (WIFEXITED(status))
+        log.warning() << "CGI process exited with status " << repr(WEXITSTATUS(status)) << ": " << repr(process) << std::endl;
+    else
+        log.warning() << "CGI process was terminated by signal " << repr(WTERMSIG(status)) << ": " << repr(process) << std::endl;
+    int readFd = process.readFd;
+    int writeFd = process.writeFd;
+    if (cgiClientOf(writeFd) == clientSocket) {
+        log.debug() << "Dropping the rest of the request body for the exited CGI process" << std::endl;
+        conn(writeFd).pendingWrite.clear();
+        terminateIfNoPendingDataAndNoCgi(writeFd, 0);
+    }
+    if (readFd < 0) {
+        log.debug() << "Stdout of the exited CGI process has already been closed, finishing the response" << std::endl;
+        finishCgiResponse(clientSocket, -1);
+        return;
+    }
+    size_t budget = _ioBudget;
+    bool mightHaveMore;
+    while ((mightHaveMore = handleCgiRead(readFd, budget)) && budget > 0)
+        ;
+    if (mightHaveMore && cgiOf(clientSocket) != NULL && isMonitoredFd(_monitorFds, readFd)) {
+        log.debug() << "I/O budget for the exited CGI process's output is used up, reading the rest when it's ready" << std::endl;
+        rearmEdgeTriggeredFd(_monitorFds, readFd); // the data is already there, so an edge-triggered FD won't be reported again
+    }
+}
+
+// the parser already split the request line into method, request target and version
+bool HttpServer::parseRequestLine(int clientSocket, HttpRequest &request) {
+    const RequestParser &parser = request.parser;
+    if (parser.target().length > Constants::clientMaxRequestSizeWithoutBody) {
+        log.debug() << "Request target is too large: " << repr(parser.target().length) << " bytes" << std::endl;
+        sendError(clientSocket, 414, NULL);
         return false;
     }
+    request.method = parser.str(parser.method());
+    request.path = parser.str(parser.target());
+    request.httpVersion = parser.str(parser.version());
     size_t idxOfQuestionMark = request.path.find('?');
     if (idxOfQuestionMark != request.path.npos)
         request.rawQuery = request.path.substr(idxOfQuestionMark + 1);
@@ -254,34 +407,6 @@ bool HttpServer::parseRequestLine(int clientSocket, const string &_line, HttpReq
     return true;
 }
 
-bool HttpServer::parseHeader(const string &line, HttpRequest &request) {
-    // not doing obs-fold, aka line folding (rfc2616), since it has been obsoleted in
-    // rfc7230.
-    // single header == single line (ends in \r\n)
-    // https://stackoverflow.com/questions/31237198/is-it-possible-to-include-multiple-crlfs-in-a-http-header-field
-    size_t colonPos = line.find(':');
-    if (colonPos == string::npos) {
-        log.warning() << "Failed to parse header (missing colon): " << repr(line) << std::endl;
-        return false;
-    }
-
-    // https://www.rfc-editor.org/rfc/rfc2616#section-4.2
-    // "Field names [==header names, keys, whatever] are case-insensitive."
-    // Therefore, always index using a lowercase string!
-    string key = Utils::strToLower(line.substr(0, colonPos));
-    string value = line.substr(colonPos + 1);
-
-    // Trim leading/trailing linear whitespace
-    value.erase(0, value.find_first_not_of(" \t\r\n"));
-    value.erase(value.find_last_not_of(" \t\r\n") + 1);
-
-    log.debug() << "Successfully parsed header." << std::endl;
-    log.debug() << "(Lowercased) Name: " << repr(key) << std::endl;
-    log.debug() << "Field Value: " << repr(value) << std::endl;
-    request.headers[key] = value;
-    return true;
-}
-
 void HttpServer::handleDelete(int clientSocket, const HttpRequest &request, const LocationCtx &location) {
     log.debug() << "Trying to handle delete for location " << repr(location) << std::endl;
     if (getFirstDirective(location.second, "upload_dir")[0].empty()) {
@@ -331,7 +456,19 @@ static string getFileName(const string &path) {
     return path.substr(pos);
 }
 
-void HttpServer::handleUpload(int clientSocket, const HttpRequest &request, const LocationCtx &location, bool overwrite) {
+static string uploadPath(const HttpServer::HttpRequest &request, const LocationCtx &location) {
+    return getFirstDirective(location.second, "root")[0] + getFirstDirective(location.second, "upload_dir")[0] + getFileName(request.path);
+}
+
+// an existing file can only be replaced by a regular file, and only if overwriting is allowed (PUT)
+static bool uploadConflicts(const string &diskPath, bool overwrite) {
+    struct stat fileStat;
+    return ::stat(diskPath.c_str(), &fileStat) == 0 && (!S_ISREG(fileStat.st_mode) || !overwrite);
+}
+
+// The body is usually in the file next to the destination already (see startUpload), otherwise it's copied there first. Either way the
+// file only appears under its name once it's complete, and the 201 is sent after that
+void HttpServer::handleUpload(int clientSocket, HttpRequest &request, const LocationCtx &location, bool overwrite) {
     log.debug() << "Trying to handle file upload for location " << repr(location) << std::endl;
     if (getFirstDirective(location.second, "upload_dir")[0].empty()) {
         log.debug() << "upload_dir directive is empty, therefore file upload is "
@@ -341,42 +478,52 @@ void HttpServer::handleUpload(int clientSocket, const HttpRequest &request, cons
         return;
     }
     log.debug() << "upload_dir directive exists, getting file name" << std::endl;
-    string fileName = getFileName(request.path);
-    string diskPath = getFirstDirective(location.second, "root")[0] + getFirstDirective(location.second, "upload_dir")[0] + fileName;
+    string diskPath = uploadPath(request, location);
 
-    struct stat fileStat;
-    int fileExists = stat(diskPath.c_str(), &fileStat) == 0;
-
-    if (fileExists && !S_ISREG(fileStat.st_mode)) {
-        log.debug() << "File exists already and is not a regulare file, can't handle, "
+    if (uploadConflicts(diskPath, overwrite)) {
+        log.debug() << "File exists already and is not a regular file, or overwriting of files is turned off, "
                        "sending 409 Conflict"
                     << std::endl;
         sendError(clientSocket, 409, &location); // == conflict
-    } else if (fileExists && !overwrite) {
-        log.debug() << "File exists already and overwriting of files is turned off, "
-                       "sending 409 Conflict"
-                    << std::endl;
-        sendError(clientSocket, 409, &location); // == conflict
-    } else if (fileExists) {
-        log.debug() << "File exists already but overwriting of files is turned on, file "
-                       "will be overwritten"
-                    << std::endl;
+        return;
     }
 
-    std::ofstream of(diskPath.c_str());
-    if (!of) {
-        log.error() << "Failed to open file on path " << repr(diskPath) << " for writing" << std::endl;
+    size_t size = request.body.size();
+    try {
+        if (!request.body.streaming())
+            request.body.streamTo(diskPath); // a spooled body is copied file to file
+        if (!request.body.commit(overwrite)) {
+            log.debug() << "File was created while the upload was running, sending 409 Conflict" << std::endl;
+            sendError(clientSocket, 409, &location);
+            return;
+        }
+    } catch (const runtime_error &error) {
+        log.error() << "Failed to write file on path " << repr(diskPath) << ": " << ansi::red(error.what()) << std::endl;
         sendError(clientSocket, 500, &location);
         return;
     }
-    of.write(request.body.c_str(), static_cast<long>(request.body.length()));
-    of.flush();
-    of.close();
-    log.debug() << "Written " << repr(request.body.length()) << " bytes to file " << repr(diskPath) << std::endl;
+    log.debug() << "Written " << repr(size) << " bytes to file " << repr(diskPath) << std::endl;
     sendString(clientSocket, "Successfully uploaded " + request.path + "\n", 201);
 }
 
-void HttpServer::handleRequestInternally(int clientSocket, const HttpRequest &request, const LocationCtx &location) {
+// An upload the location will accept is written to a file next to its destination while it arrives, one received piece at a time,
+// instead of being collected first. Anything that's refused later (409 and the like) removes the file again along with the body
+void HttpServer::startUpload(int clientSocket, HttpRequest &request, const LocationCtx &location) {
+    if ((request.method != "POST" && request.method != "PUT") || !methodAllowed(clientSocket, request, location, false) ||
+        !requestIsHandledInternally(request, location) || getFirstDirective(location.second, "upload_dir")[0].empty())
+        return; // the errors are sent once the request is complete
+    string diskPath = uploadPath(request, location);
+    if (uploadConflicts(diskPath, request.method == "PUT"))
+        return; // will be a 409 anyway
+    try {
+        request.body.streamTo(diskPath);
+        log.debug() << "Streaming the body of " << repr(clientSocket) << " to " << repr(request.body.get_tmpPath()) << std::endl;
+    } catch (const runtime_error &error) {
+        log.warning() << "Can't stream upload: " << ansi::red(error.what()) << ", collecting the body first" << std::endl;
+    }
+}
+
+void HttpServer::handleRequestInternally(int clientSocket, HttpRequest &request, const LocationCtx &location) {
     log.debug() << "Request is not for CGI, handling internally" << std::endl;
     if (request.method == "GET" || request.method == "HEAD")
         serveStaticContent(clientSocket, request, location);
@@ -408,10 +555,11 @@ static bool methodIsImplemented(const string &method) {
 }
 // clang-format on
 
-bool HttpServer::methodAllowed(int clientSocket, const HttpRequest &request, const LocationCtx &location) {
+bool HttpServer::methodAllowed(int clientSocket, const HttpRequest &request, const LocationCtx &location, bool sendErrorMsg) {
     if (!Utils::allUppercase(request.method)) {
         log.debug() << "Invalid request, method not all uppercase" << std::endl;
-        sendError(clientSocket, 400, &location);
+        if (sendErrorMsg)
+            sendError(clientSocket, 400, &location);
         return false;
     } else if (!directiveExists(location.second, "limit_except")) {
         if (methodIsImplemented(request.method)) {
@@ -422,7 +570,8 @@ bool HttpServer::methodAllowed(int clientSocket, const HttpRequest &request, con
             return true;
         }
         log.debug() << "Method " << repr(request.method) << " is not allowed since it is not implemented" << std::endl;
-        sendError(clientSocket, 405, &location);
+        if (sendErrorMsg)
+            sendError(clientSocket, 405, &location);
         return false;
     }
     string limit_except = "limit_except";
@@ -435,10 +584,16 @@ bool HttpServer::methodAllowed(int clientSocket, const HttpRequest &request, con
         }
     }
     log.debug() << "Method not allowed, since it was not one of the allowed directives" << std::endl;
-    sendError(clientSocket, 405, &location);
+    if (sendErrorMsg)
+        sendError(clientSocket, 405, &location);
     return false;
 }
 
+// whether handleRequest() serves the request itself, instead of redirecting it or handing it to a CGI process
+bool HttpServer::requestIsHandledInternally(const HttpRequest &request, const LocationCtx &location) {
+    return !directiveExists(location.second, "return") && !requestIsForCgi(request, location);
+}
+
 void HttpServer::rewriteRequest(int clientSocket, int statusCode, const string &urlOrText, const LocationCtx &location) {
     log.debug() << "Rewriting request for client" << std::endl;
     if (DirectiveValidation::isDoubleQuoted(urlOrText))
@@ -449,7 +604,24 @@ void HttpServer::rewriteRequest(int clientSocket, int statusCode, const string &
         sendError(clientSocket, 500, &location); // proper parsing should catch this case!
 }
 
-void HttpServer::handleRequest(int clientSocket, const HttpRequest &request, const LocationCtx &location) {
+// 'Connection: close' is honoured while parsing the headers, the location's keep-alive limits are applied here.
+// Decided before the response is built, so its Connection header can tell the client whether the connection stays open
+void HttpServer::applyKeepAlive(int clientSocket, const LocationCtx &location) {
+    Connection &c = conn(clientSocket);
+    ++c.requestsServed;
+    c.keepAliveTimeout = Utils::convertTimeToSeconds(getFirstDirective(location.second, "keepalive_timeout")[0]);
+    size_t maxRequests = static_cast<size_t>(std::atol(getFirstDirective(location.second, "keepalive_requests")[0].c_str()));
+    if (c.keepAliveTimeout == 0) {
+        log.debug() << "Keep-alive is disabled, closing connection to " << repr(clientSocket) << " after the response" << std::endl;
+        c.persistent = false;
+    } else if (c.requestsServed >= maxRequests) {
+        log.debug() << "Client " << repr(clientSocket) << " reached keepalive_requests (" << repr(maxRequests)
+                    << "), closing connection after the response" << std::endl;
+        c.persistent = false;
+    }
+}
+
+void HttpServer::handleRequest(int clientSocket, HttpRequest &request, const LocationCtx &location) {
     log.info() << "Handling request to path: " << repr(request.path) << " to matched location " << repr(location.first) << std::endl;
     log.trace() << "Request: " << repr(request) << std::endl;
     log.trace() << "Location: " << repr(location) << std::endl;
@@ -458,7 +630,7 @@ void HttpServer::handleRequest(int clientSocket, const HttpRequest &request, con
     else if (directiveExists(location.second, "return"))
         rewriteRequest(clientSocket, std::atoi(getFirstDirective(location.second, "return")[0].c_str()),
                        getFirstDirective(location.second, "return")[1], location);
-    else if (!requestIsForCgi(request, location))
+    else if (requestIsHandledInternally(request, location))
         handleRequestInternally(clientSocket, request, location);
     else
         try {
@@ -491,25 +663,73 @@ bool HttpServer::isHeaderComplete(const HttpRequest &request) const {
     return !request.method.empty() && !request.path.empty() && !request.httpVersion.empty();
 }
 
+// All Content-Length fields have to be the same plain decimal number that fits into a size_t. Anything else leaves the end of the body
+// open to interpretation, and a proxy in front of the server might frame the request differently (RFC 9112 6.3)
+static bool parseContentLength(const RequestParser &parser, size_t &length) {
+    const HeaderTable &headers = parser.headers();
+    bool found = false;
+    for (size_t i = 0; i < headers.size(); ++i) {
+        if (headers[i].id != HeaderTable::CONTENT_LENGTH)
+            continue;
+        const char *digits = parser.data(headers[i].value);
+        size_t value = 0;
+        if (headers[i].value.length == 0)
+            return false;
+        for (size_t j = 0; j < headers[i].value.length; ++j) {
+            if (digits[j] < '0' || digits[j] > '9')
+                return false;
+            size_t digit = static_cast<size_t>(digits[j] - '0');
+            if (value > (std::numeric_limits<size_t>::max() - digit) / 10)
+                return false;
+            value = value * 10 + digit;
+        }
+        if (found && value != length)
+            return false;
+        length = value;
+        found = true;
+    }
+    return true;
+}
+
+// Determines how the body is framed, before the request can count toward keep-alive. Returns false after sending an error if it can't
+// be framed reliably
 bool HttpServer::updateSomeThingsBasedOnHeaders(int clientSocket, HttpRequest &request) {
-    if (request.headers.find("content-length") != request.headers.end())
-        request.contentLength = static_cast<size_t>(std::atoi(request.headers["content-length"].c_str()));
+    const RequestParser &parser = request.parser;
+    if (!parseContentLength(parser, request.contentLength)) {
+        log.debug() << "Invalid or conflicting Content-Length in request on " << repr(clientSocket) << std::endl;
+        sendError(clientSocket, 400, NULL);
+        return false;
+    }
 
-    if (request.headers.find("transfer-encoding") != request.headers.end() && request.headers["transfer-encoding"] == "chunked") {
-        request.chunkParsingState = PARSE_CHUNK_SIZE;
+    const HeaderTable &headers = parser.headers();
+    size_t encodings = 0;
+    for (size_t i = 0; i < headers.size(); ++i)
+        if (headers[i].id == HeaderTable::TRANSFER_ENCODING)
+            ++encodings;
+    if (encodings > 0) {
+        if (encodings != 1 || !parser.headerIs(HeaderTable::TRANSFER_ENCODING, "chunked")) {
+            log.debug() << "Transfer-Encoding other than chunked in request on " << repr(clientSocket) << std::endl;
+            sendError(clientSocket, 501, NULL);
+            return false;
+        }
         request.chunkedTransfer = true;
+        if (parser.hasHeader(HeaderTable::CONTENT_LENGTH)) { // chunked wins, but the sender can't be trusted with the next request
+            log.debug() << "Request on " << repr(clientSocket) << " has both Content-Length and Transfer-Encoding, ignoring "
+                        << "Content-Length and closing the connection after the response" << std::endl;
+            request.contentLength = 0;
+            conn(clientSocket).persistent = false;
+        }
     }
 
-    if (request.headers.find("connection") != request.headers.end() && request.headers["connection"] == "close") {
+    if (parser.headerIs(HeaderTable::CONNECTION, "close")) {
         log.debug() << "Requestion has 'Connection: close' header, marking the client socket " << repr(clientSocket) << " as non-persistent"
                     << std::endl;
-        persistConns.erase(clientSocket);
+        conn(clientSocket).persistent = false;
     }
 
-    if (request.headers.find("expect") != request.headers.end() && request.headers["expect"] == "100-continue") {
+    if (parser.headerIs(HeaderTable::EXPECT, "100-continue")) {
         log.debug() << "Found expect 100 continue header, sending appropriate response" << std::endl;
         queueWrite(clientSocket, "HTTP/1.1 100 Continue\r\n\r\n");
-        return false;
     }
     return true;
 }
@@ -556,35 +776,38 @@ bool HttpServer::validateRequest(const HttpRequest &request, int clientSocket) {
     return true;
 }
 
-size_t HttpServer::getRequestSizeLimit(int clientSocket, const HttpRequest &request) {
+// client_max_body_size and client_body_buffer_size of the location the request goes to, and where the body goes if it's an upload
+void HttpServer::prepareBody(int clientSocket, HttpRequest &request) {
     try {
-        log.trace() << "Trying to get request size limit" << std::endl;
+        log.trace() << "Trying to get request size limit and body buffer size" << std::endl;
         const LocationCtx &loc = requestToLocation(clientSocket, request);
-        size_t limit = Utils::convertSizeToBytes(getFirstDirective(loc.second, "client_max_body_size")[0]);
-        log.trace() << "Successfully got request size limit: " << repr(limit) << std::endl;
-        return limit;
+        request.bodySizeLimit = Utils::convertSizeToBytes(getFirstDirective(loc.second, "client_max_body_size")[0]);
+        request.body.setBufferSize(Utils::convertSizeToBytes(getFirstDirective(loc.second, "client_body_buffer_size")[0]));
+        log.trace() << "Successfully got request size limit: " << repr(request.bodySizeLimit) << std::endl;
+        startUpload(clientSocket, request, loc);
     } catch (const runtime_error &error) {
-        log.error() << "Failed to determine client_max_body_size for client socket " << repr(clientSocket) << ", returning default of "
-                    << Constants::defaultClientMaxBodySize << std::endl;
-        return Utils::convertSizeToBytes(Constants::defaultClientMaxBodySize);
+        log.error() << "Failed to determine client_max_body_size for client socket " << repr(clientSocket) << ", using defaults of "
+                    << Constants::defaultClientMaxBodySize << " and " << Constants::defaultClientBodyBufferSize << std::endl;
+        request.bodySizeLimit = Utils::convertSizeToBytes(Constants::defaultClientMaxBodySize);
+        request.body.setBufferSize(Utils::convertSizeToBytes(Constants::defaultClientBodyBufferSize));
     }
 }
 
 void HttpServer::removeClientAndRequest(int clientSocket) {
     removeClient(clientSocket);
     log.debug() << "Removing socket " << repr(clientSocket) << " from pendingRequests" << std::endl;
-    _pendingRequests.erase(clientSocket);
+    conn(clientSocket).hasRequest = false;
 }
 
 bool HttpServer::checkRequestBodySize(int clientSocket, const HttpRequest &request, size_t currentSize) {
     log.debug() << "Checking request body size limit" << std::endl;
-    size_t sizeLimit = getRequestSizeLimit(clientSocket, request);
+    size_t sizeLimit = request.bodySizeLimit;
     if (currentSize > sizeLimit) {
         log.warning() << "Request body (so far) is too big: " << repr(currentSize) << " bytes but max allowed is " << repr(sizeLimit)
                       << std::endl;
         sendError(clientSocket, 413, NULL); // Payload Too Large
         log.debug() << "Removing socket " << repr(clientSocket) << " from pendingRequests" << std::endl;
-        _pendingRequests.erase(clientSocket);
+        conn(clientSocket).hasRequest = false;
         return false;
     }
     log.trace() << "Request body size so far is " << repr(currentSize) << " which is OK (not bigger than " << repr(sizeLimit) << ")"
@@ -600,7 +823,7 @@ bool HttpServer::checkRequestSizeWithoutBody(int clientSocket, size_t currentSiz
                       << repr(sizeLimit) << std::endl;
         sendError(clientSocket, 413, NULL); // Payload Too Large
         log.debug() << "Removing socket " << repr(clientSocket) << " from pendingRequests" << std::endl;
-        _pendingRequests.erase(clientSocket);
+        conn(clientSocket).hasRequest = false;
         return false;
     }
     log.trace() << "Request size (without body) so far is " << repr(currentSize) << " which is OK (not bigger than " << repr(sizeLimit)
@@ -608,135 +831,88 @@ bool HttpServer::checkRequestSizeWithoutBody(int clientSocket, size_t currentSiz
     return true;
 }
 
-bool HttpServer::getChunkSizeStrAndConsume(string &buffer, string &chunkSizeStr) {
-    log.trace() << "Trying to read and consume chunk size specification from buffer: " << repr(buffer) << std::endl;
-    vector<char> bytes;
-    size_t i = 0;
-    while (true) {
-        char c = buffer[i];
-        if (Utils::isHexDigitNoCase(c))
-            bytes.push_back(c);
-        else
-            break;
-        ++i;
-    }
-    if (i + 1 >= buffer.length()) {
-        log.debug() << "Chunked request: Need more data" << std::endl;
-        chunkSizeStr = "";
-        return true; // need more data
-    } else if (buffer[i] == '\r' && buffer[i + 1] == '\n') {
-        log.debug() << "Successfully parsed chunk size specification" << std::endl;
-        log.trace() << "Updating buffer from " << repr(buffer) << std::endl;
-        log.trace() << "                  to " << repr(buffer.substr(i + 2)) << std::endl;
-        buffer = buffer.substr(i + 2);
-        chunkSizeStr = string(&bytes[0], bytes.size());
-        return true; // success
-    } else {
-        log.warning() << "Error, chunk size ends in invalid bytes, expected \\r\\n, but got " << static_cast<int>(buffer[i]) << " and "
-                      << static_cast<int>(buffer[i + 1]) << " (decimal)" << std::endl;
-        return false; // error
+// Feeds received bytes of a chunked body to the request's decoder, which appends the chunk data to the body. Sends the error response
+// itself if the body is malformed or grows (or is announced to grow) beyond client_max_body_size
+bool HttpServer::processChunkedData(int clientSocket, HttpRequest &request, const char *data, size_t size) {
+    size_t consumed = 0;
+    ChunkedDecoder::Status status;
+    try {
+        status = request.chunkedDecoder.decode(data, size, request.body, consumed);
+    } catch (const runtime_error &error) { // the body couldn't be spooled
+        log.error() << "Failed to store request body: " << ansi::red(error.what()) << std::endl;
+        sendError(clientSocket, 500, NULL);
+        conn(clientSocket).hasRequest = false;
+        return false;
     }
-}
-
-bool HttpServer::getChunkAndConsume(string &buffer, size_t chunkSize, string &retChunk) {
-    log.debug() << "Trying to consume chunk of size " << repr(chunkSize) << std::endl;
-    string chunk = buffer.substr(0, chunkSize);
-    if (chunk.length() + 1 >= buffer.length()) {
-        retChunk = "";
-        return false; // need more data
+    request.bytesRead += consumed;
+    log.debug() << "Chunked request: Decoded " << repr(consumed) << " of " << repr(size) << " bytes, body is now "
+                << repr(request.body.size()) << " bytes" << std::endl;
+    if (status == ChunkedDecoder::DECODE_ERROR) {
+        log.warning() << "Error while decoding chunked request body" << std::endl;
+        sendError(clientSocket, 400, NULL);
+        conn(clientSocket).hasRequest = false;
+        return false;
+    }
+    // the rest of the current chunk is already counted, so too big chunks are rejected before their data arrives
+    if (!checkRequestBodySize(clientSocket, request, request.body.size() + request.chunkedDecoder.remaining())) {
+        log.warning() << "Anticipated size of chunked request body is too big" << std::endl;
+        return false;
+    }
+    if (status == ChunkedDecoder::DECODE_COMPLETE) {
+        request.state = REQUEST_COMPLETE;
+        log.debug() << "Found last chunk, changed request state to " << repr(request.state) << std::endl;
+        request.temporaryBuffer.assign(data + consumed, size - consumed);
     }
-    log.debug() << "Chunk is " << repr(chunk) << " of size " << repr(chunk.length()) << std::endl;
-    log.debug() << "Successfully parsed chunk size specification" << std::endl;
-    log.trace() << "Updating buffer from " << repr(buffer) << std::endl;
-    log.trace() << "                  to " << repr(buffer.substr(chunk.length() + 2)) << std::endl;
-    buffer = buffer.substr(chunk.length() + 2);
-    retChunk = chunk;
     return true;
 }
 
-bool HttpServer::processChunkedData(int clientSocket, HttpRequest &request) {
-    if (request.chunkParsingState == PARSE_CHUNK_SIZE) {
-        string chunkSizeStr;
-        if (!getChunkSizeStrAndConsume(request.temporaryBuffer, chunkSizeStr)) {
-            log.warning() << "Error parsing chunk size specification" << std::endl;
-            return false;
-        }
-        if (chunkSizeStr.empty()) {
-            log.debug() << "Couldn't parse entire chunk size specification, need more data" << std::endl;
-            return true; // need more data, not updating request.body
-        }
-        request.chunkParsingState = PARSE_CHUNK;
-        log.debug() << "Changed chunk parsing state to " << repr(request.chunkParsingState) << std::endl;
-        request.thisChunkSize =
-            Utils::hexToSize(chunkSizeStr); // saving parsed chunk size, since we'll need it when parsing the chunk itself
-        if (!checkRequestBodySize(clientSocket, request, request.thisChunkSize + request.body.length())) {
-            log.warning() << "Error while reading chunk: Anticipated chunk size of " << repr(request.thisChunkSize) << " is too big"
-                          << std::endl;
-            return false;
-        }
+// Appends received bytes of a body with a Content-Length, whatever is behind it belongs to the next request. Sends the error response
+// itself if the body is too big or can't be stored
+bool HttpServer::processUnchunkedData(int clientSocket, HttpRequest &request, const char *data, size_t size) {
+    // the announced size counts, so too big bodies are rejected before their data arrives
+    if (!checkRequestBodySize(clientSocket, request, request.contentLength))
+        return false;
+    size_t taken = std::min(size, request.contentLength - request.bytesRead);
+    try {
+        request.body.append(data, taken);
+    } catch (const runtime_error &error) { // the body couldn't be spooled
+        log.error() << "Failed to store request body: " << ansi::red(error.what()) << std::endl;
+        sendError(clientSocket, 500, NULL);
+        conn(clientSocket).hasRequest = false;
+        return false;
     }
-
-    string chunk;
-    if (!getChunkAndConsume(request.temporaryBuffer, request.thisChunkSize, chunk)) {
-        log.debug() << "Couldn't parse entire chunk, need more data" << std::endl;
-        return true; // need more data, not updating request.body
-    } else if (request.thisChunkSize == 0 && chunk.empty()) {
+    request.bytesRead += taken;
+    log.debug() << "Unchunked request: Appended " << repr(taken) << " of " << repr(size) << " bytes, body is now "
+                << repr(request.body.size()) << " bytes" << (request.body.inMemory() ? "" : " (spooled to a file)") << std::endl;
+    if (request.bytesRead == request.contentLength) {
         request.state = REQUEST_COMPLETE;
-        log.debug() << "Found last chunk, changed request state to " << repr(request.state) << std::endl;
-        request.chunkParsingState = PARSE_CHUNK_SIZE;
-        log.debug() << "Technically needless: Changed chunk parsing state to " << repr(request.chunkParsingState) << std::endl;
-        return true; // end condition (and it was CRLF terminuated)
-    } else if (request.thisChunkSize == 0 && !chunk.empty()) {
-        log.warning() << "Error parsing chunk, chunk size of " << repr(0) << " was specified but a non-empty chunk followed" << std::endl;
-        return false; // got data although chunksize was zero, invalid request
-    } else if (request.thisChunkSize == chunk.length()) {
-        log.debug() << "Successfully extracted one chunk from the temporary buffer, appending to request body" << std::endl;
-        request.body += chunk;
-        log.debug() << "Doing recursive chunk processing call, in case there are more chunks contained in the temporary buffer"
-                    << std::endl;
-        request.chunkParsingState = PARSE_CHUNK_SIZE;
-        log.debug() << "Changed chunk parsing state to " << repr(request.chunkParsingState) << std::endl;
-        return processChunkedData(clientSocket, request);
-    } else {
-        log.warning() << "Error parsing chunk, specified chunk size " << repr(request.thisChunkSize) << " is not actual chunk size "
-                      << repr(chunk.length()) << std::endl;
-        return false; // request.thisChunkSize is not equal to actual (parsed) chunk size, invalid request
+        log.debug() << "Done collecting request body (bytes received reached content-length), updating request parsing state to "
+                    << repr(request.state) << std::endl;
+        request.temporaryBuffer.assign(data + taken, size - taken);
     }
+    return true;
 }
 
-bool HttpServer::processRequestHeaders(int clientSocket, HttpRequest &request, const string &rawData) {
+// called once the parser has seen the complete head of the request
+bool HttpServer::processRequestHeaders(int clientSocket, HttpRequest &request) {
     log.debug() << "Processing request headers" << std::endl;
-    size_t headerEnd = rawData.find("\r\n\r\n");
-    log.debug() << "Looking for \\r\\n\\r\\n. Found?: " << repr(headerEnd != string::npos) << std::endl;
-    if (headerEnd == string::npos) {
-        log.debug() << "Not processing headers, waiting for more client data to arrive" << std::endl;
-        return false; // Need more data
-    }
-
-    std::istringstream stream(rawData);
-    string line;
-
     // Parse request line (GET /path HTTP/1.1)
-    if (!std::getline(stream, line) || !parseRequestLine(clientSocket, line, request)) {
-        _pendingRequests.erase(clientSocket);
+    if (!parseRequestLine(clientSocket, request)) {
+        conn(clientSocket).hasRequest = false;
         return false;
     }
 
-    log.debug() << "Parsing all headers, line by line, \\n delimited" << std::endl;
-    // Parse headers (Key: Value)
-    while (std::getline(stream, line) && line != "\r") {
-        log.debug() << "Got this raw header line: " << repr(line) << std::endl;
-        if (!parseHeader(line, request)) {
-            log.debug() << "Failed to parse header line: " << repr(line) << std::endl;
-            sendError(clientSocket, 400, NULL);
-            _pendingRequests.erase(clientSocket);
-            return false;
-        }
-    }
-    log.debug() << "Found line consisting only of \\r, finishing header parsing" << std::endl;
+    // the header fields stay in the parser's table, lookups of the well-known ones are array accesses
+    const HeaderTable &headers = request.parser.headers();
+    if (log.isdebug())
+        for (size_t i = 0; i < headers.size(); ++i)
+            log.debug() << "Header " << repr(request.parser.str(headers[i].name)) << ": " << repr(request.parser.str(headers[i].value))
+                        << std::endl;
 
     // Process Content-Length and chunked transfer headers
     if (!updateSomeThingsBasedOnHeaders(clientSocket, request)) {
+        conn(clientSocket).hasRequest = false;
+        return false;
     }
     log.debug() << "Content length: " << repr(request.contentLength) << " (if it is " << repr(0)
                 << ", it can also mean the header not present, like with GET request)" << std::endl;
@@ -746,84 +922,35 @@ bool HttpServer::processRequestHeaders(int clientSocket, HttpRequest &request, c
     if (!validateRequest(request, clientSocket)) {
         log.debug() << "Request validation failed" << std::endl;
         log.debug() << "Removing socket " << repr(clientSocket) << " from pendingRequests" << std::endl;
-        _pendingRequests.erase(clientSocket);
+        conn(clientSocket).hasRequest = false;
         return false;
     }
 
-    // Move any remaining data to body
-    if (headerEnd + 4 < rawData.length()) {
-        if (request.chunkedTransfer) {
-            request.temporaryBuffer = rawData.substr(headerEnd + 4);
-            log.debug() << "Chunked request: Moved " << repr(request.temporaryBuffer.length()) << " bytes to temporary buffer" << std::endl;
-            if (!processChunkedData(clientSocket, request)) { // this might set request.state to REQUEST_COMPLETE
-                sendError(clientSocket, 400, NULL);
-                _pendingRequests.erase(clientSocket);
-                return false;
-            }
-            if (request.state == REQUEST_COMPLETE)
-                return true;
-        } else {
-            request.body = rawData.substr(headerEnd + 4);
-            request.bytesRead = request.body.length();
-            log.debug() << "Unchunked request: Moved " << repr(request.body.length()) << " bytes to body" << std::endl;
-        }
-    } else {
-        request.temporaryBuffer.clear();
-        request.body.clear();
-        request.bytesRead = 0;
-    }
-
-    // Update state
+    // the location doesn't change anymore, so it's looked up once instead of for every part of the body
+    prepareBody(clientSocket, request);
     request.state = READING_BODY;
     log.debug() << "Updating request parsing state to " << repr(request.state) << std::endl;
 
-    // If no body expected, mark as complete
-    if (!request.chunkedTransfer && (request.contentLength == 0 || request.bytesRead >= request.contentLength)) {
-        request.state = REQUEST_COMPLETE;
-        log.debug() << "No additional body data expected, updating request parsing state to " << repr(request.state) << std::endl;
+    // Move any remaining data to body
+    const string &received = request.parser.buffer();
+    size_t headSize = request.parser.headSize();
+    if (request.chunkedTransfer) {
+        log.debug() << "Chunked request: Decoding " << repr(received.length() - headSize) << " bytes received with the head" << std::endl;
+        return processChunkedData(clientSocket, request, received.data() + headSize, received.length() - headSize);
     }
-
-    return true;
+    // this also completes requests without a body right away
+    return processUnchunkedData(clientSocket, request, received.data() + headSize, received.length() - headSize);
 }
 
 bool HttpServer::processRequestBody(int clientSocket, HttpRequest &request, const char *buffer, size_t bytesRead) {
-
+    log.trace() << "Buffer is " << repr(const_cast<char *>(buffer)) << std::endl;
+    // NOTE: these functions might update the request state to REQUEST_COMPLETE, and check the size limit themselves
     if (request.chunkedTransfer) {
         log.debug() << "Processing chunked request body" << std::endl;
-        log.debug() << "Appending new data (" << repr(bytesRead) << " bytes) to temporary buffer (currently "
-                    << repr(request.temporaryBuffer.length()) << " bytes)" << std::endl;
-        log.trace() << "Buffer is " << repr(const_cast<char *>(buffer)) << std::endl;
-        log.trace() << "Temporary buffer is " << repr(request.temporaryBuffer) << std::endl;
-        request.temporaryBuffer.append(buffer, bytesRead);
-        if (!processChunkedData(clientSocket, request)) { // NOTE: this function might update the request state to REQUEST_COMPLETE
-            sendError(clientSocket, 400, NULL);
-            _pendingRequests.erase(clientSocket);
-            return false;
-        }
-    } else {
-        log.debug() << "Processing request body (unchunked)" << std::endl;
-        // Append new data to body
-        log.debug() << "Appending new data (" << repr(bytesRead) << " bytes) to body (currently " << repr(request.body.length())
-                    << " bytes)" << std::endl;
-        log.trace() << "Buffer is " << repr(const_cast<char *>(buffer)) << std::endl;
-        log.trace() << "Body is " << repr(request.body) << std::endl;
-        request.body.append(buffer, bytesRead);
-        request.bytesRead += bytesRead;
-    }
-
-    // Check size limit
-    if (!checkRequestBodySize(clientSocket, request, request.body.length()))
-        return false;
-
-    // Check if we have all the data
-    if (!request.chunkedTransfer && request.bytesRead >= request.contentLength) {
-        request.state = REQUEST_COMPLETE;
-        log.debug() << "Done collecting request body (not chunked and bytes received "
-                       "reached content-length), updating request parsing state to "
-                    << repr(request.state) << std::endl;
+        return processChunkedData(clientSocket, request, buffer, bytesRead);
     }
-
-    return true;
+    log.debug() << "Processing request body (unchunked)" << std::endl;
+    return processUnchunkedData(clientSocket, request, buffer, bytesRead);
 }
 
 void HttpServer::finalizeRequest(int clientSocket, HttpRequest &request) {
@@ -833,6 +960,7 @@ void HttpServer::finalizeRequest(int clientSocket, HttpRequest &request) {
         const LocationCtx &location = requestToLocation(clientSocket, request);
         bound = true;
         log.debug() << "Found location " << repr(location) << " for request " << repr(request) << std::endl;
+        applyKeepAlive(clientSocket, location);
         handleRequest(clientSocket, request, location);
     } catch (const runtime_error &err) {
         if (!bound)
@@ -841,39 +969,103 @@ void HttpServer::finalizeRequest(int clientSocket, HttpRequest &request) {
         log.error() << "Failed to match request to a server/location context: " << ansi::red(err.what()) << std::endl;
     }
     log.debug() << "Removing socket " << repr(clientSocket) << " from pendingRequests" << std::endl;
-    _pendingRequests.erase(clientSocket);
+    conn(clientSocket).hasRequest = false;
+    request.body.clear(); // consumed (a CGI process has its own FD of a spool file), an idle connection shouldn't hold on to it
+}
+
+// bytes received behind the end of a complete request belong to the next (pipelined) one
+static string takeLeftover(HttpServer::HttpRequest &request) {
+    string leftover;
+    leftover.swap(request.temporaryBuffer);
+    return leftover;
 }
 
 void HttpServer::handleIncomingData(int clientSocket, const char *buffer, ssize_t bytesRead) {
+    Connection &c = conn(clientSocket);
+    if (!c.hasRequest && !c.persistent) {
+        log.debug() << "Connection to " << repr(clientSocket) << " will be closed after the current response, discarding "
+                    << repr(bytesRead) << " bytes" << std::endl;
+        return;
+    }
+    // responses must leave in request order, and every queued response holds its file open until it's sent
+    if (c.hasCgi || c.hasPendingWrite || !c.pipelined.empty()) {
+        log.debug() << "Response to the previous request on " << repr(clientSocket) << " is still being produced or sent, buffering "
+                    << repr(bytesRead) << " bytes of pipelined data" << std::endl;
+        c.pipelined.append(buffer, static_cast<size_t>(bytesRead));
+        if (c.pipelined.length() > Constants::clientMaxPipelinedSize) {
+            log.warning() << "Too much pipelined data on " << repr(clientSocket) << " (" << repr(c.pipelined.length())
+                          << " bytes), closing the connection after the current response" << std::endl;
+            c.persistent = false;
+            c.pipelined.clear();
+        }
+        return;
+    }
+    parseIncomingData(clientSocket, buffer, static_cast<size_t>(bytesRead));
+    resumePipelinedRequests(clientSocket);
+}
 
-    // TODO: @timo: 408, request timeout??
+// Parses requests that were received behind an earlier one. This stops as soon as a response is queued or produced by a CGI process,
+// and is resumed once that response has been sent (see terminatePendingCloses).
+void HttpServer::resumePipelinedRequests(int clientSocket) {
+    Connection &c = conn(clientSocket);
+    while (!c.pipelined.empty() && !c.hasCgi && !c.hasPendingWrite) {
+        if (!c.persistent || !isMonitoredFd(_monitorFds, clientSocket)) {
+            log.debug() << "Dropping " << repr(c.pipelined.length()) << " bytes of pipelined data of closing connection "
+                        << repr(clientSocket) << std::endl;
+            c.pipelined.clear();
+            return;
+        }
+        string data;
+        data.swap(c.pipelined);
+        log.debug() << "Parsing " << repr(data.length()) << " bytes of pipelined data on " << repr(clientSocket) << std::endl;
+        parseIncomingData(clientSocket, data.c_str(), data.length());
+    }
+}
+
+void HttpServer::parseIncomingData(int clientSocket, const char *buffer, size_t bytesRead) {
     log.debug() << "Received data length: " << repr(bytesRead) << std::endl;
-    log.trace() << "The data is: " << repr(const_cast<char *>(buffer)) << std::endl;
+    if (log.istrace())
+        log.trace() << "The data is: " << repr(string(buffer, bytesRead)) << std::endl;
     // Get or create request state
-    HttpRequest &request = _pendingRequests[clientSocket];
+    Connection &c = conn(clientSocket);
+    if (!c.hasRequest) {
+        c.hasRequest = true;
+        c.request = HttpRequest();
+        c.pendingClose = false; // the previous response (if any) is completely queued, this one may be appended
+        if (!c.hasPendingWrite) // otherwise send_timeout applies until the previous response is out
+            armTimer(clientSocket, TIMER_HEADER);
+    }
+    HttpRequest &request = c.request;
     log.debug() << "Current request state: " << repr(request.state) << std::endl;
 
     // Process based on current state
     if (request.state == READING_HEADERS) {
-        // During header reading, we temporarily accumulate data
-        string rawData = request.temporaryBuffer + string(buffer, static_cast<size_t>(bytesRead));
-        log.debug() << "Accumulated data length: " << repr(rawData.length()) << std::endl;
+        // the parser continues where it stopped with the previous part of the head
+        RequestParser::Status status = request.parser.parse(buffer, bytesRead);
+        log.debug() << "Received " << repr(request.parser.headSize()) << " bytes of the request head so far" << std::endl;
 
-        // Check accumulated size (without body)
-        if (!checkRequestSizeWithoutBody(clientSocket, rawData.length()))
+        // Check accumulated size (without body, and without pipelined requests that may follow)
+        if (!checkRequestSizeWithoutBody(clientSocket, request.parser.headSize()))
             return;
 
-        // Store for next iteration if headers aren't complete
-        request.temporaryBuffer = rawData;
-
-        // Try to process headers
-        if (processRequestHeaders(clientSocket, request, rawData)) {
-            log.debug() << "Headers fully processed. Body size so far: " << repr(request.body.length()) << std::endl;
+        if (status == RequestParser::PARSE_ERROR) {
+            log.debug() << "Failed to parse request head: " << repr(request.parser.buffer()) << std::endl;
+            sendError(clientSocket, 400, NULL);
+            c.hasRequest = false;
+            return;
+        }
+        if (status == RequestParser::PARSE_INCOMPLETE) {
+            log.debug() << "Not processing headers, waiting for more client data to arrive" << std::endl;
+            return;
+        }
+        if (processRequestHeaders(clientSocket, request)) {
+            log.debug() << "Headers fully processed. Body size so far: " << repr(request.body.size()) << std::endl;
             if (!request.chunkedTransfer)
                 log.debug() << "Expected content length: " << repr(request.contentLength) << std::endl;
             else
                 log.debug() << "Is chunked requests: " << repr(request.chunkedTransfer) << std::endl;
-        }
+        } else
+            request.body.clear(); // removes an unfinished upload right away
     } else if (request.state == READING_BODY) {
         if (request.chunkedTransfer) {
             log.debug() << "Reading body using chunked transfer encoding. Current size: " << repr(request.bytesRead) << std::endl;
@@ -881,26 +1073,34 @@ void HttpServer::handleIncomingData(int clientSocket, const char *buffer, ssize_
             log.debug() << "Reading body (unchunked). Current size: " << repr(request.bytesRead)
                         << " Expected: " << repr(request.contentLength) << std::endl;
         }
-        if (!processRequestBody(clientSocket, request, buffer, static_cast<size_t>(bytesRead))) {
+        if (!processRequestBody(clientSocket, request, buffer, bytesRead)) {
+            request.body.clear(); // removes an unfinished upload right away
             return;
         }
     }
+    if (request.state == READING_BODY && !c.hasPendingWrite)
+        armTimer(clientSocket, TIMER_BODY); // restarted by every part of the body
     // no else if. if state was set to complete just now then might as well already handle
     // it in the same pass
     if (request.state == REQUEST_COMPLETE) { // If request is complete, handle it
-        if (!checkRequestBodySize(clientSocket, request, request.body.length()))
-            return;
+        string leftover = takeLeftover(request);
+        if (!c.hasPendingWrite)
+            armTimer(clientSocket, TIMER_NONE); // until the response is queued
 
         log.debug() << "Request completely received" << std::endl;
         finalizeRequest(clientSocket, request);
+        if (!leftover.empty()) {
+            log.debug() << "Keeping " << repr(leftover.length()) << " bytes received behind the request for the next one" << std::endl;
+            c.pipelined = leftover;
+        }
     }
 }
 
-void HttpServer::readFromClient(int clientSocket) {
-    if (_cgiToClient.find(clientSocket) != _cgiToClient.end()) {
+// returns whether there might be more data to read from the FD right away
+bool HttpServer::readFromClient(int clientSocket, size_t &budget) {
+    if (cgiClientOf(clientSocket) >= 0) {
         log.debug() << "CGI process has written data to stdout, trying to read it from FD " << repr(clientSocket) << std::endl;
-        handleCgiRead(clientSocket);
-        return;
+        return handleCgiRead(clientSocket, budget);
     }
     log.debug() << "FD " << repr(clientSocket) << " is a remote client socket, trying to read " << repr(CONSTANTS_CHUNK_SIZE)
                 << " bytes from it" << std::endl;
@@ -913,16 +1113,43 @@ void HttpServer::readFromClient(int clientSocket) {
     log.trace() << "errno: " << ::strerror(errno) << std::endl;
 
     log.debug() << "Actually read " << repr(bytesRead) << " bytes" << std::endl;
+    if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        log.debug() << "No more data available on FD " << repr(clientSocket) << " for now" << std::endl;
+        return false;
+    }
+    if (bytesRead > 0)
+        budget -= std::min(budget, static_cast<size_t>(bytesRead));
+    // a full buffer means the socket may hold more, as long as the client wasn't removed meanwhile
+    return receivedFromClient(clientSocket, buffer, bytesRead) && static_cast<size_t>(bytesRead) == sizeof(buffer) - 1;
+}
+
+// buffer must have room for a terminating NUL behind bytesRead bytes, returns whether the client is still monitored
+bool HttpServer::receivedFromClient(int clientSocket, char *buffer, ssize_t bytesRead) {
     if (bytesRead <= 0) {
         log.debug() << "Removing client (ignoring whether it's a persistent connection or not) since only " << repr(bytesRead)
                     << " bytes were read" << std::endl;
-        persistConns.erase(clientSocket);
+        conn(clientSocket).persistent = false;
         removeClientAndRequest(clientSocket);
-        _clientToCgi.erase(clientSocket);
-        return;
+        detachCgi(clientSocket);
+        return false;
     }
 
     buffer[bytesRead] = '\0';
     log.debug() << "Handling incoming data" << std::endl;
     handleIncomingData(clientSocket, buffer, bytesRead);
+    return isMonitoredFd(_monitorFds, clientSocket);
+}
+
+// the kernel already received the data into a buffer of the buffer ring, which goes back to the ring once it's handled
+void HttpServer::handleIoUringRecv(int clientSocket, const struct io_uring_cqe &cqe) {
+    if (!ioUringCompletionIsCurrent(_monitorFds, cqe)) { // the client was removed by an earlier completion of this round
+        _monitorFds.uring.recycleBuffer(cqe);
+        return;
+    }
+    if (cqe.res < 0)
+        log.debug() << "io_uring recv request for FD " << repr(clientSocket) << " failed: " << ::strerror(-cqe.res) << std::endl;
+    else if (log.isdebug())
+        log.debug() << "io_uring received " << repr(cqe.res) << " bytes from FD " << repr(clientSocket) << std::endl;
+    (void)receivedFromClient(clientSocket, _monitorFds.uring.buffer(cqe), cqe.res); // a result > 0 always comes with a buffer
+    _monitorFds.uring.recycleBuffer(cqe);
 }
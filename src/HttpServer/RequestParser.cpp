@@ -0,0 +1,154 @@
+#include <cctype>
+#include <cstring>
+#include <string>
+
+#include "ByteScan.hpp"
+#include "RequestParser.hpp"
+
+static bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+RequestParser::~RequestParser() {}
+
+RequestParser::RequestParser()
+    : _buffer(), _pos(0), _lineStart(0), _state(REQUEST_LINE), _status(PARSE_INCOMPLETE), _method(), _target(), _version(), _headers() {}
+
+RequestParser::RequestParser(const RequestParser &other)
+    : _buffer(other._buffer), _pos(other._pos), _lineStart(other._lineStart), _state(other._state), _status(other._status),
+      _method(other._method), _target(other._target), _version(other._version), _headers(other._headers) {}
+
+RequestParser &RequestParser::operator=(const RequestParser &other) {
+    if (this == &other)
+        return *this;
+    _buffer = other._buffer;
+    _pos = other._pos;
+    _lineStart = other._lineStart;
+    _state = other._state;
+    _status = other._status;
+    _method = other._method;
+    _target = other._target;
+    _version = other._version;
+    _headers = other._headers;
+    return *this;
+}
+
+void RequestParser::reset() {
+    _buffer.clear();
+    _pos = 0;
+    _lineStart = 0;
+    _state = REQUEST_LINE;
+    _status = PARSE_INCOMPLETE;
+    _method = Span();
+    _target = Span();
+    _version = Span();
+    _headers.clear();
+}
+
+// only the new bytes are scanned for line ends, every complete line is parsed exactly once. Control characters other than HTAB are
+// rejected on the way, CR only as part of CRLF
+RequestParser::Status RequestParser::parse(const char *data, size_t size) {
+    if (_status != PARSE_INCOMPLETE)
+        return _status;
+    _buffer.append(data, size);
+    while (_pos < _buffer.size()) {
+        size_t end = _pos + ByteScan::findLineStop(_buffer.data() + _pos, _buffer.size() - _pos);
+        if (end == _buffer.size() || (_buffer[end] == '\r' && end + 1 == _buffer.size())) {
+            _pos = end; // the LF of a CRLF may still be on its way
+            break;
+        }
+        if (_buffer[end] == '\n')
+            _pos = end + 1;
+        else if (_buffer[end] == '\r' && _buffer[end + 1] == '\n')
+            _pos = end + 2;
+        else
+            return _status = PARSE_ERROR;
+        size_t start = _lineStart;
+        _lineStart = _pos;
+        if (_state == REQUEST_LINE) {
+            if (start == end)
+                continue; // RFC 9112 2.2: empty lines before the request line should be ignored
+            if (!parseRequestLine(start, end))
+                return _status = PARSE_ERROR;
+            _state = FIELDS;
+        } else if (start == end) {
+            _state = DONE;
+            return _status = PARSE_COMPLETE;
+        } else if (!parseField(start, end))
+            return _status = PARSE_ERROR;
+    }
+    return _status;
+}
+
+// method, request target and version separated by blanks, nothing else
+bool RequestParser::parseRequestLine(size_t start, size_t end) {
+    Span *tokens[3] = {&_method, &_target, &_version};
+    size_t count = 0, i = start;
+    while (i < end) {
+        while (i < end && isBlank(_buffer[i]))
+            ++i;
+        if (i == end)
+            break;
+        if (count == 3)
+            return false;
+        size_t tokenStart = i;
+        while (i < end && !isBlank(_buffer[i]))
+            ++i;
+        *tokens[count++] = Span(tokenStart, i - tokenStart);
+    }
+    return count == 3;
+}
+
+// the field name has to be a token, which also rules out whitespace before the colon (RFC 9112 5.1) and obs-fold. It's lowercased in
+// place, as field names are case-insensitive
+bool RequestParser::parseField(size_t start, size_t end) {
+    char *name = &_buffer[start];
+    const char *colonPtr = static_cast<const char *>(std::memchr(name, ':', end - start));
+    if (colonPtr == NULL || colonPtr == name)
+        return false;
+    size_t colon = start + static_cast<size_t>(colonPtr - name);
+    if (ByteScan::lowerToken(name, colon - start, name) != colon - start)
+        return false;
+    size_t valueStart = colon + 1;
+    while (valueStart < end && isBlank(_buffer[valueStart]))
+        ++valueStart;
+    while (end > valueStart && isBlank(_buffer[end - 1]))
+        --end;
+    HeaderTable::Id id = HeaderTable::identify(name, colon - start);
+    _headers.add(HeaderTable::Entry(id, Span(start, colon - start), Span(valueStart, end - valueStart)));
+    return true;
+}
+
+RequestParser::Status RequestParser::status() const { return _status; }
+
+size_t RequestParser::headSize() const { return _state == DONE ? _lineStart : _buffer.size(); }
+
+const string &RequestParser::buffer() const { return _buffer; }
+
+const char *RequestParser::data(const Span &span) const { return _buffer.data() + span.offset; }
+
+string RequestParser::str(const Span &span) const { return _buffer.substr(span.offset, span.length); }
+
+const RequestParser::Span &RequestParser::method() const { return _method; }
+
+const RequestParser::Span &RequestParser::target() const { return _target; }
+
+const RequestParser::Span &RequestParser::version() const { return _version; }
+
+const HeaderTable &RequestParser::headers() const { return _headers; }
+
+bool RequestParser::hasHeader(HeaderTable::Id id) const { return _headers.find(id) != NULL; }
+
+const RequestParser::Span *RequestParser::header(HeaderTable::Id id) const {
+    const HeaderTable::Entry *entry = _headers.find(id);
+    return entry == NULL ? NULL : &entry->value;
+}
+
+bool RequestParser::headerIs(HeaderTable::Id id, const char *value) const {
+    const Span *span = header(id);
+    if (span == NULL || std::strlen(value) != span->length)
+        return false;
+    const char *field = data(*span);
+    for (size_t i = 0; i < span->length; ++i)
+        if (std::tolower(static_cast<unsigned char>(field[i])) != std::tolower(static_cast<unsigned char>(value[i])))
+            return false;
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once /* RequestParser.hpp */
+
+#include <cstddef>
+#include <string>
+
+#include "HeaderTable.hpp"
+
+using std::string;
+
+// Resumable parser for the head (request line and header fields) of an HTTP/1.x request. Received data is appended to one buffer and
+// the parser remembers where it stopped, so no byte is looked at twice no matter how fragmented the head arrives. The request line and
+// the fields are recorded as offsets into that buffer (see HeaderTable), copying them out is up to the caller. Lines end in CRLF or a
+// bare LF (RFC 9112 2.2), empty lines before the request line are skipped, obs-fold is rejected. The scanning itself is done by ByteScan.
+class RequestParser {
+  public:
+    enum Status { PARSE_INCOMPLETE, PARSE_COMPLETE, PARSE_ERROR };
+    typedef HeaderTable::Span Span;
+
+    ~RequestParser();
+    RequestParser();
+    RequestParser(const RequestParser &other);
+    RequestParser &operator=(const RequestParser &other);
+
+    Status parse(const char *data, size_t size); // appends data and continues where the last call stopped
+    void reset();                                // for the next request, keeps the capacity of the buffer
+    Status status() const;
+    size_t headSize() const; // bytes of the head received so far, including the empty line once it's complete
+    const string &buffer() const;
+    const char *data(const Span &span) const;
+    string str(const Span &span) const;
+    const Span &method() const;
+    const Span &target() const;
+    const Span &version() const;
+    const HeaderTable &headers() const;
+    const string &get_buffer() const { return _buffer; } // for repr
+    bool hasHeader(HeaderTable::Id id) const;
+    const Span *header(HeaderTable::Id id) const;               // value of the last field with that name, NULL if there is none
+    bool headerIs(HeaderTable::Id id, const char *value) const; // compares that value in place, ASCII case-insensitively
+
+  private:
+    enum State { REQUEST_LINE, FIELDS, DONE };
+
+    string _buffer;
+    size_t _pos;       // where scanning for the next line end resumes
+    size_t _lineStart; // first byte of the line currently being received
+    State _state;
+    Status _status;
+    Span _method;
+    Span _target;
+    Span _version;
+    HeaderTable _headers;
+
+    bool parseRequestLine(size_t start, size_t end);
+    bool parseField(size_t start, size_t end);
+};
@@ -0,0 +1,64 @@
+#include "ResponseCache.hpp"
+
+ResponseCache::~ResponseCache() {}
+
+ResponseCache::ResponseCache() : _lru(), _index(), _maxBytes(0), _maxFileSize(0), _bytes(0) {}
+
+void ResponseCache::configure(size_t maxBytes, size_t maxFileSize) {
+    while (!_lru.empty())
+        evict(_lru.begin());
+    _maxBytes = maxBytes;
+    _maxFileSize = maxFileSize;
+}
+
+bool ResponseCache::cacheable(const struct stat &info) const {
+    return _maxBytes > 0 && S_ISREG(info.st_mode) && static_cast<size_t>(info.st_size) <= _maxFileSize &&
+           static_cast<size_t>(info.st_size) < _maxBytes;
+}
+
+// NULL on a miss, the response stays valid until the next insert() or configure()
+const ResponseCache::Response *ResponseCache::find(const string &path, const struct stat &info) {
+    map<string, Entries::iterator>::iterator found = _index.find(path);
+    if (found == _index.end())
+        return NULL;
+    Entries::iterator entry = found->second;
+    if (entry->dev != info.st_dev || entry->ino != info.st_ino || entry->size != info.st_size || entry->mtime != info.st_mtime ||
+        entry->mtimeNsec != info.st_mtim.tv_nsec) {
+        evict(entry); // the file changed since it was read
+        return NULL;
+    }
+    _lru.splice(_lru.begin(), _lru, entry);
+    return &entry->response;
+}
+
+void ResponseCache::insert(const string &path, const struct stat &info, const Response &response) {
+    size_t bytes = response.data.size();
+    if (bytes > _maxBytes)
+        return;
+    map<string, Entries::iterator>::iterator found = _index.find(path);
+    if (found != _index.end())
+        evict(found->second);
+    while (!_lru.empty() && _bytes + bytes > _maxBytes)
+        evict(--_lru.end());
+    _lru.push_front(Entry());
+    Entry &entry = _lru.front();
+    entry.path = path;
+    entry.response = response;
+    entry.dev = info.st_dev;
+    entry.ino = info.st_ino;
+    entry.size = info.st_size;
+    entry.mtime = info.st_mtime;
+    entry.mtimeNsec = info.st_mtim.tv_nsec;
+    _index[path] = _lru.begin();
+    _bytes += bytes;
+}
+
+size_t ResponseCache::size() const { return _lru.size(); }
+
+size_t ResponseCache::bytes() const { return _bytes; }
+
+void ResponseCache::evict(Entries::iterator entry) {
+    _bytes -= entry->response.data.size();
+    _index.erase(entry->path);
+    _lru.erase(entry);
+}
@@ -0,0 +1,64 @@
+#pragma once /* ResponseCache.hpp */
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+
+#include "SharedBuffer.hpp"
+
+using std::list;
+using std::map;
+using std::string;
+
+// Fully serialised responses of small static files (status line, headers and body in one SharedBuffer), keyed by the path on disk.
+// Hits are queued without copying, every client just holds another reference. A cached response is only used while the file still has
+// the device, inode, size and mtime it was read with, otherwise the entry is dropped. The responses share a budget of maxBytes, the
+// least recently used ones are evicted to make room. Without a budget nothing is cached.
+class ResponseCache {
+  public:
+    struct Response {
+        SharedBuffer data;
+        size_t headersLength; // bytes of data before the body, the headers lack the final CRLF and Connection
+
+        Response() : data(), headersLength(0) {}
+        Response(const SharedBuffer &_data, size_t _headersLength) : data(_data), headersLength(_headersLength) {}
+    };
+
+    ~ResponseCache();
+    ResponseCache();
+
+    void configure(size_t maxBytes, size_t maxFileSize);
+    bool cacheable(const struct stat &info) const; // whether a response for this file would be cached
+    const Response *find(const string &path, const struct stat &info);
+    void insert(const string &path, const struct stat &info, const Response &response);
+    size_t size() const;
+    size_t bytes() const;
+
+  private:
+    struct Entry {
+        string path;
+        Response response;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        std::time_t mtime;
+        long mtimeNsec;
+
+        Entry() : path(), response(), dev(0), ino(0), size(0), mtime(0), mtimeNsec(0) {}
+    };
+    typedef list<Entry> Entries;
+
+    Entries _lru; // most recently used first
+    map<string, Entries::iterator> _index;
+    size_t _maxBytes;
+    size_t _maxFileSize;
+    size_t _bytes;
+
+    ResponseCache(const ResponseCache &other);            // not copyable, _index points into _lru
+    ResponseCache &operator=(const ResponseCache &other); // not copyable, _index points into _lru
+
+    void evict(Entries::iterator entry);
+};
@@ -1,13 +1,20 @@
 #include <algorithm>
+#include <cerrno>
 #include <cstdlib>
-#include <fstream>
-#include <ios>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
 #include <ostream>
 #include <sstream>
+#include <stdexcept>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "Ansi.hpp"
 #include "Config.hpp"
 #include "Constants.hpp"
 #include "HttpServer.hpp"
@@ -15,32 +22,81 @@
 #include "Repr.hpp"
 #include "Utils.hpp"
 
+using std::runtime_error;
 using Utils::STR;
 
 void HttpServer::queueWrite(int clientSocket, const string &data) {
     log.debug() << "Queueing a write: " << repr(data) << std::endl;
-    if (_pendingWrites.find(clientSocket) == _pendingWrites.end())
-        _pendingWrites[clientSocket] = string(data);
-    else
-        _pendingWrites[clientSocket] += data;
+    Connection &c = conn(clientSocket);
+    if (c.pendingWrite.empty())
+        armTimer(clientSocket, TIMER_SEND); // send_timeout runs from here on, restarted by every successful write
+    if (!c.hasPendingWrite) {
+        c.hasPendingWrite = true;
+        c.pendingWrite.clear();
+    }
+    c.pendingWrite.append(data);
+    startMonitoringForWriteEvents(_monitorFds, clientSocket);
+    log.debug() << "Pending write is now: " << repr(c.pendingWrite) << std::endl;
+}
+
+// the file is sent straight from the page cache with sendfile(), the output queue owns fd from now on
+void HttpServer::queueFile(int clientSocket, int fd, off_t offset, size_t length) {
+    log.debug() << "Queueing " << repr(length) << " bytes of file FD " << repr(fd) << " from offset " << repr(offset) << std::endl;
+    Connection &c = conn(clientSocket);
+    if (c.pendingWrite.empty())
+        armTimer(clientSocket, TIMER_SEND);
+    if (!c.hasPendingWrite) {
+        c.hasPendingWrite = true;
+        c.pendingWrite.clear();
+    }
+    c.pendingWrite.appendFile(fd, offset, length);
+    startMonitoringForWriteEvents(_monitorFds, clientSocket);
+}
+
+// a request body to the stdin of a CGI process, from memory or from its spool file
+void HttpServer::queueBody(int clientSocket, const RequestBody &body) {
+    log.debug() << "Queueing a request body of " << repr(body.size()) << " bytes" << (body.inMemory() ? "" : " from its spool file")
+                << std::endl;
+    Connection &c = conn(clientSocket);
+    if (c.pendingWrite.empty())
+        armTimer(clientSocket, TIMER_SEND);
+    if (!c.hasPendingWrite) {
+        c.hasPendingWrite = true;
+        c.pendingWrite.clear();
+    }
+    body.appendTo(c.pendingWrite);
     startMonitoringForWriteEvents(_monitorFds, clientSocket);
-    log.debug() << "Pending writes is now: " << repr(_pendingWrites) << std::endl;
 }
 
+const char *HttpServer::connectionHeader(int clientSocket) { return conn(clientSocket).persistent ? "keep-alive" : "close"; }
+
+// called once a response has been sent completely: either close the connection or keep reading the next request
 void HttpServer::terminatePendingCloses(int clientSocket) {
-    if (_pendingCloses.find(clientSocket) != _pendingCloses.end()) {
+    Connection &c = conn(clientSocket);
+    if (c.pendingClose) {
         log.debug() << "Removing client " << repr(clientSocket) << " from pendingCloses" << std::endl;
-        _pendingCloses.erase(clientSocket);
-        removeClient(clientSocket);
+        c.pendingClose = false;
     } else {
-        log.debug() << "Client " << repr(clientSocket) << " is not in pendingCloses, not doing anything with it" << std::endl;
+        log.debug() << "Client " << repr(clientSocket) << " is not in pendingCloses" << std::endl;
+    }
+    if (!c.persistent || c.kind != CONN_CLIENT) {
+        removeClient(clientSocket);
+        return;
     }
+    log.debug() << "Keeping connection to client " << repr(clientSocket) << " alive for " << repr(c.keepAliveTimeout)
+                << " seconds, it has sent " << repr(c.requestsServed) << " requests so far" << std::endl;
+    if (c.hasRequest) // a pipelined request has partly arrived meanwhile
+        armTimer(clientSocket, c.request.state == READING_BODY ? TIMER_BODY : TIMER_HEADER);
+    else if (c.requestsServed > 0) // before the first request client_header_timeout applies
+        armTimer(clientSocket, TIMER_KEEPALIVE);
+    resumePipelinedRequests(clientSocket);
 }
 
-bool HttpServer::maybeTerminateConnection(PendingWriteMap::iterator it, int clientSocket) {
-    if (it == _pendingWrites.end()) {                                // no pending writes anymore, maybe close
-        if (_clientToCgi.find(clientSocket) == _clientToCgi.end()) { // STOP, make sure CGI doesn't want to write data to this client
-            if (_cgiToClient.count(clientSocket) == 0) {             // STOP, make sure clientSocket is not a writeFd to the CGI process
+bool HttpServer::maybeTerminateConnection(int clientSocket) {
+    Connection &c = conn(clientSocket);
+    if (!c.hasPendingWrite) {      // no pending writes anymore, maybe close
+        if (!c.hasCgi) {           // STOP, make sure CGI doesn't want to write data to this client
+            if (c.cgiClient < 0) { // STOP, make sure clientSocket is not a writeFd to the CGI process
                 log.debug() << "Client " << repr(clientSocket)
                             << " is a proper remote client, there are no pending writes "
                                "for this client and no CGI process wants to write data "
@@ -62,128 +118,302 @@ bool HttpServer::maybeTerminateConnection(PendingWriteMap::iterator it, int clie
                         << " anymore, but don't terminate "
                            "connection yet, since the following CGI process still wants to write "
                            "data to the client: "
-                        << repr(_clientToCgi.at(clientSocket)) << std::endl;
+                        << repr(c.cgi) << std::endl;
         return true;
     }
     log.debug() << "There are still pending writes, not terminating connection to client " << repr(clientSocket) << std::endl;
     return false;
 }
 
-void HttpServer::terminateIfNoPendingDataAndNoCgi(PendingWriteMap::iterator &it, int clientSocket, ssize_t bytesSent) {
-    PendingWrite &pw = it->second;
+void HttpServer::terminateIfNoPendingDataAndNoCgi(int clientSocket, ssize_t bytesSent) {
+    Connection &c = conn(clientSocket);
+    PendingWrite &pw = c.pendingWrite;
 
     // Check whether we've sent everything and that there are no CGI processes
-    if (_clientToCgi.find(clientSocket) == _clientToCgi.end() && (pw.length() == 0 || bytesSent == 0)) {
+    if (!c.hasCgi && (pw.empty() || bytesSent == 0)) {
         log.debug() << "Removing client " << repr(clientSocket) << " from pendingWrites" << std::endl;
-        _pendingWrites.erase(it);
+        c.hasPendingWrite = false;
+        pw.clear();
         stopMonitoringForWriteEvents(_monitorFds, clientSocket);
-        removeClient(clientSocket);
-        log.debug() << "Removing client " << repr(clientSocket) << " from pendingCloses" << std::endl;
-        _pendingCloses.erase(clientSocket); // also not 100% sure about this one
-        if (_cgiToClient.count(clientSocket) != 0) {
-            log.debug() << "Removing CGI pipe FD " << repr(clientSocket) << " (write end, stdin of CGI) from cgiToClient map" << std::endl;
-            _cgiToClient.erase(clientSocket);
+        terminatePendingCloses(clientSocket);
+        if (c.cgiClient >= 0) {
+            CgiProcess *cgi = cgiOf(c.cgiClient);
+            log.debug() << "Unmapping CGI pipe FD " << repr(clientSocket) << " (write end, stdin of CGI) from its client" << std::endl;
+            c.cgiClient = -1;
+            // the CGI output was ignored while its stdin was still being written (half-duplex)
+            if (cgi != NULL && cgi->readFd >= 0)
+                rearmEdgeTriggeredFd(_monitorFds, cgi->readFd);
         }
-    } else if (_clientToCgi.find(clientSocket) == _clientToCgi.end()) {
-        log.debug() << "Haven't yet sent all the data: pendingWrites length: " << repr(pw.length()) << ", bytesSent: " << repr(bytesSent)
+    } else if (!c.hasCgi) {
+        log.debug() << "Haven't yet sent all the data: pendingWrites length: " << repr(pw.size()) << ", bytesSent: " << repr(bytesSent)
                     << std::endl;
     } else {
-        log.debug() << "Not terminating connection of " << repr(clientSocket)
-                    << ", there's still a CGI process: " << repr(_clientToCgi.at(clientSocket)) << std::endl;
+        log.debug() << "Not terminating connection of " << repr(clientSocket) << ", there's still a CGI process: " << repr(c.cgi)
+                    << std::endl;
     }
 }
 
-void HttpServer::writeToClient(int clientSocket) {
-    PendingWriteMap::iterator it = _pendingWrites.find(clientSocket);
-    if (maybeTerminateConnection(it, clientSocket))
-        return;
+// returns whether the FD might accept more data right away, sends at most budget bytes and deducts what was sent
+bool HttpServer::writeToClient(int clientSocket, size_t &budget) {
+    if (maybeTerminateConnection(clientSocket))
+        return false;
 
-    PendingWrite &pw = it->second;
-    size_t dataSize = std::min(Constants::chunkSize, pw.length());
-    string dataChunk = pw.substr(0, dataSize);
-    pw = pw.substr(dataSize); // remove chunk (that will be send) from the beginning
-    const char *data = dataChunk.c_str();
+    Connection &c = conn(clientSocket);
+    PendingWrite &pw = c.pendingWrite;
+    size_t dataSize = std::min(budget, pw.size());
+    struct iovec iov[CONSTANTS_MAX_IOVECS];
+    size_t gathered;
+    int iovCount = pw.gather(iov, CONSTANTS_MAX_IOVECS, dataSize, gathered);
+    int fileFd;
+    off_t fileOffset;
+    size_t fileLength;
 
     ssize_t bytesSent;
-    if (_cgiToClient.count(clientSocket)) { // it's a writeFd for the CGI, can't use send
-        log.debug() << "Writing this data of " << repr(dataSize) << " bytes to socket " << repr(clientSocket) << ": "
-                    << repr(const_cast<char *>(data)) << std::endl;
-        bytesSent = ::write(clientSocket, data, dataSize);
+    if (iovCount == 0 && pw.frontFile(fileFd, fileOffset, fileLength)) {
+        size_t fileChunk = std::min(dataSize, fileLength);
+        log.debug() << "Sending " << repr(fileChunk) << " bytes of file FD " << repr(fileFd) << " from offset " << repr(fileOffset)
+                    << " to socket " << repr(clientSocket) << std::endl;
+        bytesSent = ::sendfile(clientSocket, fileFd, &fileOffset, fileChunk);
+        log.debug() << "Sent " << repr(bytesSent) << " bytes to client " << repr(clientSocket) << std::endl;
+        if (bytesSent == 0) { // the file was truncated meanwhile, the promised Content-Length can't be kept anymore
+            log.warning() << "File FD " << repr(fileFd) << " ended before its queued length, closing client " << repr(clientSocket)
+                          << std::endl;
+            errno = EIO;
+            bytesSent = -1;
+        }
+    } else if (c.cgiClient >= 0) { // it's a writeFd for the CGI, can't use send
+        if (log.isdebug())
+            log.debug() << "Writing up to " << repr(dataSize) << " bytes in " << repr(iovCount) << " buffers to socket "
+                        << repr(clientSocket) << ": " << repr(pw.peek(dataSize)) << std::endl;
+        bytesSent = ::writev(clientSocket, iov, iovCount);
         log.debug() << "Written " << repr(bytesSent) << " bytes to client " << repr(clientSocket) << std::endl;
     } else {
-        log.debug() << "Sending this data of " << repr(dataSize) << " bytes to socket " << repr(clientSocket) << ": "
-                    << repr(const_cast<char *>(data)) << std::endl;
-        bytesSent = ::send(clientSocket, data, dataSize, 0);
+        if (log.isdebug())
+            log.debug() << "Sending up to " << repr(dataSize) << " bytes in " << repr(iovCount) << " buffers to socket "
+                        << repr(clientSocket) << ": " << repr(pw.peek(dataSize)) << std::endl;
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = static_cast<size_t>(iovCount);
+        // a file follows (or more buffers than fit into one call): let the kernel coalesce the headers with the first body bytes
+        int flags = gathered < dataSize ? MSG_DONTWAIT | MSG_MORE : MSG_DONTWAIT;
+        bytesSent = ::sendmsg(clientSocket, &msg, flags);
         log.debug() << "Sent " << repr(bytesSent) << " bytes to client " << repr(clientSocket) << std::endl;
     }
 
+    if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        log.debug() << "FD " << repr(clientSocket) << " is not ready for more data, waiting for the next write event" << std::endl;
+        return false;
+    }
     if (bytesSent < 0) {
+        c.persistent = false; // the response is broken, nothing more can follow on this connection
         removeClient(clientSocket);
         log.debug() << "Removing client " << repr(clientSocket) << " from pendingWrites" << std::endl;
-        _pendingWrites.erase(clientSocket);
+        c.hasPendingWrite = false;
+        pw.clear();
         log.debug() << "Removing client " << repr(clientSocket) << " from pendingCloses" << std::endl;
-        _pendingCloses.erase(clientSocket);
-        if (_cgiToClient.count(clientSocket) > 0) {
-            int client = _cgiToClient[clientSocket];
+        c.pendingClose = false;
+        if (c.cgiClient >= 0) {
+            int client = c.cgiClient;
             log.debug() << "Client " << repr(client) << " had data to send but pipe broke" << std::endl;
             log.debug() << "NOT notifying remote client " << repr(client) << " with a " << repr(500)
                         << ", (CGI process died/closed stdin), we don't care" << std::endl;
             sendError(client, 502, NULL);
         }
-        return;
+        return false;
     }
+    pw.consume(static_cast<size_t>(bytesSent)); // drop what was actually sent from the front
+    budget -= std::min(budget, static_cast<size_t>(bytesSent));
+    if (bytesSent > 0)
+        armTimer(clientSocket, pw.empty() ? TIMER_NONE : TIMER_SEND);
 
     log.debug() << "Successfully sent data to " << repr(clientSocket) << ", now checking if we need to reset the connection" << std::endl;
-    terminateIfNoPendingDataAndNoCgi(it, clientSocket, bytesSent);
+    bool mightTakeMore = bytesSent > 0 && !pw.empty();
+    terminateIfNoPendingDataAndNoCgi(clientSocket, bytesSent);
+    return mightTakeMore;
 }
 
 // note, be careful sending errors from this function, as it could lead to infinite
 // recursion! (the error sending function uses this function)
 bool HttpServer::sendFileContent(int clientSocket, const string &filePath, const LocationCtx &location, int statusCode,
-                                 const string &contentType, bool onlyHeaders) {
-    if (_pendingCloses.count(clientSocket) > 0) {
+                                 const string &contentType, bool onlyHeaders, const string &extraHeaders) {
+    if (conn(clientSocket).pendingClose) {
         log.debug() << "NOT sending file " << repr(filePath) << " with status code " << repr(statusCode) << " since for client "
                     << repr(clientSocket) << " there's already a pendingClose scheduled" << std::endl;
         return true;
     }
     log.debug() << "Trying to send file content of file " << repr(filePath) << std::endl;
-    std::ifstream file(filePath.c_str(), std::ifstream::binary);
-    if (!file) {
-        log.debug() << "Could not open file " << repr(filePath) << std::endl;
+    if (statusCode == 200 && contentType.empty() && extraHeaders.empty() &&
+        sendCachedResponse(clientSocket, filePath, location, onlyHeaders))
+        return true;
+    struct stat fileInfo;
+    int fd = _fileCache.open(filePath, fileInfo);
+    if (fd < 0) {
+        log.debug() << "Could not open file " << repr(filePath) << " as a regular file: " << ::strerror(errno) << std::endl;
         sendError(clientSocket, 403, &location);
         return false;
     }
+    queueFileResponse(clientSocket, fd, fileInfo, filePath, statusCode, contentType, onlyHeaders, extraHeaders);
+    return true;
+}
 
-    log.debug() << "Could open file " << repr(filePath) << ", determining file size via istream::seekg and istream::tellg" << std::endl;
-    file.seekg(0, std::ios::end);
-    long fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
-    log.debug() << "File size is " << repr(fileSize) << std::endl;
+// takes ownership of fd, an open regular file described by fileInfo
+void HttpServer::queueFileResponse(int clientSocket, int fd, const struct stat &fileInfo, const string &filePath, int statusCode,
+                                   const string &contentType, bool onlyHeaders, const string &extraHeaders) {
+    if (conn(clientSocket).pendingClose) {
+        log.debug() << "NOT sending file " << repr(filePath) << " with status code " << repr(statusCode) << " since for client "
+                    << repr(clientSocket) << " there's already a pendingClose scheduled" << std::endl;
+        ::close(fd);
+        return;
+    }
+    long fileSize = fileInfo.st_size;
+    log.debug() << "Could open file " << repr(filePath) << ", file size is " << repr(fileSize) << std::endl;
 
     std::ostringstream headers;
     log.debug() << "Building headers for error response" << std::endl;
     headers << _httpVersionString << " " << statusCode << " " << statusTextFromCode(statusCode) << "\r\n"
             << "Content-Length: " << fileSize << "\r\n"
             << "Content-Type: " << (contentType.empty() ? getMimeType(filePath) : contentType) << "\r\n"
-            << "Connection: keep-alive\r\n\r\n";
+            << (statusCode == 200 ? "Accept-Ranges: bytes\r\n" + validatorHeaders(fileInfo) : "") << extraHeaders
+            << "Connection: " << connectionHeader(clientSocket) << "\r\n\r\n";
 
     queueWrite(clientSocket, headers.str());
 
     if (!onlyHeaders) {
         log.debug() << "Queueing actual file contents, since it's not a HEAD request" << std::endl;
-        char buffer[CONSTANTS_CHUNK_SIZE];
-        while (file.read(buffer, sizeof(buffer)))
-            queueWrite(clientSocket, string(buffer, static_cast<size_t>(file.gcount())));
-        if (file.gcount() > 0)
-            queueWrite(clientSocket, string(buffer, static_cast<size_t>(file.gcount())));
+        queueFile(clientSocket, fd, 0, static_cast<size_t>(fileSize));
     } else {
         log.debug() << "It was a HEAD request, not queuing any file contents" << std::endl;
+        ::close(fd);
     }
     log.debug() << "Adding socket " << repr(clientSocket) << " to pendingCloses" << std::endl;
-    _pendingCloses.insert(clientSocket);
+    conn(clientSocket).pendingClose = true;
+}
+
+// serves a 200 response for filePath from the response cache, reading the file into the cache first if it's small enough. False if the
+// file has to be sent the usual way. The gzip compressed variant and the uncompressed one with Vary are cached separately, so every file
+// is only compressed once (with the gzip_comp_level of whichever location asked first)
+bool HttpServer::sendCachedResponse(int clientSocket, const string &filePath, const LocationCtx &location, bool onlyHeaders) {
+    struct stat fileInfo;
+    if (_fileCache.stat(filePath, fileInfo) != 0 || !_responseCache.cacheable(fileInfo))
+        return false;
+    string contentType = getMimeType(filePath);
+    bool varies;
+    int level = gzipLevel(clientSocket, &location, contentType, static_cast<size_t>(fileInfo.st_size), varies);
+    string key = filePath;
+    if (varies) // NUL can't be part of a path
+        key += string(1, '\0') + (level > 0 ? "gzip" : "vary");
+    const ResponseCache::Response *cached = _responseCache.find(key, fileInfo);
+    if (cached != NULL) {
+        log.debug() << "Response for " << repr(filePath) << (level > 0 ? " (gzip)" : "") << " is cached" << std::endl;
+        queueCachedResponse(clientSocket, *cached, onlyHeaders);
+        return true;
+    }
+
+    int fd = _fileCache.open(filePath, fileInfo);
+    if (fd < 0)
+        return false;
+    size_t fileSize = static_cast<size_t>(fileInfo.st_size);
+    string body(fileSize, '\0');
+    size_t got = 0;
+    ssize_t bytesRead = 1;
+    while (got < fileSize && bytesRead > 0) {
+        bytesRead = ::pread(fd, &body[got], fileSize - got, static_cast<off_t>(got));
+        if (bytesRead > 0)
+            got += static_cast<size_t>(bytesRead);
+    }
+    ::close(fd);
+    if (got != fileSize) {
+        log.debug() << "Could not read " << repr(filePath) << " completely, not caching it" << std::endl;
+        return false;
+    }
+    if (level > 0) {
+        try {
+            body = GzipStream::compress(body, level);
+        } catch (const runtime_error &error) {
+            log.error() << "Failed to compress " << repr(filePath) << ": " << ansi::red(error.what()) << std::endl;
+            return false; // sent uncompressed the usual way
+        }
+    }
+    std::ostringstream headers;
+    headers << _httpVersionString << " 200 " << statusTextFromCode(200) << "\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Content-Type: " << contentType << "\r\n"
+            << (level > 0 ? "Content-Encoding: gzip\r\n" : "Accept-Ranges: bytes\r\n") << (varies ? "Vary: Accept-Encoding\r\n" : "")
+            << validatorHeaders(fileInfo, level > 0);
+    string data = headers.str();
+    size_t headersLength = data.size();
+    data += body;
+    ResponseCache::Response response(SharedBuffer(data), headersLength);
+    _responseCache.insert(key, fileInfo, response);
+    log.debug() << "Cached response for " << repr(filePath) << ", " << repr(_responseCache.size()) << " responses with "
+                << repr(_responseCache.bytes()) << " bytes cached" << std::endl;
+    queueCachedResponse(clientSocket, response, onlyHeaders);
     return true;
 }
 
+// the status line, headers and body are shared with the cache and everyone else sending them, only Connection differs per client
+void HttpServer::queueCachedResponse(int clientSocket, const ResponseCache::Response &response, bool onlyHeaders) {
+    Connection &c = conn(clientSocket);
+    if (c.pendingWrite.empty())
+        armTimer(clientSocket, TIMER_SEND);
+    if (!c.hasPendingWrite) {
+        c.hasPendingWrite = true;
+        c.pendingWrite.clear();
+    }
+    c.pendingWrite.appendShared(response.data, 0, response.headersLength);
+    c.pendingWrite.append(string("Connection: ") + connectionHeader(clientSocket) + "\r\n\r\n");
+    if (!onlyHeaders)
+        c.pendingWrite.appendShared(response.data, response.headersLength, response.data.size() - response.headersLength);
+    startMonitoringForWriteEvents(_monitorFds, clientSocket);
+    log.debug() << "Adding socket " << repr(clientSocket) << " to pendingCloses" << std::endl;
+    c.pendingClose = true;
+}
+
+// the gzip_comp_level to compress a response with, 0 if it's sent as it is: gzip has to be on for the location, the client has to accept
+// gzip, the Content-Type has to be in gzip_types (text/html always is) and the body at least gzip_min_length bytes long (npos for an
+// unknown length). varies is whether the response depends on Accept-Encoding, i.e. everything but the client's Accept-Encoding allows
+// compressing it, so both variants are sent with Vary
+int HttpServer::gzipLevel(int clientSocket, const LocationCtx *location, const string &contentType, size_t length, bool &varies) {
+    varies = false;
+    if (location == NULL || getFirstDirective(location->second, "gzip")[0] != "on")
+        return 0;
+    if (length != string::npos && length < Utils::convertSizeToBytes(getFirstDirective(location->second, "gzip_min_length")[0]))
+        return 0;
+    string type = Utils::strToLower(contentType.substr(0, contentType.find(';')));
+    type.erase(type.find_last_not_of(" \t") + 1);
+    const Arguments &types = getFirstDirective(location->second, "gzip_types");
+    if (type != "text/html" && std::find(types.begin(), types.end(), type) == types.end() &&
+        std::find(types.begin(), types.end(), "*") == types.end())
+        return 0;
+    varies = true;
+    if (!acceptsEncoding(conn(clientSocket).request.parser, "gzip"))
+        return 0;
+    return std::atoi(getFirstDirective(location->second, "gzip_comp_level")[0].c_str());
+}
+
+// the file's inode, mtime and size in hex like nginx (which leaves out the inode)
+string HttpServer::entityTag(const struct stat &fileInfo) {
+    std::ostringstream etag;
+    etag << std::hex << "\"" << fileInfo.st_ino << "-" << fileInfo.st_mtime << "-" << fileInfo.st_size << "\"";
+    return etag.str();
+}
+
+// a compressed response gets a weak ETag, it's not byte for byte the file
+string HttpServer::validatorHeaders(const struct stat &fileInfo, bool weak) {
+    return "ETag: " + string(weak ? "W/" : "") + entityTag(fileInfo) + "\r\nLast-Modified: " + Utils::httpDate(fileInfo.st_mtime) + "\r\n";
+}
+
+// answered from the stat() result alone, the file isn't opened
+void HttpServer::sendNotModified(int clientSocket, const struct stat &fileInfo, const string &extraHeaders) {
+    if (conn(clientSocket).pendingClose)
+        return;
+    log.debug() << "Sending 304 Not Modified to client " << repr(clientSocket) << std::endl;
+    queueWrite(clientSocket, _httpVersionString + " 304 " + statusTextFromCode(304) + "\r\n" + validatorHeaders(fileInfo) +
+                                 extraHeaders + "Connection: " + connectionHeader(clientSocket) + "\r\n\r\n");
+    conn(clientSocket).pendingClose = true;
+}
+
 string HttpServer::generateServerMessage(const string &text) {
     log.trace() << "Wrapping text in some html and body tags and setting title: " << repr(text) << std::endl;
     return "<html>\r\n<head><title>" + text + "</title></head>\r\n<body>\r\n<center><h1>" + text + "</h1></center>\r\n<hr><center>" +
@@ -216,17 +446,29 @@ bool HttpServer::sendErrorPage(int clientSocket, int statusCode, const LocationC
         return false;
     string errorPagePath = getFirstDirective(location.second, "root")[0] + errorPageLocation;
     log.debug() << "Full file system error page path is " << repr(errorPagePath) << ", trying to open that file" << std::endl;
-    std::ifstream file(errorPagePath.c_str());
-    if (!file) {
-        log.debug() << "Failed to open " << repr(errorPagePath) << std::endl;
+    struct stat fileInfo;
+    int fd = _fileCache.open(errorPagePath, fileInfo);
+    if (fd < 0) {
+        log.debug() << "Failed to open " << repr(errorPagePath) << ": " << ::strerror(errno) << std::endl;
         return false;
     }
     log.debug() << "Can open " << repr(errorPagePath) << ", so all good" << std::endl;
-    return sendFileContent(clientSocket, errorPagePath, location, statusCode);
+    queueFileResponse(clientSocket, fd, fileInfo, errorPagePath, statusCode);
+    return true;
 }
 
 // pass NULL as location if errorPages should not be served
+// after these the rest of the request (e.g. an unread body) can't be told apart from the next one, so keep-alive ends
+static bool breaksRequestFraming(int statusCode) {
+    return statusCode == 400 || statusCode == 408 || statusCode == 413 || statusCode == 414 || statusCode == 431 || statusCode == 501 ||
+           statusCode == 505;
+}
+
 void HttpServer::sendError(int clientSocket, int statusCode, const LocationCtx *const location) {
+    if (breaksRequestFraming(statusCode)) {
+        log.debug() << "Status code " << repr(statusCode) << " ends the persistent connection to client " << repr(clientSocket) << std::endl;
+        conn(clientSocket).persistent = false;
+    }
     if (location == NULL || !sendErrorPage(clientSocket, statusCode, *location)) {
         if (location == NULL)
             log.debug() << "Location was " << num("NULL") << std::endl;
@@ -234,12 +476,13 @@ void HttpServer::sendError(int clientSocket, int statusCode, const LocationCtx *
             log.debug() << "Couldn't send error page" << std::endl;
         log.debug() << "Sending hardcoded error with status code: " << repr(statusCode) << std::endl;
         string errorContent = generateServerMessage(STR(statusCode) + " " + statusTextFromCode(statusCode));
-        sendString(clientSocket, errorContent, statusCode);
+        sendString(clientSocket, errorContent, statusCode, "text/html", false, location);
     }
 }
 
-void HttpServer::sendString(int clientSocket, const string &payload, int statusCode, const string &contentType, bool onlyHeaders) {
-    if (_pendingCloses.count(clientSocket) > 0) {
+void HttpServer::sendString(int clientSocket, const string &payload, int statusCode, const string &contentType, bool onlyHeaders,
+                            const LocationCtx *location) {
+    if (conn(clientSocket).pendingClose) {
         log.debug() << "NOT sending string " << repr(payload) << " with status code " << repr(statusCode) << " since for client "
                     << repr(clientSocket) << " there's already a pendingClose scheduled" << std::endl;
         return;
@@ -247,20 +490,32 @@ void HttpServer::sendString(int clientSocket, const string &payload, int statusC
     log.debug() << "Preparing to send string response with status code: " << repr(statusCode) << std::endl;
     log.trace() << "The payload is " << repr(payload) << std::endl;
     std::ostringstream response;
+    bool varies;
+    int level = gzipLevel(clientSocket, location, contentType, payload.length(), varies);
+    string body = payload;
+    if (level > 0) {
+        try {
+            body = GzipStream::compress(payload, level);
+        } catch (const runtime_error &error) {
+            log.error() << "Failed to compress a response: " << ansi::red(error.what()) << ", sending it uncompressed" << std::endl;
+            level = 0;
+        }
+    }
 
     response << _httpVersionString << " " << statusCode << " " << statusTextFromCode(statusCode) << "\r\n"
              << "Content-Type: " << contentType << "\r\n"
-             << "Content-Length: " << payload.length() << "\r\n"
-             << "Connection: keep-alive\r\n"
+             << "Content-Length: " << body.length() << "\r\n"
+             << (level > 0 ? "Content-Encoding: gzip\r\n" : "") << (varies ? "Vary: Accept-Encoding\r\n" : "")
+             << "Connection: " << connectionHeader(clientSocket) << "\r\n"
              << "\r\n";
     if (!onlyHeaders) {
         log.debug() << "Queueing actual string payload, since it's not a HEAD request" << std::endl;
-        response << payload;
+        response << body;
     } else {
         log.debug() << "It was a HEAD request, not queuing any payload" << std::endl;
     }
 
     queueWrite(clientSocket, response.str());
     log.debug() << "Adding socket " << repr(clientSocket) << " to pendingCloses" << std::endl;
-    _pendingCloses.insert(clientSocket);
+    conn(clientSocket).pendingClose = true;
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <asm-generic/socket.h>
 #include <cerrno>
 #include <cstdlib>
@@ -5,8 +6,11 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <ostream>
+#include <signal.h>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <sys/poll.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -49,7 +53,7 @@ static in_port_t getServerPort(const ServerCtx &serverCtx) {
 
 static int createTcpListenSocket() {
     Logger::lastInstance().debug() << "Creating AF_INET SOCK_STREAM socket (TCP)" << std::endl;
-    int listeningSocket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC,
+    int listeningSocket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
                                    0); // NOTODO: @timo: close all fds from _monitorFds array
                                        // NOTODO: @timo: close all fds from _monitorFds and
                                        // associated CGI read/write fds whenever forking.
@@ -109,18 +113,111 @@ void HttpServer::setupListeningSocket(const Server &server) {
     bindSocket(listeningSocket, server);
     listenSocket(listeningSocket);
 
-    Logger::lastInstance().debug() << "Creating a pollfd with POLLIN events for socket " << repr(listeningSocket) << std::endl;
-    struct pollfd pfd;
-    pfd.fd = listeningSocket;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-    if (std::find(_monitorFds.pollFds.begin(), _monitorFds.pollFds.end(), pfd) != _monitorFds.pollFds.end())
-        log.error() << "ERROR4: pushing a pollfd " << repr(pfd.fd) << " that is already in the monitoring fds: " << repr(pfd) << std::endl;
-    _monitorFds.pollFds.push_back(pfd);
+    Logger::lastInstance().debug() << "Monitoring socket " << repr(listeningSocket) << " for POLLIN events" << std::endl;
+    resetConnection(listeningSocket, CONN_LISTENING);
+    addFdToMonitorFds(_monitorFds, listeningSocket, POLLIN);
 
     _listeningSockets.push_back(listeningSocket);
 }
 
+void HttpServer::setupMultPlexFds(MultPlexFds &monitorFds, const string &multPlexMethod) {
+    log.debug() << "Setting up I/O multiplexing method " << repr(multPlexMethod) << std::endl;
+    if (multPlexMethod == "poll") {
+        monitorFds.multPlexType = Constants::POLL;
+        return;
+    }
+    if (multPlexMethod == "io_uring") {
+        monitorFds.multPlexType = Constants::IO_URING;
+        log.debug() << "Calling " << func("io_uring_setup") << punct("()") << " with " << repr(Constants::ioUringEntries) << " entries"
+                    << std::endl;
+        monitorFds.uring.setup(Constants::ioUringEntries);
+        log.debug() << "Created io_uring instance " << repr(monitorFds.uring.fd()) << ", registering " << repr(Constants::ioUringBuffers)
+                    << " receive buffers" << std::endl;
+        monitorFds.uring.setupBufferRing(Constants::ioUringBuffers, CONSTANTS_CHUNK_SIZE + 1);
+        return;
+    }
+    monitorFds.multPlexType = Constants::EPOLL;
+    monitorFds.edgeTriggered = multPlexMethod == "epoll_et";
+    log.debug() << "Calling " << func("epoll_create1") << punct("()") << " with flag " << num("EPOLL_CLOEXEC") << std::endl;
+    monitorFds.epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (monitorFds.epollFd < 0)
+        throw runtime_error(string("Failed to create epoll instance: ") + ::strerror(errno));
+    monitorFds.epollFds.reserve(static_cast<size_t>(Constants::epollMaxEvents));
+    log.debug() << "Created epoll instance " << repr(monitorFds.epollFd) << " (edge-triggered: " << repr(monitorFds.edgeTriggered) << ")"
+                << std::endl;
+}
+
+// preallocate the ready-list and its scratch space, so waiting for events doesn't allocate once the server is running
+void HttpServer::setupReadyFds(const MultPlexFds &monitorFds) {
+    size_t capacity = 2 * static_cast<size_t>(Constants::epollMaxEvents); // edge-triggered epoll may report an FD twice
+    log.debug() << "Reserving space for " << repr(capacity) << " ready FDs" << std::endl;
+    _readyFds.multPlexType = monitorFds.multPlexType;
+    _readyFds.edgeTriggered = monitorFds.edgeTriggered;
+    _readyFds.pollFds.reserve(capacity);
+    _readyFds.epollFds.reserve(capacity);
+    _readyFds.uringCqes.reserve(capacity);
+    _readyFds.fdStates.reserve(capacity);
+    _fdsToRemove.reserve(capacity);
+}
+
+// SIGCHLD is blocked in initSignals, so it's only reported through this FD
+void HttpServer::setupSignalFd() {
+    sigset_t mask;
+    ::sigemptyset(&mask);
+    ::sigaddset(&mask, SIGCHLD);
+    log.debug() << "Calling " << func("signalfd") << punct("()") << " for " << num("SIGCHLD") << std::endl;
+    _signalFd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (_signalFd < 0)
+        throw runtime_error(string("Failed to create signalfd: ") + ::strerror(errno));
+    resetConnection(_signalFd, CONN_SIGNAL);
+    addFdToMonitorFds(_monitorFds, _signalFd, POLLIN);
+}
+
+// at least one chunk is always read/written per readiness event
+void HttpServer::setupIoBudget(const string &ioBudget) {
+    _ioBudget = std::max(Constants::chunkSize, Utils::convertSizeToBytes(ioBudget));
+    log.debug() << "Reading/writing at most " << repr(_ioBudget) << " bytes per readiness event" << std::endl;
+}
+
+// two timers per FD, so the timer wheel never allocates once the connection table is full
+void HttpServer::setupTimeouts(const Directives &httpDirectives) {
+    _keepAliveTimeout = Utils::convertTimeToSeconds(getFirstDirective(httpDirectives, "keepalive_timeout")[0]);
+    _clientHeaderTimeout = Utils::convertTimeToSeconds(getFirstDirective(httpDirectives, "client_header_timeout")[0]);
+    _clientBodyTimeout = Utils::convertTimeToSeconds(getFirstDirective(httpDirectives, "client_body_timeout")[0]);
+    _sendTimeout = Utils::convertTimeToSeconds(getFirstDirective(httpDirectives, "send_timeout")[0]);
+    _cgiTimeout = Utils::convertTimeToSeconds(getFirstDirective(httpDirectives, "cgi_timeout")[0]);
+    log.debug() << "Timeouts (in seconds): keepalive " << repr(_keepAliveTimeout) << ", client header " << repr(_clientHeaderTimeout)
+                << ", client body " << repr(_clientBodyTimeout) << ", send " << repr(_sendTimeout) << ", CGI " << repr(_cgiTimeout)
+                << std::endl;
+    _timers.reserve(2 * _conns.capacity());
+}
+
+// open_file_cache off | max=N [inactive=time]
+void HttpServer::setupFileCache(const Directives &httpDirectives) {
+    const Arguments &args = getFirstDirective(httpDirectives, "open_file_cache");
+    size_t maxEntries = 0;
+    std::time_t inactive = 60;
+    for (Arguments::const_iterator arg = args.begin(); arg != args.end(); ++arg) {
+        if (arg->compare(0, 4, "max=") == 0)
+            maxEntries = static_cast<size_t>(std::atol(arg->c_str() + 4));
+        else if (arg->compare(0, 9, "inactive=") == 0)
+            inactive = Utils::convertTimeToSeconds(arg->substr(9));
+    }
+    std::time_t valid = Utils::convertTimeToSeconds(getFirstDirective(httpDirectives, "open_file_cache_valid")[0]);
+    unsigned minUses = static_cast<unsigned>(std::atol(getFirstDirective(httpDirectives, "open_file_cache_min_uses")[0].c_str()));
+    bool cacheErrors = getFirstDirective(httpDirectives, "open_file_cache_errors")[0] == "on";
+    log.debug() << "Open file cache: max " << repr(maxEntries) << " entries, inactive after " << repr(inactive) << " seconds, valid for "
+                << repr(valid) << " seconds, min uses " << repr(minUses) << ", errors cached: " << repr(cacheErrors) << std::endl;
+    _fileCache.configure(maxEntries, static_cast<uint64_t>(inactive) * 1000, static_cast<uint64_t>(valid) * 1000, minUses, cacheErrors);
+}
+
+void HttpServer::setupResponseCache(const Directives &httpDirectives) {
+    size_t maxBytes = Utils::convertSizeToBytes(getFirstDirective(httpDirectives, "response_cache_size")[0]);
+    size_t maxFileSize = Utils::convertSizeToBytes(getFirstDirective(httpDirectives, "response_cache_max_file_size")[0]);
+    log.debug() << "Response cache: " << repr(maxBytes) << " bytes, for files of at most " << repr(maxFileSize) << " bytes" << std::endl;
+    _responseCache.configure(maxBytes, maxFileSize);
+}
+
 void HttpServer::setupServers(const Config &config) {
     log.debug() << "Setting up servers" << std::endl;
     size_t serverId = 0;
@@ -0,0 +1,36 @@
+#include "SharedBuffer.hpp"
+
+SharedBuffer::~SharedBuffer() { release(); }
+
+SharedBuffer::SharedBuffer() : _block(NULL) {}
+
+SharedBuffer::SharedBuffer(const string &data) : _block(new Block(data)) {}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &other) : _block(other._block) {
+    if (_block != NULL)
+        ++_block->refs;
+}
+
+SharedBuffer &SharedBuffer::operator=(const SharedBuffer &other) {
+    if (_block == other._block)
+        return *this;
+    release();
+    _block = other._block;
+    if (_block != NULL)
+        ++_block->refs;
+    return *this;
+}
+
+bool SharedBuffer::empty() const { return _block == NULL || _block->data.empty(); }
+
+size_t SharedBuffer::size() const { return _block == NULL ? 0 : _block->data.size(); }
+
+const char *SharedBuffer::data() const { return _block == NULL ? NULL : _block->data.data(); }
+
+size_t SharedBuffer::useCount() const { return _block == NULL ? 0 : _block->refs; }
+
+void SharedBuffer::release() {
+    if (_block != NULL && --_block->refs == 0)
+        delete _block;
+    _block = NULL;
+}
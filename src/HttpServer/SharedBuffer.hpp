@@ -0,0 +1,33 @@
+#pragma once /* SharedBuffer.hpp */
+
+#include <cstddef>
+#include <string>
+
+using std::string;
+
+// Immutable, reference counted bytes. Copies share the same buffer, which is freed together with the last copy, so e.g. a cached
+// response can be queued for any number of clients without copying it.
+class SharedBuffer {
+  public:
+    ~SharedBuffer();
+    SharedBuffer();
+    explicit SharedBuffer(const string &data);
+    SharedBuffer(const SharedBuffer &other);
+    SharedBuffer &operator=(const SharedBuffer &other);
+
+    bool empty() const;
+    size_t size() const;
+    const char *data() const;
+    size_t useCount() const; // 0 for an empty buffer
+
+  private:
+    struct Block {
+        string data;
+        size_t refs;
+
+        explicit Block(const string &_data) : data(_data), refs(1) {}
+    };
+    Block *_block;
+
+    void release();
+};
@@ -1,6 +1,9 @@
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
 #include <ostream>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <sys/poll.h>
 
 #include "Constants.hpp"
@@ -9,26 +12,120 @@
 #include "Utils.hpp"
 
 using Constants::EPOLL;
+using Constants::IO_URING;
 using Constants::POLL;
 using Constants::SELECT;
 
 void HttpServer::updatePollEvents(MultPlexFds &monitorFds, int clientSocket, short events, bool add) {
-    for (size_t i = 0; i < monitorFds.pollFds.size(); ++i) {
-        if (monitorFds.pollFds[i].fd == clientSocket) {
-            if (add) {
-                log.trace() << "Adding events " << repr(pollevents_helper(events)) << " to pollfd " << repr(monitorFds.pollFds[i])
-                            << std::endl;
-                monitorFds.pollFds[i].events |= events;
-            } else {
-                log.trace() << "Removing events " << repr(pollevents_helper(events)) << " from pollfd " << repr(monitorFds.pollFds[i])
-                            << std::endl;
-                monitorFds.pollFds[i].events &= ~events;
-            }
-            break;
-        }
+    size_t i = conn(clientSocket).pollIndex;
+    if (i >= monitorFds.pollFds.size() || monitorFds.pollFds[i].fd != clientSocket)
+        return;
+    if (add) {
+        log.trace() << "Adding events " << repr(pollevents_helper(events)) << " to pollfd " << repr(monitorFds.pollFds[i]) << std::endl;
+        monitorFds.pollFds[i].events |= events;
+    } else {
+        log.trace() << "Removing events " << repr(pollevents_helper(events)) << " from pollfd " << repr(monitorFds.pollFds[i]) << std::endl;
+        monitorFds.pollFds[i].events &= ~events;
     }
 }
 
+// POLLIN/POLLOUT/... have the same values as their EPOLL* counterparts on Linux
+uint32_t HttpServer::pollEventsToEpollEvents(short events, bool edgeTriggered) {
+    uint32_t epollEvents = static_cast<uint32_t>(static_cast<unsigned short>(events));
+    if (edgeTriggered)
+        epollEvents |= EPOLLET;
+    return epollEvents;
+}
+
+void HttpServer::updateEpollEvents(MultPlexFds &monitorFds, int fd, short events, bool add) {
+    if (fd < 0 || static_cast<size_t>(fd) >= monitorFds.epollRegs.size() || monitorFds.epollRegs[static_cast<size_t>(fd)] == 0)
+        return;
+    uint32_t oldEvents = monitorFds.epollRegs[static_cast<size_t>(fd)];
+    uint32_t change = pollEventsToEpollEvents(events, false);
+    struct epoll_event ev;
+    ev.events = add ? (oldEvents | change) : (oldEvents & ~change);
+    ev.data.u64 = 0;
+    ev.data.fd = fd;
+    // in edge-triggered mode, a MOD with an unchanged mask is still needed to re-arm the fd
+    if (ev.events == oldEvents && !(add && monitorFds.edgeTriggered))
+        return;
+    log.trace() << (add ? "Adding events " : "Removing events ") << repr(pollevents_helper(events)) << (add ? " to " : " from ")
+                << repr(ev) << std::endl;
+    if (::epoll_ctl(monitorFds.epollFd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        log.error() << "Error calling " << func("epoll_ctl") << punct("()") << " with " << num("EPOLL_CTL_MOD") << " on FD " << repr(fd)
+                    << ": " << ::strerror(errno) << std::endl;
+        return;
+    }
+    monitorFds.epollRegs[static_cast<size_t>(fd)] = ev.events;
+}
+
+// The generation in the upper half tells completions for a closed FD apart from those for a new FD with the same number, the FD
+// (always below Constants::maxFds) leaves room for the kind of request in the top bits of the lower half
+uint64_t HttpServer::ioUringUserData(int fd, uint32_t gen, UringOp op) {
+    return (static_cast<uint64_t>(gen) << 32) | (static_cast<uint64_t>(op) << 28) | static_cast<uint32_t>(fd);
+}
+
+bool HttpServer::ioUringCompletionIsCurrent(const MultPlexFds &monitorFds, const struct io_uring_cqe &cqe) {
+    size_t fd = static_cast<size_t>(cqe.user_data & 0x0fffffff);
+    return fd < monitorFds.uringRegs.size() && monitorFds.uringRegs[fd].events != 0 &&
+           monitorFds.uringRegs[fd].gen == static_cast<uint32_t>(cqe.user_data >> 32);
+}
+
+// readability of listening and client sockets isn't polled for, their multishot accept/recv requests take care of it
+uint32_t HttpServer::ioUringPollEvents(const UringReg &reg) {
+    return reg.input == URING_POLL ? reg.events : reg.events & ~static_cast<uint32_t>(POLLIN);
+}
+
+// poll requests are one-shot, so they're armed again after every completion, which gives level-triggered semantics like poll()
+void HttpServer::armIoUringPoll(MultPlexFds &monitorFds, int fd) {
+    UringReg &reg = monitorFds.uringRegs[static_cast<size_t>(fd)];
+    uint32_t events = ioUringPollEvents(reg);
+    if (events == 0)
+        return;
+    monitorFds.uring.prepPollAdd(fd, events, ioUringUserData(fd, reg.gen, URING_POLL));
+    reg.armed = true;
+}
+
+// multishot requests stay armed until they fail, or the kernel runs out of buffers or CQ ring space
+void HttpServer::armIoUringInput(MultPlexFds &monitorFds, int fd) {
+    UringReg &reg = monitorFds.uringRegs[static_cast<size_t>(fd)];
+    if (reg.input == URING_ACCEPT)
+        monitorFds.uring.prepMultishotAccept(fd, ioUringUserData(fd, reg.gen, URING_ACCEPT));
+    else if (reg.input == URING_RECV)
+        monitorFds.uring.prepMultishotRecv(fd, ioUringUserData(fd, reg.gen, URING_RECV));
+    else
+        return;
+    reg.multishot = true;
+}
+
+void HttpServer::updateIoUringEvents(MultPlexFds &monitorFds, int fd, short events, bool add) {
+    if (fd < 0 || static_cast<size_t>(fd) >= monitorFds.uringRegs.size() || monitorFds.uringRegs[static_cast<size_t>(fd)].events == 0)
+        return;
+    UringReg &reg = monitorFds.uringRegs[static_cast<size_t>(fd)];
+    uint32_t change = static_cast<uint32_t>(static_cast<unsigned short>(events));
+    uint32_t newEvents = add ? (reg.events | change) : (reg.events & ~change);
+    if (newEvents == reg.events)
+        return;
+    log.trace() << (add ? "Adding events " : "Removing events ") << repr(pollevents_helper(events)) << (add ? " to " : " from ")
+                << "io_uring registration " << repr(reg) << " of FD " << repr(fd) << std::endl;
+    reg.events = newEvents;
+    if (!reg.armed) // the next arm picks up the new events
+        armIoUringPoll(monitorFds, fd);
+    else if (ioUringPollEvents(reg) != 0)
+        monitorFds.uring.prepPollUpdate(ioUringUserData(fd, reg.gen, URING_POLL), ioUringPollEvents(reg));
+    // otherwise the poll request is left to complete, its events are of no interest anymore by then
+}
+
+// edge-triggered epoll only reports transitions, so readiness that was left
+// unconsumed (e.g. CGI output while its stdin was still being written) has
+// to be reported again explicitly
+void HttpServer::rearmEdgeTriggeredFd(MultPlexFds &monitorFds, int fd) {
+    if (monitorFds.multPlexType != EPOLL || !monitorFds.edgeTriggered)
+        return;
+    log.debug() << "Re-arming edge-triggered FD " << repr(fd) << std::endl;
+    updateEpollEvents(monitorFds, fd, 0, true);
+}
+
 void HttpServer::startMonitoringForWriteEvents(MultPlexFds &monitorFds, int clientSocket) {
     log.debug() << "Starting monitoring for FD " << repr(clientSocket) << std::endl;
     switch (monitorFds.multPlexType) {
@@ -40,8 +137,10 @@ void HttpServer::startMonitoringForWriteEvents(MultPlexFds &monitorFds, int clie
         updatePollEvents(monitorFds, clientSocket, POLLOUT, true);
         break;
     case EPOLL:
-        throw std::logic_error("Starting monitoring for write events for epoll type FDs "
-                               "not implemented yet");
+        updateEpollEvents(monitorFds, clientSocket, POLLOUT, true);
+        break;
+    case IO_URING:
+        updateIoUringEvents(monitorFds, clientSocket, POLLOUT, true);
         break;
     default:
         throw std::logic_error("Starting monitoring for write events for unknown type "
@@ -60,8 +159,10 @@ void HttpServer::stopMonitoringForWriteEvents(MultPlexFds &monitorFds, int clien
         updatePollEvents(monitorFds, clientSocket, POLLOUT, false);
         break;
     case EPOLL:
-        throw std::logic_error("Stopping monitoring for write events for epoll type FDs "
-                               "not implemented yet");
+        updateEpollEvents(monitorFds, clientSocket, POLLOUT, false);
+        break;
+    case IO_URING:
+        updateIoUringEvents(monitorFds, clientSocket, POLLOUT, false);
         break;
     default:
         throw std::logic_error("Stopping monitoring for write events for unknown type "
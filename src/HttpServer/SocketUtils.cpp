@@ -1,4 +1,3 @@
-#include <algorithm>
 #include <cstddef>
 #include <ostream>
 #include <stdexcept>
@@ -9,30 +8,53 @@
 #include "Repr.hpp"
 
 using Constants::EPOLL;
+using Constants::IO_URING;
 using Constants::POLL;
 using Constants::SELECT;
 
 bool HttpServer::isListeningSocket(int fd) {
-    bool isListening = std::find(_listeningSockets.begin(), _listeningSockets.end(), fd) != _listeningSockets.end();
-    log.trace() << "All listening sockets: " << repr(_listeningSockets) << std::endl;
-    log.trace() << "Checking if " << repr(fd) << " is a listening socket: " << repr(isListening)
-                << std::endl; // NOTODO: @timo: overload << s.t. you don't have to do
-                              // repr(intVar) all the time
+    bool isListening = conn(fd).kind == CONN_LISTENING;
+    if (log.istrace())
+        log.trace() << "Checking if " << repr(fd) << " is a listening socket: " << repr(isListening)
+                    << std::endl; // NOTODO: @timo: overload << s.t. you don't have to do
+                                  // repr(intVar) all the time
     return isListening;
 }
 
+bool HttpServer::isMonitoredFd(const MultPlexFds &monitorFds, int fd) {
+    switch (monitorFds.multPlexType) {
+    case SELECT:
+        throw std::logic_error("Checking select type FDs not implemented yet");
+    case POLL: {
+        size_t pollIndex = conn(fd).pollIndex;
+        return pollIndex < monitorFds.pollFds.size() && monitorFds.pollFds[pollIndex].fd == fd;
+    }
+    case EPOLL:
+        return fd >= 0 && static_cast<size_t>(fd) < monitorFds.epollRegs.size() && monitorFds.epollRegs[static_cast<size_t>(fd)] != 0;
+    case IO_URING:
+        return fd >= 0 && static_cast<size_t>(fd) < monitorFds.uringRegs.size() &&
+               monitorFds.uringRegs[static_cast<size_t>(fd)].events != 0;
+    default:
+        throw std::logic_error("Checking unknown type of fd not implemented");
+    }
+}
+
 vector<int> HttpServer::multPlexFdsToRawFds(const MultPlexFds &readyFds) {
     vector<int> rawFds;
     switch (readyFds.multPlexType) {
     case SELECT:
         throw std::logic_error("Converting select fd type to raw fd not implemented");
     case POLL:
+    case IO_URING:
         log.trace() << "Converting pollfds " << repr(readyFds.pollFds) << " to plain FDs" << std::endl;
         for (size_t i = 0; i < readyFds.pollFds.size(); ++i)
             rawFds.push_back(readyFds.pollFds[i].fd);
         return rawFds;
     case EPOLL:
-        throw std::logic_error("Converting epoll fd type to raw fd not implemented");
+        log.trace() << "Converting epoll_events " << repr(readyFds.epollFds) << " to plain FDs" << std::endl;
+        for (size_t i = 0; i < readyFds.epollFds.size(); ++i)
+            rawFds.push_back(readyFds.epollFds[i].data.fd);
+        return rawFds;
     default:
         throw std::logic_error("Converting unknown fd type to raw fd not implemented");
     }
@@ -43,10 +65,16 @@ int HttpServer::multPlexFdToRawFd(const MultPlexFds &readyFds, size_t i) {
     case SELECT:
         throw std::logic_error("Converting select fd type to raw fd not implemented");
     case POLL:
-        log.trace() << "Converting pollfd " << repr(readyFds.pollFds[i]) << " to plain FD " << repr(readyFds.pollFds[i].fd) << std::endl;
+    case IO_URING:
+        if (log.istrace())
+            log.trace() << "Converting pollfd " << repr(readyFds.pollFds[i]) << " to plain FD " << repr(readyFds.pollFds[i].fd)
+                        << std::endl;
         return readyFds.pollFds[i].fd;
     case EPOLL:
-        throw std::logic_error("Converting epoll fd type to raw fd not implemented");
+        if (log.istrace())
+            log.trace() << "Converting epoll_event " << repr(readyFds.epollFds[i]) << " to plain FD "
+                        << repr(readyFds.epollFds[i].data.fd) << std::endl;
+        return readyFds.epollFds[i].data.fd;
     default:
         throw std::logic_error("Converting unknown fd type to raw fd not implemented");
     }
@@ -1,8 +1,8 @@
+#include <climits>
 #include <ctime>
 #include <ostream>
 #include <signal.h>
 #include <stdlib.h>
-#include <sys/wait.h>
 
 #include "Constants.hpp"
 #include "HttpServer.hpp"
@@ -10,100 +10,129 @@
 #include "Repr.hpp"
 #include "Utils.hpp"
 
-static bool isTimedOut(const HttpServer::CgiProcess &process) {
-    std::time_t lastActive = process.lastActive;
-    std::time_t now = std::time(NULL);
-    Logger::lastInstance().debug() << "Checking wether CGI process " << repr(process) << " is timed out" << std::endl;
-    Logger::lastInstance().debug() << "Now: " << repr(Utils::formattedTimestamp(now)) << " (" << repr(now) << ")" << std::endl;
-    Logger::lastInstance().debug() << "Last active: " << repr(Utils::formattedTimestamp(lastActive)) << " (" << repr(lastActive) << ")"
-                                   << std::endl;
-    Logger::lastInstance().debug() << "Difference: " << repr(now - lastActive) << std::endl;
-    Logger::lastInstance().debug() << "Timeout: " << repr(Constants::cgiTimeout) << std::endl;
-    if (now - lastActive >= Constants::cgiTimeout) {
-        Logger::lastInstance().debug() << "CGI process IS timed out (difference is bigger)" << std::endl;
-        return true;
+// every FD owns two timers, the one for whatever its client is currently given time for and the one of its CGI process
+static size_t timerId(int fd, bool cgi) { return 2 * static_cast<size_t>(fd) + (cgi ? 1 : 0); }
+
+static const char *timerName(HttpServer::ConnectionTimer timer) {
+    switch (timer) {
+    case HttpServer::TIMER_HEADER:
+        return "client_header_timeout";
+    case HttpServer::TIMER_BODY:
+        return "client_body_timeout";
+    case HttpServer::TIMER_SEND:
+        return "send_timeout";
+    case HttpServer::TIMER_KEEPALIVE:
+        return "keepalive_timeout";
+    default:
+        return "no timeout";
+    }
+}
+
+// Replaces the connection timer of a remote client. The header timer covers the whole request line and headers, so it is not
+// restarted while they trickle in, body and send timers cover the time between two successful reads/writes.
+void HttpServer::armTimer(int clientSocket, ConnectionTimer timer) {
+    Connection &c = conn(clientSocket);
+    if (c.kind != CONN_CLIENT)
+        return;
+    std::time_t timeout = 0;
+    switch (timer) {
+    case TIMER_NONE:
+        c.timer = TIMER_NONE;
+        _timers.cancel(timerId(clientSocket, false));
+        return;
+    case TIMER_HEADER:
+        timeout = _clientHeaderTimeout;
+        break;
+    case TIMER_BODY:
+        timeout = _clientBodyTimeout;
+        break;
+    case TIMER_SEND:
+        timeout = _sendTimeout;
+        break;
+    case TIMER_KEEPALIVE:
+        timeout = c.keepAliveTimeout;
+        break;
     }
-    Logger::lastInstance().debug() << "CGI process is NOT timed out (difference is smaller)" << std::endl;
-    return false;
+    if (log.istrace())
+        log.trace() << "Arming " << timerName(timer) << " of " << repr(timeout) << " seconds for client " << repr(clientSocket) << std::endl;
+    c.timer = timer;
+    _timers.schedule(timerId(clientSocket, false), TimerWheel::now() + static_cast<uint64_t>(timeout) * 1000);
 }
 
-void HttpServer::checkForInactiveClients() {
-    vector<int> deleteFromClientToCgi;
-    vector<int> deleteFromCgiToClient;
+// (re)started whenever the CGI process produces output
+void HttpServer::armCgiTimer(int clientSocket) {
+    _timers.schedule(timerId(clientSocket, true), TimerWheel::now() + static_cast<uint64_t>(_cgiTimeout) * 1000);
+}
 
-    log.debug() << "Checking for inactive CGI clients" << std::endl;
-    for (ClientFdToCgiMap::iterator it = _clientToCgi.begin(); it != _clientToCgi.end(); ++it) {
-        int clientSocket = it->first;
-        CgiProcess &process = it->second;
+void HttpServer::cancelCgiTimer(int clientSocket) { _timers.cancel(timerId(clientSocket, true)); }
 
-        if (process.done) {
-            log.trace() << "Process is marked as done, not checking it: " << repr(process) << std::endl;
-            continue;
-        }
+void HttpServer::cancelTimers(int fd) {
+    _timers.cancel(timerId(fd, false));
+    cancelCgiTimer(fd);
+}
 
-        if (isTimedOut(process)) {
-            log.warning() << "Timed out CGI process (sending SIGKILL): " << repr(process) << std::endl;
-            (void)::kill(process.pid, SIGKILL);
-            (void)::waitpid(process.pid, NULL, WNOHANG);
-            _pendingCloses.erase(process.clientSocket); // overwrite behaviour
-            sendError(process.clientSocket, 504, process.location);
+// the mainloop blocks until the nearest timer is due, or forever without any timers
+int HttpServer::waitTimeout() {
+    long timeoutMs = _timers.timeUntilNext(TimerWheel::now());
+    return timeoutMs > INT_MAX ? INT_MAX : static_cast<int>(timeoutMs);
+}
 
-            log.debug() << "Removing client " << repr(clientSocket) << " from clientToCgi map (CGI has no more data to send)" << std::endl;
-            deleteFromClientToCgi.push_back(clientSocket);
-            log.debug() << "Removing CGI read FD " << repr(process.readFd) << " (stdout) from cgiToClientMap" << std::endl;
-            deleteFromCgiToClient.push_back(process.readFd);
-            log.debug() << "Inserting CGI read FD " << repr(process.readFd) << " to _tmpCgiFds" << std::endl;
-            _tmpCgiFds.insert(process.readFd);
-            log.debug() << "Removing remote client " << repr(clientSocket) << " from persistent connections" << std::endl;
-            persistConns.erase(clientSocket);
-            // closeAndRemoveMultPlexFd(_monitorFds, clientSocket);
-            // _pendingWrites.erase(clientSocket);
-        } else {
-            log.debug() << "CGI process " << repr(process) << " is not timed out" << std::endl;
-            if (process.dead) {
-                if (process.noRecentReadEvent) {
-                    log.debug() << "Process is dead and doesn't have read events: " << repr(process) << std::endl;
-                    if (process.response.empty() && !process.headersSent) {
-                        log.trace() << "Process died, response is empty and headers have not yet been sent, sending 502 Bad Gateway"
-                                    << std::endl;
-                        sendError(clientSocket, 502, process.location);
-                    } else if (process.response.empty() && process.headersSent) {
-                        log.trace()
-                            << "Process died, response is empty, BUT headers have been sent/enqueued, not sending anything extra/any errors"
-                            << std::endl;
-                    } else if (!process.response.empty()) { // not perfect, we should check if it's a valid response, i.e. headers present,
-                                                            // \r\n\r\n, etc., but it'll do
-                        log.trace()
-                            << "Process died but there's still response data to enqueue, sending that data raw (no header validation)"
-                            << std::endl;
-                        queueWrite(clientSocket, _httpVersionString + " 200 " + statusTextFromCode(200) + "\r\n" + process.response);
-                        log.trace() << "Marking process as done: " << repr(process) << std::endl;
-                        process.done = true;
-                    }
-                    log.debug() << "Removing remote client " << repr(clientSocket) << " from persistent connections" << std::endl;
-                    persistConns.erase(clientSocket);
-                    closeAndRemoveMultPlexFd(_monitorFds, process.readFd);
-                    log.debug() << "Removing its read FD " << repr(process.readFd) << " (stdout) from cgiToClient map" << std::endl;
-                    deleteFromCgiToClient.push_back(process.readFd);
-                    deleteFromClientToCgi.push_back(clientSocket);
-                    // _pendingWrites.erase(clientSocket);
-                } else {
-                    log.debug() << "Process is dead, but still had a recent read event" << std::endl;
-                }
-            } else {
-                log.debug() << "Proces is not dead" << std::endl;
-            }
-        }
+void HttpServer::expireTimers() {
+    _expiredTimers.clear();
+    _timers.advance(TimerWheel::now(), _expiredTimers);
+    for (size_t i = 0; i < _expiredTimers.size(); ++i) {
+        int fd = static_cast<int>(_expiredTimers[i] / 2);
+        if (_expiredTimers[i] % 2 == 1)
+            handleCgiTimeout(fd);
+        else
+            handleConnectionTimeout(fd);
+    }
+}
 
-        if (::waitpid(process.pid, NULL, WNOHANG) > 0) {
-            log.debug() << "Reaped CGI process " << repr(process) << std::endl;
-            log.debug() << "Updating its dead state to " << repr(true) << std::endl;
-            process.dead = true;
-        }
-        process.noRecentReadEvent = true; // should be reset to false if there was a read event
+// A client that is in the middle of a request gets a 408, everything else is closed right away.
+void HttpServer::handleConnectionTimeout(int clientSocket) {
+    Connection &c = conn(clientSocket);
+    ConnectionTimer timer = c.timer;
+    c.timer = TIMER_NONE;
+    if (c.kind != CONN_CLIENT || !isMonitoredFd(_monitorFds, clientSocket))
+        return;
+    if ((timer == TIMER_HEADER || timer == TIMER_BODY) && c.hasRequest && !c.hasPendingWrite && !c.hasCgi) {
+        log.info() << "Client " << repr(clientSocket) << " exceeded " << timerName(timer) << ", sending 408 Request Timeout" << std::endl;
+        c.hasRequest = false;
+        c.pipelined.clear();
+        sendError(clientSocket, 408, NULL); // closes the connection once sent
+        return;
     }
-    for (size_t i = 0; i < deleteFromClientToCgi.size(); ++i) {
-        _clientToCgi.erase(deleteFromClientToCgi[i]);
-        _cgiToClient.erase(deleteFromCgiToClient[i]);
+    log.info() << "Closing connection to client " << repr(clientSocket) << " after " << timerName(timer) << std::endl;
+    c.persistent = false;
+    removeClientAndRequest(clientSocket);
+    detachCgi(clientSocket);
+}
+
+// The client gets a 504, unless the CGI response has been started already. Then a second response would end up in the middle of the
+// body, so the connection is closed instead.
+void HttpServer::handleCgiTimeout(int clientSocket) {
+    CgiProcess *cgi = cgiOf(clientSocket);
+    if (cgi == NULL || cgi->done)
+        return;
+    CgiProcess &process = *cgi;
+    log.warning() << "Timed out CGI process (sending SIGKILL): " << repr(process) << std::endl;
+    (void)::kill(process.pid, SIGKILL); // reaped through the signalfd like every other child
+
+    // the rest of the request body and whatever the process still writes are of no use anymore
+    closeCgiPipe(clientSocket, process.writeFd);
+    closeCgiPipe(clientSocket, process.readFd);
+    process.readFd = -1;
+    Connection &c = conn(clientSocket);
+    c.persistent = false;
+    if (!process.headersSent) {
+        c.pendingClose = false; // overwrite behaviour
+        sendError(clientSocket, 504, process.location);
+        log.debug() << "Removing client " << repr(clientSocket) << " from the CGI registry" << std::endl;
+        detachCgi(clientSocket);
+        return;
     }
+    log.info() << "CGI response to client " << repr(clientSocket) << " has already been started, closing the connection" << std::endl;
+    removeClientAndRequest(clientSocket);
+    detachCgi(clientSocket);
 }
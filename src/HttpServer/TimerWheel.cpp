@@ -0,0 +1,155 @@
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include "TimerWheel.hpp"
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+const uint64_t TimerWheel::tickMs = 100;
+
+TimerWheel::~TimerWheel() {}
+
+TimerWheel::TimerWheel() : _nodes(HEADS), _currentTick(now() / tickMs), _size(0) {
+    for (size_t i = 0; i < HEADS; ++i) {
+        _nodes[i].prev = i;
+        _nodes[i].next = i;
+        _nodes[i].expiresAt = 0;
+        _nodes[i].linked = false;
+    }
+}
+
+TimerWheel::TimerWheel(const TimerWheel &other) : _nodes(other._nodes), _currentTick(other._currentTick), _size(other._size) {}
+
+TimerWheel &TimerWheel::operator=(const TimerWheel &other) {
+    if (this == &other)
+        return *this;
+    _nodes = other._nodes;
+    _currentTick = other._currentTick;
+    _size = other._size;
+    return *this;
+}
+
+uint64_t TimerWheel::now() {
+    struct timespec ts;
+    if (::clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        throw runtime_error(string("clock_gettime failed: ") + ::strerror(errno));
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+void TimerWheel::reserve(size_t ids) { _nodes.reserve(HEADS + ids); }
+
+void TimerWheel::schedule(size_t id, uint64_t expiresAt) {
+    size_t node = HEADS + id;
+    if (node >= _nodes.size()) {
+        Node unused = {node, node, 0, false};
+        _nodes.resize(node + 1, unused);
+    }
+    if (_nodes[node].linked)
+        unlink(node);
+    _nodes[node].expiresAt = (expiresAt + tickMs - 1) / tickMs; // never fire early
+    link(node, _currentTick + 1);
+}
+
+void TimerWheel::cancel(size_t id) {
+    size_t node = HEADS + id;
+    if (node < _nodes.size() && _nodes[node].linked)
+        unlink(node);
+}
+
+bool TimerWheel::scheduled(size_t id) const { return HEADS + id < _nodes.size() && _nodes[HEADS + id].linked; }
+
+size_t TimerWheel::size() const { return _size; }
+
+// A timer goes into the lowest level whose range still covers it. Timers beyond the last level wait in its farthest slot and are
+// placed again when that slot is cascaded. Overdue timers go into the slot of notBefore.
+void TimerWheel::link(size_t node, uint64_t notBefore) {
+    uint64_t expiresAt = _nodes[node].expiresAt;
+    if (expiresAt < notBefore)
+        expiresAt = notBefore;
+    uint64_t delta = expiresAt - _currentTick;
+    unsigned level = 0;
+    while (level < LEVELS - 1 && delta >= static_cast<uint64_t>(1) << (SLOT_BITS * (level + 1)))
+        ++level;
+    if (delta >= static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS))
+        expiresAt = _currentTick + (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)) - 1;
+    size_t head = level * SLOTS + static_cast<size_t>((expiresAt >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+    Node &n = _nodes[node];
+    n.prev = head;
+    n.next = _nodes[head].next;
+    _nodes[n.next].prev = node;
+    _nodes[head].next = node;
+    n.linked = true;
+    ++_size;
+}
+
+void TimerWheel::unlink(size_t node) {
+    Node &n = _nodes[node];
+    _nodes[n.prev].next = n.next;
+    _nodes[n.next].prev = n.prev;
+    n.prev = node;
+    n.next = node;
+    n.linked = false;
+    --_size;
+}
+
+// moves the timers of the current slot of a level down to the lower levels, those due right now into the slot about to expire
+void TimerWheel::cascade(unsigned level) {
+    size_t head = level * SLOTS + static_cast<size_t>((_currentTick >> (SLOT_BITS * level)) & (SLOTS - 1));
+    while (_nodes[head].next != head) {
+        size_t node = _nodes[head].next;
+        unlink(node);
+        link(node, _currentTick);
+    }
+}
+
+void TimerWheel::advance(uint64_t until, vector<size_t> &expired) {
+    uint64_t target = until / tickMs;
+    if (_size == 0 && target > _currentTick) // nothing to cascade or expire on the way
+        _currentTick = target;
+    while (_currentTick < target) {
+        ++_currentTick;
+        unsigned levels = 1; // lower levels wrap around first, so the highest level to cascade is cascaded first
+        while (levels < LEVELS && (_currentTick & ((static_cast<uint64_t>(1) << (SLOT_BITS * levels)) - 1)) == 0)
+            ++levels;
+        for (unsigned level = levels - 1; level > 0; --level)
+            cascade(level);
+
+        size_t head = static_cast<size_t>(_currentTick & (SLOTS - 1));
+        while (_nodes[head].next != head) {
+            size_t node = _nodes[head].next;
+            unlink(node);
+            if (_nodes[node].expiresAt <= _currentTick)
+                expired.push_back(node - HEADS);
+            else
+                link(node, _currentTick + 1); // parked in the last level, not due yet
+        }
+    }
+}
+
+// The first occupied slot of every level bounds the next tick at which a timer expires or moves down a level. Waking up for a
+// cascade is early, but then the next call knows better.
+long TimerWheel::timeUntilNext(uint64_t at) const {
+    if (_size == 0)
+        return -1;
+    uint64_t nextTick = 0;
+    for (unsigned level = 0; level < LEVELS; ++level) {
+        uint64_t slotTick = _currentTick >> (SLOT_BITS * level);
+        for (uint64_t i = 1; i <= SLOTS; ++i) {
+            size_t head = level * SLOTS + static_cast<size_t>((slotTick + i) & (SLOTS - 1));
+            if (_nodes[head].next == head)
+                continue;
+            uint64_t tick = (slotTick + i) << (SLOT_BITS * level);
+            if (nextTick == 0 || tick < nextTick)
+                nextTick = tick;
+            break;
+        }
+    }
+    uint64_t deadline = nextTick * tickMs;
+    return deadline > at ? static_cast<long>(deadline - at) : 0;
+}
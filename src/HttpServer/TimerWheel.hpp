@@ -0,0 +1,45 @@
+#pragma once /* TimerWheel.hpp */
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+// Hierarchical timing wheel with 4 levels of 64 slots, timers are identified by small integers chosen by the caller.
+// Every slot is an intrusive doubly linked list threaded through _nodes, so scheduling and cancelling are O(1) and never allocate
+// once reserve() covered all ids. Advancing costs O(1) per tick plus the timers that expire or move down a level.
+class TimerWheel {
+  public:
+    ~TimerWheel();
+    TimerWheel();
+    TimerWheel(const TimerWheel &other);
+    TimerWheel &operator=(const TimerWheel &other);
+
+    static uint64_t now(); // CLOCK_MONOTONIC in milliseconds
+
+    void reserve(size_t ids);
+    void schedule(size_t id, uint64_t expiresAt); // (re)arms a timer, expiresAt is in milliseconds (see now())
+    void cancel(size_t id);
+    bool scheduled(size_t id) const;
+    size_t size() const;
+    void advance(uint64_t until, std::vector<size_t> &expired); // appends the ids of all timers that expired up to until
+    long timeUntilNext(uint64_t at) const;                      // milliseconds until advance() has something to do, -1 without timers
+
+    static const uint64_t tickMs;
+
+  private:
+    enum { LEVELS = 4, SLOT_BITS = 6, SLOTS = 1 << SLOT_BITS, HEADS = LEVELS * SLOTS };
+    struct Node {
+        size_t prev;
+        size_t next;
+        uint64_t expiresAt; // in ticks
+        bool linked;
+    };
+
+    std::vector<Node> _nodes; // the first HEADS nodes are the list heads of the slots, timer id i lives in node HEADS + i
+    uint64_t _currentTick;    // every timer expiring at or before this tick has been reported
+    size_t _size;
+
+    void link(size_t node, uint64_t notBefore);
+    void unlink(size_t node);
+    void cascade(unsigned level);
+};
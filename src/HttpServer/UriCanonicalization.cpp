@@ -3,36 +3,43 @@
 #include <sstream>
 #include <string>
 
+#include "ByteScan.hpp"
 #include "HttpServer.hpp"
 #include "Repr.hpp"
 #include "Utils.hpp"
 
 string HttpServer::percentDecode(const string &str) {
     log.trace() << "Percent decoding string: " << repr(str) << std::endl;
-    std::ostringstream oss;
+    string decoded;
+    decoded.reserve(str.length());
     for (size_t i = 0; i < str.length(); ++i) {
+        size_t run = ByteScan::findUriSpecial(str.data() + i, str.length() - i); // bytes that are copied as they are
+        decoded.append(str, i, run);
+        i += run;
+        if (i == str.length())
+            break;
         if (str[i] != '%') {
-            oss << str[i];
+            decoded += str[i];
             continue;
         }
         if (i + 2 >= str.length()) {
-            oss << str[i];
+            decoded += str[i];
             continue;
         }
         if (!Utils::isHexDigitNoCase(str[i + 1]) || !Utils::isHexDigitNoCase(str[i + 2])) {
-            oss << str[i];
+            decoded += str[i];
             continue;
         }
         if (str[i + 1] == '0' && str[i + 2] == '0') {
-            oss << str[i];
+            decoded += str[i];
             continue;
         }
         log.trace2() << "Found a valid percent token for decoding: " << num(string("%") + str[i + 1] + str[i + 2]) << std::endl;
-        oss << Utils::decodeTwoHexChars(str[i + 1], str[i + 2]);
+        decoded += Utils::decodeTwoHexChars(str[i + 1], str[i + 2]);
         i += 2;
     }
-    log.trace() << "Percent decoded string is: " << repr(oss.str()) << std::endl;
-    return oss.str();
+    log.trace() << "Percent decoded string is: " << repr(decoded) << std::endl;
+    return decoded;
 }
 
 string HttpServer::resolveDots(const string &str) {
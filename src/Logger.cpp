@@ -141,7 +141,7 @@ static string formattedPid() { return "[" + cmt(" ") + repr(getpid()) + cmt(" ")
 #endif
 
 Logger::StreamWrapper &Logger::StreamWrapper::operator()(bool printPrefix) {
-    if (printPrefix)
+    if (printPrefix && thisLevel <= logLevel) // the timestamp is expensive, don't format it for suppressed levels
         return *this << prefix << Utils::formattedTimestamp(0, true) << formattedPid();
     else
         return *this;
@@ -34,8 +34,16 @@ static Logger::Level convertStringToLogLevel(const char *str) {
                                  "`-l' option. Run with -h for more information.");
 }
 
+static std::string convertStringToMultPlexMethod(const char *str) {
+    std::string s(str);
+    if (s == "poll" || s == "epoll" || s == "epoll_et" || s == "io_uring")
+        return s;
+    throw std::runtime_error("Option parsing error: Invalid method argument to "
+                             "`-m' option. Run with -h for more information.");
+}
+
 Options::Options(int ac, char **av)
-    : printHelp(), printVersion(), onlyCheckConfig(), configPath(Constants::defaultConfPath), logLevel(Logger::INFO) {
+    : printHelp(), printVersion(), onlyCheckConfig(), configPath(Constants::defaultConfPath), multPlexMethod(), logLevel(Logger::INFO) {
     (void)ac;
     bool configPathSpecified = false;
     ++av;
@@ -58,6 +66,15 @@ Options::Options(int ac, char **av)
                                          "argument to `-l' option. Run with "
                                          "-h for more information.");
             }
+        } else if (arg == "-m") {
+            if (av[1]) {
+                multPlexMethod = convertStringToMultPlexMethod(av[1]);
+                ++av;
+            } else {
+                throw std::runtime_error("Option parsing error: Excpected method argument "
+                                         "to `-m' option. Run with -h "
+                                         "for more information.");
+            }
         } else if (arg == "-c") {
             if (av[1]) {
                 configPath = std::string(av[1]);
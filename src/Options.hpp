@@ -13,5 +13,6 @@ class Options {
     bool printVersion;
     size_t onlyCheckConfig;
     std::string configPath;
+    std::string multPlexMethod;
     Logger::Level logLevel;
 };
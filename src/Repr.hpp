@@ -262,20 +262,28 @@ CHAR_REPR(signed char);
 POST_REFLECT_MEMBER(struct pollfd, int, fd, struct pollevents_helper, events, struct pollevents_helper, revents);
 
 #include "HttpServer.hpp"
+POST_REFLECT_MEMBER(OutputQueue::Segment, string, data, int, fd, off_t, offset, size_t, length);
+POST_REFLECT_GETTER(OutputQueue, deque<OutputQueue::Segment>, _segments, size_t, _offset, size_t, _size);
 POST_REFLECT_MEMBER(HttpServer::Server, struct in_addr, ip, struct in_port_t_helper, port, vector<string>, serverNames, Directives,
                     directives, LocationCtxs, locations);
 POST_REFLECT_MEMBER(HttpServer::CgiProcess, pid_t, pid, int, readFd, int, writeFd, string, response, unsigned long, totalSize, int,
-                    clientSocket, const LocationCtx *, location, bool, headersSent, std::time_t, lastActive);
-POST_REFLECT_MEMBER(HttpServer::HttpRequest, string, method, string, path, string, rawQuery, string, httpVersion, HttpServer::Headers,
-                    headers, string, body, HttpServer::RequestState, state, size_t, contentLength, bool, chunkedTransfer, size_t, bytesRead,
+                    clientSocket, const LocationCtx *, location, bool, headersSent);
+POST_REFLECT_GETTER(RequestParser, string, _buffer);
+POST_REFLECT_GETTER(RequestBody, string, _memory, int, _fd, size_t, _size);
+POST_REFLECT_MEMBER(HttpServer::HttpRequest, string, method, string, path, string, rawQuery, string, httpVersion, RequestParser,
+                    parser, RequestBody, body, HttpServer::RequestState, state, size_t, contentLength, bool, chunkedTransfer, size_t, bytesRead,
                     string, temporaryBuffer, bool, pathParsed);
-POST_REFLECT_MEMBER(HttpServer::MultPlexFds, MultPlexType, multPlexType, HttpServer::SelectFds, selectFds, HttpServer::PollFds, pollFds,
-                    HttpServer::EpollFds, epollFds, HttpServer::FdStates, fdStates);
-POST_REFLECT_GETTER(HttpServer, HttpServer::MultPlexFds, _monitorFds, HttpServer::ClientFdToCgiMap, _clientToCgi,
-                    HttpServer::CgiFdToClientMap, _cgiToClient, vector<int>, _listeningSockets, string, _httpVersionString,
-                    HttpServer::PendingWriteMap, _pendingWrites, HttpServer::PendingCloses, _pendingCloses, HttpServer::DefaultServers,
-                    _defaultServers, HttpServer::PendingRequests,
-                    _pendingRequests); /*, HttpServer::StatusTexts, _statusTexts, HttpServer::MimeTypes,
+POST_REFLECT_MEMBER(HttpServer::UringReg, uint32_t, events, uint32_t, gen, bool, armed, HttpServer::UringOp, input, bool, multishot);
+POST_REFLECT_MEMBER(HttpServer::MultPlexFds, MultPlexType, multPlexType, HttpServer::SelectFds, selectFds, HttpServer::PollFds, pollFds, int,
+                    epollFd, bool, edgeTriggered, HttpServer::EpollFds, epollFds, HttpServer::EpollRegs, epollRegs, HttpServer::UringRegs,
+                    uringRegs, HttpServer::FdStates, fdStates);
+POST_REFLECT_MEMBER(HttpServer::Connection, HttpServer::ConnectionKind, kind, bool, hasRequest, HttpServer::HttpRequest, request, string,
+                    pipelined, bool, hasPendingWrite, HttpServer::PendingWrite, pendingWrite, bool, pendingClose, bool, persistent,
+                    std::time_t, connectedSince, HttpServer::ConnectionTimer, timer, std::time_t, keepAliveTimeout, size_t, requestsServed, bool,
+                    hasCgi, HttpServer::CgiProcess, cgi, int, cgiClient, size_t, pollIndex);
+POST_REFLECT_GETTER(HttpServer, HttpServer::MultPlexFds, _monitorFds, vector<int>, _listeningSockets, string, _httpVersionString,
+                    HttpServer::DefaultServers, _defaultServers, HttpServer::Connections, _conns, vector<int>,
+                    _cgiClients); /*, HttpServer::StatusTexts, _statusTexts, HttpServer::MimeTypes,
                                           _mimeTypes, Config, _config, HttpServer::Servers, _servers,
                                           string, _rawConfig); */
 
@@ -600,13 +608,17 @@ template <> struct ReprWrapper<struct pollevents_helper> {
 // for struct epoll_event
 template <> struct ReprWrapper<struct epoll_event> {
     static inline string repr(const struct epoll_event &value) {
-        (void)value;
         std::ostringstream oss;
-        oss << "epoll_event(...)";
-        if (Logger::lastInstance().istrace5())
+        if (Logger::lastInstance().istrace5()) {
+            oss << "epoll_event(" << value.data.fd << ", " << value.events << ")";
             return Utils::jsonEscape(oss.str());
-        else
-            return kwrd(oss.str());
+        }
+        oss << kwrd("epoll_event") << punct("(") << ReprWrapper<int>::repr(value.data.fd) << punct(", ")
+            << ReprWrapper<struct pollevents_helper>::repr(pollevents_helper(static_cast<short>(value.events & 0xffff)));
+        if (value.events & EPOLLET)
+            oss << punct(", ") << num("EPOLLET");
+        oss << punct(")");
+        return oss.str();
     }
 };
 
@@ -624,6 +636,9 @@ template <> struct ReprWrapper<MultPlexType> {
         case Constants::EPOLL:
             oss << "EPOLL";
             break;
+        case Constants::IO_URING:
+            oss << "IO_URING";
+            break;
         }
         if (Logger::lastInstance().istrace5())
             return Utils::jsonEscape(oss.str());
@@ -668,6 +683,12 @@ template <> struct ReprWrapper<HttpServer::FdState> {
         case HttpServer::FD_WRITEABLE:
             oss << "WRITABLE";
             break;
+        case HttpServer::FD_ACCEPTED:
+            oss << "ACCEPTED";
+            break;
+        case HttpServer::FD_RECEIVED:
+            oss << "RECEIVED";
+            break;
         case HttpServer::FD_OTHER_STATE:
             oss << "OTHER_STATE";
             break;
@@ -679,16 +700,75 @@ template <> struct ReprWrapper<HttpServer::FdState> {
     }
 };
 
-// for enum ChunkParsingState
-template <> struct ReprWrapper<HttpServer::ChunkParsingState> {
-    static inline string repr(const HttpServer::ChunkParsingState &value) {
+// for enum ConnectionKind
+template <> struct ReprWrapper<HttpServer::ConnectionKind> {
+    static inline string repr(const HttpServer::ConnectionKind &value) {
+        std::ostringstream oss;
+        switch (value) {
+        case HttpServer::CONN_UNUSED:
+            oss << "UNUSED";
+            break;
+        case HttpServer::CONN_LISTENING:
+            oss << "LISTENING";
+            break;
+        case HttpServer::CONN_CLIENT:
+            oss << "CLIENT";
+            break;
+        case HttpServer::CONN_CGI_PIPE:
+            oss << "CGI_PIPE";
+            break;
+        case HttpServer::CONN_SIGNAL:
+            oss << "SIGNAL";
+            break;
+        }
+        if (Logger::lastInstance().istrace5())
+            return Utils::jsonEscape(oss.str());
+        else
+            return num(oss.str());
+    }
+};
+
+// for enum UringOp
+template <> struct ReprWrapper<HttpServer::UringOp> {
+    static inline string repr(const HttpServer::UringOp &value) {
+        std::ostringstream oss;
+        switch (value) {
+        case HttpServer::URING_POLL:
+            oss << "POLL";
+            break;
+        case HttpServer::URING_ACCEPT:
+            oss << "ACCEPT";
+            break;
+        case HttpServer::URING_RECV:
+            oss << "RECV";
+            break;
+        }
+        if (Logger::lastInstance().istrace5())
+            return Utils::jsonEscape(oss.str());
+        else
+            return num(oss.str());
+    }
+};
+
+// for enum ConnectionTimer
+template <> struct ReprWrapper<HttpServer::ConnectionTimer> {
+    static inline string repr(const HttpServer::ConnectionTimer &value) {
         std::ostringstream oss;
         switch (value) {
-        case HttpServer::PARSE_CHUNK:
-            oss << "PARSE_CHUNK";
+        case HttpServer::TIMER_NONE:
+            oss << "NONE";
+            break;
+        case HttpServer::TIMER_HEADER:
+            oss << "HEADER";
+            break;
+        case HttpServer::TIMER_BODY:
+            oss << "BODY";
+            break;
+        case HttpServer::TIMER_SEND:
+            oss << "SEND";
             break;
-        case HttpServer::PARSE_CHUNK_SIZE:
-            oss << "PARSE_CHUNK_SIZE";
+        case HttpServer::TIMER_KEEPALIVE:
+            oss << "KEEPALIVE";
             break;
         }
         if (Logger::lastInstance().istrace5())
@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <ios>
@@ -125,6 +126,37 @@ size_t Utils::convertSizeToBytes(const string &sizeStr) {
     return size;
 }
 
+std::time_t Utils::convertTimeToSeconds(const string &timeStr) {
+    if (timeStr.empty())
+        return 0;
+
+    string numStr;
+    char unit = timeStr[timeStr.length() - 1];
+
+    if (std::isdigit(unit)) {
+        numStr = timeStr;
+    } else {
+        numStr = timeStr.substr(0, timeStr.length() - 1);
+        unit = static_cast<char>(std::tolower(unit));
+    }
+
+    std::time_t seconds = static_cast<std::time_t>(std::atol(numStr.c_str()));
+
+    switch (unit) {
+    case 'm':
+        seconds *= 60;
+        break;
+    case 'h':
+        seconds *= 60 * 60;
+        break;
+    case 'd':
+        seconds *= 60 * 60 * 24;
+        break;
+    }
+
+    return seconds;
+}
+
 string Utils::ellipsisize(const string &str, size_t maxLen) {
     if (str.length() <= maxLen)
         return str;
@@ -197,6 +229,25 @@ string Utils::formattedTimestamp(std::time_t _t, bool forLogger) {
     }
 }
 
+// IMF-fixdate as used in Date, Last-Modified etc., e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+string Utils::httpDate(std::time_t t) {
+    char date[64];
+    struct tm tm;
+    if (::gmtime_r(&t, &tm) != NULL && std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm))
+        return date;
+    return "Thu, 01 Jan 1970 00:00:00 GMT";
+}
+
+// -1 if date isn't an IMF-fixdate, the obsolete formats RFC 9110 still allows aren't recognized
+std::time_t Utils::parseHttpDate(const string &date) {
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    const char *end = ::strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0')
+        return -1;
+    return ::timegm(&tm);
+}
+
 string Utils::formatSI(size_t size) {
     std::ostringstream oss;
 
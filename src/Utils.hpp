@@ -40,6 +40,7 @@ namespace Utils {
     char decodeTwoHexChars(const char _c1, const char _c2);
     bool isHexDigitNoCase(const char c);
     size_t convertSizeToBytes(const string &sizeStr);
+    std::time_t convertTimeToSeconds(const string &timeStr);
     string replaceAll(string s, const string &search, const string &replace);
     string jsonEscape(const string &s);
     string escapeExceptNlAndTab(const string &s);
@@ -47,6 +48,8 @@ namespace Utils {
     bool allUppercase(const string &str);
     string ellipsisize(const string &str, size_t maxLen);
     string formattedTimestamp(std::time_t _t = 0, bool forLogger = false);
+    string httpDate(std::time_t t);
+    std::time_t parseHttpDate(const string &date);
     string millisecondRemainderSinceEpoch();
     string formatSI(size_t size);
     size_t hexToSize(string sizeStr);
@@ -17,7 +17,7 @@ int main(int ac, char **av) {
             return EXIT_SUCCESS;
         }
         Logger log(std::cerr, options.logLevel);
-        HttpServer server(options.configPath, log, options.onlyCheckConfig);
+        HttpServer server(options.configPath, log, options.onlyCheckConfig, options.multPlexMethod);
         server.run();
         return EXIT_SUCCESS;
     } catch (const OnlyCheckConfigException &exception) {
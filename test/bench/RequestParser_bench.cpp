@@ -0,0 +1,104 @@
+// Microbenchmark of the request head parser against the way heads were parsed before RequestParser: every received piece was appended
+// to a copy of everything received so far, searched for the empty line from the start, and the complete head was split with
+// std::getline and operator>>. The parser is measured with every ByteScan implementation the CPU supports. Run with `make bench`.
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "ByteScan.hpp"
+#include "RequestParser.hpp"
+
+using std::map;
+using std::string;
+
+static string legacyLower(const string &s) {
+    string lower(s);
+    for (string::iterator c = lower.begin(); c != lower.end(); ++c)
+        *c = static_cast<char>(std::tolower(static_cast<unsigned char>(*c)));
+    return lower;
+}
+
+// both look up the headers every request needs, the legacy parser in the map it built
+static bool legacyParse(string &temporaryBuffer, const char *data, size_t size, map<string, string> &headers) {
+    string rawData = temporaryBuffer + string(data, size);
+    temporaryBuffer = rawData;
+    if (rawData.find("\r\n\r\n") == string::npos)
+        return false;
+    std::istringstream stream(rawData);
+    string line, method, path, version;
+    std::getline(stream, line);
+    std::istringstream requestLine(line);
+    requestLine >> method >> path >> version;
+    while (std::getline(stream, line) && line != "\r") {
+        size_t colon = line.find(':');
+        string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t\r\n"));
+        value.erase(value.find_last_not_of(" \t\r\n") + 1);
+        headers[legacyLower(line.substr(0, colon))] = value;
+    }
+    return headers.find("host") != headers.end() && headers.find("content-length") == headers.end() &&
+           headers.find("transfer-encoding") == headers.end();
+}
+
+static bool newParse(RequestParser &parser, const char *data, size_t size) {
+    if (parser.parse(data, size) != RequestParser::PARSE_COMPLETE)
+        return false;
+    return parser.hasHeader(HeaderTable::HOST) && !parser.hasHeader(HeaderTable::CONTENT_LENGTH) &&
+           !parser.hasHeader(HeaderTable::TRANSFER_ENCODING);
+}
+
+static double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+static void run(const char *name, const string &request, size_t pieceSize, size_t iterations) {
+    size_t completed = 0;
+    double start = seconds();
+    for (size_t i = 0; i < iterations; ++i) {
+        string temporaryBuffer;
+        map<string, string> headers;
+        for (size_t offset = 0; offset < request.size(); offset += pieceSize)
+            completed += legacyParse(temporaryBuffer, request.data() + offset, std::min(pieceSize, request.size() - offset), headers);
+    }
+    double legacy = seconds() - start;
+    std::printf("%-6s %5zu byte pieces: legacy %9.0f ns/request", name, pieceSize, legacy / static_cast<double>(iterations) * 1e9);
+    const char *implementations[] = {"scalar", "sse2", "avx2"};
+    for (size_t impl = 0; impl < sizeof(implementations) / sizeof(*implementations); ++impl) {
+        if (!ByteScan::use(implementations[impl]))
+            continue;
+        start = seconds();
+        RequestParser parser;
+        for (size_t i = 0; i < iterations; ++i) {
+            parser.reset();
+            for (size_t offset = 0; offset < request.size(); offset += pieceSize)
+                completed += newParse(parser, request.data() + offset, std::min(pieceSize, request.size() - offset));
+        }
+        double incremental = seconds() - start;
+        std::printf(", %s %7.0f (%.1fx)", implementations[impl], incremental / static_cast<double>(iterations) * 1e9, legacy / incremental);
+    }
+    std::printf("%s\n", completed % iterations == 0 ? "" : " MISMATCH");
+}
+
+int main() {
+    string small = "GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: bench\r\nAccept: */*\r\n\r\n";
+    string large = "GET /some/longer/path/to/a/resource.html?query=string&with=parameters HTTP/1.1\r\nHost: localhost:8080\r\n";
+    for (int i = 0; i < 40; ++i) {
+        std::ostringstream field;
+        field << "X-Custom-Header-" << i << ": some value that is reasonably long to look like a cookie " << i << "\r\n";
+        large += field.str();
+    }
+    large += "\r\n";
+    run("small", small, small.size(), 200000);
+    run("small", small, 16, 200000);
+    run("small", small, 1, 20000);
+    run("large", large, large.size(), 20000);
+    run("large", large, 64, 2000);
+    run("large", large, 1, 200);
+    return 0;
+}
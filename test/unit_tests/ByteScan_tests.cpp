@@ -0,0 +1,48 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <string>
+
+#include "ByteScan.hpp"
+
+using std::string;
+
+TEST_CASE("scans find the first special byte", "[bytescan]") {
+    string line = string(40, 'a') + "\tb\r\n";
+    CHECK(ByteScan::findLineStop(line.data(), line.size()) == 42);
+    CHECK(ByteScan::findLineStop(line.data(), 41) == 41);
+    string name = "Content-LENGTH-" + string(30, 'X');
+    string lowered(name.size(), '\0');
+    CHECK(ByteScan::lowerToken(name.data(), name.size(), &lowered[0]) == name.size());
+    CHECK(lowered == "content-length-" + string(30, 'x'));
+    CHECK(ByteScan::lowerToken("Bad Name", 8, &lowered[0]) == 3);
+    string target = "/some/long/path/without/anything/special/x%41";
+    CHECK(ByteScan::findUriSpecial(target.data(), target.size()) == target.size() - 3);
+}
+
+TEST_CASE("all implementations agree", "[bytescan]") {
+    const char *implementations[] = {"avx2", "sse2", "scalar"};
+    string reference = ByteScan::implementation();
+    std::srand(42);
+    for (int round = 0; round < 200; ++round) {
+        string data(static_cast<size_t>(std::rand() % 100), 'a');
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = static_cast<char>(std::rand() % 4 ? 0x21 + std::rand() % 94 : std::rand() % 256);
+        size_t results[3][3];
+        string lowered[3];
+        for (int i = 0; i < 3; ++i) {
+            if (!ByteScan::use(implementations[i]))
+                ByteScan::use("scalar");
+            lowered[i].assign(data.size(), '\0');
+            results[i][0] = ByteScan::findLineStop(data.data(), data.size());
+            results[i][1] = ByteScan::lowerToken(data.data(), data.size(), &lowered[i][0]);
+            results[i][2] = ByteScan::findUriSpecial(data.data(), data.size());
+        }
+        for (int i = 1; i < 3; ++i) {
+            CHECK(results[i][0] == results[0][0]);
+            CHECK(results[i][1] == results[0][1]);
+            CHECK(results[i][2] == results[0][2]);
+            CHECK(lowered[i] == lowered[0]);
+        }
+    }
+    ByteScan::use(reference);
+}
@@ -0,0 +1,76 @@
+#include <catch2/catch_test_macros.hpp>
+#include <sstream>
+#include <string>
+
+#include "ChunkedDecoder.hpp"
+
+static const string chunked = "4\r\nWiki\r\n7;name=\"value\"\r\npedia i\r\nB \t;a;b=c\r\nn \r\nchunks.\r\n0\r\nX-Trailer: 1\r\n\r\nGET";
+
+TEST_CASE("chunked body in one piece", "[chunkeddecoder]") {
+    ChunkedDecoder decoder;
+    RequestBody body;
+    size_t consumed = 0;
+    REQUIRE(decoder.decode(chunked.data(), chunked.size(), body, consumed) == ChunkedDecoder::DECODE_COMPLETE);
+    CHECK(body.memory() == "Wikipedia in \r\nchunks.");
+    CHECK(consumed == chunked.size() - 3); // the start of the next request is left alone
+    CHECK(decoder.decode("x", 1, body, consumed) == ChunkedDecoder::DECODE_COMPLETE);
+    CHECK(consumed == 0);
+}
+
+TEST_CASE("chunked body byte by byte", "[chunkeddecoder]") {
+    ChunkedDecoder decoder;
+    RequestBody body;
+    size_t consumed = 0;
+    size_t end = chunked.size() - 4;
+    for (size_t i = 0; i < end; ++i) {
+        CHECK(decoder.decode(chunked.data() + i, 1, body, consumed) == ChunkedDecoder::DECODE_INCOMPLETE);
+        CHECK(consumed == 1);
+    }
+    CHECK(decoder.decode(chunked.data() + end, 4, body, consumed) == ChunkedDecoder::DECODE_COMPLETE);
+    CHECK(consumed == 1);
+    CHECK(body.memory() == "Wikipedia in \r\nchunks.");
+
+    decoder.reset();
+    body.clear();
+    string bare = "3\nabc\n0\n\n";
+    CHECK(decoder.decode(bare.data(), bare.size(), body, consumed) == ChunkedDecoder::DECODE_COMPLETE);
+    CHECK(body.memory() == "abc");
+}
+
+TEST_CASE("many small chunks", "[chunkeddecoder]") {
+    std::ostringstream stream;
+    for (int i = 0; i < 100000; ++i)
+        stream << "1\r\nx\r\n";
+    stream << "0\r\n\r\n";
+    ChunkedDecoder decoder;
+    RequestBody body;
+    body.setBufferSize(4096);
+    size_t consumed = 0;
+    CHECK(decoder.decode(stream.str().data(), stream.str().size(), body, consumed) == ChunkedDecoder::DECODE_COMPLETE);
+    CHECK(body.size() == 100000);
+    CHECK(!body.inMemory());
+}
+
+TEST_CASE("remaining size of the current chunk", "[chunkeddecoder]") {
+    ChunkedDecoder decoder;
+    RequestBody body;
+    size_t consumed = 0;
+    CHECK(decoder.decode("1000\r\nab", 8, body, consumed) == ChunkedDecoder::DECODE_INCOMPLETE);
+    CHECK(decoder.remaining() == 0x1000 - 2);
+}
+
+TEST_CASE("malformed chunked bodies", "[chunkeddecoder]") {
+    const char *bodies[] = {"\r\n",           "x\r\n",          "3\r\nabcd\r\n", "3\r\nabc\rx", "3 x\r\n", "3\rx",
+                            "3;a\x01\r\n",    "0\r\nA: b\rc\r\n", "0\r\n\rx",      "10000000000000000\r\n"};
+    for (size_t i = 0; i < sizeof(bodies) / sizeof(*bodies); ++i) {
+        ChunkedDecoder decoder;
+        RequestBody body;
+        size_t consumed = 0;
+        CHECK(decoder.decode(bodies[i], string(bodies[i]).size(), body, consumed) == ChunkedDecoder::DECODE_ERROR);
+    }
+    ChunkedDecoder decoder;
+    RequestBody body;
+    size_t consumed = 0;
+    string extension = "1;" + string(ChunkedDecoder::MAX_LINE_LENGTH + 1, 'a');
+    CHECK(decoder.decode(extension.data(), extension.size(), body, consumed) == ChunkedDecoder::DECODE_ERROR);
+}
@@ -0,0 +1,50 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <string>
+#include <zlib.h>
+
+#include "GzipStream.hpp"
+
+static string gunzip(const string &compressed) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    string data;
+    char buffer[1024];
+    int ret;
+    do {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        data.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (ret == Z_OK);
+    CHECK(ret == Z_STREAM_END);
+    inflateEnd(&stream);
+    return data;
+}
+
+TEST_CASE("compressing a whole string", "[gzipstream]") {
+    string data;
+    for (int i = 0; i < 1000; ++i)
+        data += "compress me ";
+    string compressed = GzipStream::compress(data, 6);
+    CHECK(compressed.size() < data.size() / 10);
+    CHECK(gunzip(compressed) == data);
+    CHECK(gunzip(GzipStream::compress("", 1)).empty());
+}
+
+TEST_CASE("compressing a stream piece by piece", "[gzipstream]") {
+    GzipStream stream;
+    CHECK(!stream.active());
+    stream.start(1);
+    string compressed = stream.compress("first ", 6, false);
+    CHECK(!compressed.empty()); // flushed, can be sent already
+
+    GzipStream copy(stream);
+    compressed += stream.compress("second", 6, true);
+    CHECK(!stream.active());
+    CHECK(gunzip(compressed) == "first second");
+    CHECK(copy.active());
+}
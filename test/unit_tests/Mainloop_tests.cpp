@@ -0,0 +1,72 @@
+#include <catch2/catch_test_macros.hpp>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "AllocationCounter.hpp"
+#include "HttpServer.hpp"
+#include "Logger.hpp"
+
+static const int port = 8123;
+
+// keep-alive requests and keepalive_timeout closing the connection make busy iterations, the SIGTERM that stops the server an idle one
+static void driveServer(pid_t server) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0) {
+        const char request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        char buffer[4096];
+        for (int i = 0; i < 20; ++i)
+            if (::send(fd, request, sizeof(request) - 1, 0) < 0 || ::recv(fd, buffer, sizeof(buffer), 0) <= 0)
+                break;
+        while (::recv(fd, buffer, sizeof(buffer), 0) > 0) // until the server closes the connection
+            ;
+    }
+    ::close(fd);
+    ::usleep(200 * 1000); // so the signal finds the server waiting, and not for this process to exit
+    ::kill(server, SIGTERM);
+    ::usleep(200 * 1000);
+}
+
+static HttpServer::MainloopStats runServer(const string &multPlexMethod) {
+    string configPath = "/tmp/webserv_mainloop.conf";
+    std::ofstream config(configPath.c_str());
+    config << "keepalive_timeout 1s;\nserver {\n\tlisten 127.0.0.1:8123;\n\troot html;\n}\n";
+    config.close();
+    Logger log(std::cerr, Logger::ERROR);
+    HttpServer server(configPath, log, 0, multPlexMethod);
+    pid_t client = ::fork();
+    REQUIRE(client >= 0);
+    if (client == 0) {
+        driveServer(::getppid());
+        ::_exit(0);
+    }
+    HttpServer::_running = true;
+    server.run();
+    ::waitpid(client, NULL, 0); // the server may have reaped it already
+    return server.get_mainloopStats();
+}
+
+TEST_CASE("the mainloop doesn't allocate while waiting or idle", "[mainloop]") {
+    if (!AllocationCounter::enabled())
+        SKIP("build with COUNT_ALLOCS=1 to count heap allocations");
+    const char *methods[] = {"poll", "epoll", "io_uring"};
+    for (size_t i = 0; i < sizeof(methods) / sizeof(*methods); ++i) {
+        INFO(methods[i]);
+        HttpServer::MainloopStats stats = runServer(methods[i]);
+        CHECK(stats.iterations > stats.idleIterations);
+        CHECK(stats.idleIterations > 0);
+        CHECK(stats.waitAllocs == 0);
+        CHECK(stats.idleAllocs == 0);
+    }
+}
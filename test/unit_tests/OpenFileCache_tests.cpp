@@ -0,0 +1,88 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cerrno>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "OpenFileCache.hpp"
+
+static string tmpFile(const string &name, const string &content) {
+    string path = "/tmp/webserv_ofc_" + name;
+    std::ofstream file(path.c_str());
+    file << content;
+    return path;
+}
+
+TEST_CASE("cached files stay open while they're used", "[openfilecache]") {
+    OpenFileCache cache;
+    cache.configure(2, 60 * 1000, 60 * 1000, 1, false);
+    string a = tmpFile("a", "aaa"), b = tmpFile("b", "b"), c = tmpFile("c", "cc");
+    struct stat info;
+
+    CHECK(cache.stat(a, info) == 0);
+    CHECK(info.st_size == 3);
+    ::unlink(a.c_str());
+    int fd = cache.open(a, info); // still valid, served from the cache
+    REQUIRE(fd >= 0);
+    char buf[8];
+    CHECK(::read(fd, buf, sizeof(buf)) == 3);
+    ::close(fd);
+
+    CHECK(cache.stat(b, info) == 0);
+    CHECK(cache.stat(c, info) == 0); // evicts a, the least recently used
+    CHECK(cache.size() == 2);
+    CHECK(cache.stat(a, info) == ENOENT);
+    ::unlink(b.c_str());
+    ::unlink(c.c_str());
+}
+
+TEST_CASE("failed lookups", "[openfilecache]") {
+    OpenFileCache cache;
+    struct stat info;
+    string missing = "/tmp/webserv_ofc_missing";
+    ::unlink(missing.c_str());
+
+    cache.configure(10, 60 * 1000, 60 * 1000, 1, false);
+    CHECK(cache.stat(missing, info) == ENOENT);
+    CHECK(cache.size() == 0);
+
+    cache.configure(10, 60 * 1000, 60 * 1000, 1, true);
+    CHECK(cache.stat(missing, info) == ENOENT);
+    CHECK(cache.size() == 1);
+    tmpFile("missing", "now it exists");
+    CHECK(cache.open(missing, info) < 0); // until the entry has to be validated again
+    CHECK(errno == ENOENT);
+    ::unlink(missing.c_str());
+}
+
+TEST_CASE("directories and min uses", "[openfilecache]") {
+    OpenFileCache cache;
+    cache.configure(10, 60 * 1000, 60 * 1000, 2, false);
+    struct stat info;
+    CHECK(cache.stat("/tmp", info) == 0);
+    CHECK(S_ISDIR(info.st_mode));
+    CHECK(cache.open("/tmp", info) < 0);
+    CHECK(errno == EISDIR);
+
+    string a = tmpFile("uses", "x");
+    CHECK(cache.stat(a, info) == 0); // first use, not cached yet
+    ::unlink(a.c_str());
+    CHECK(cache.stat(a, info) == ENOENT);
+}
+
+TEST_CASE("only regular files are opened without the cache", "[openfilecache]") {
+    OpenFileCache cache;
+    struct stat info;
+    CHECK(cache.open("/tmp", info) < 0);
+    CHECK(errno == EISDIR);
+    CHECK(cache.open("/dev/null", info) < 0);
+    CHECK(errno == EACCES);
+
+    string a = tmpFile("uncached", "abc");
+    int fd = cache.open(a, info);
+    CHECK(fd >= 0);
+    CHECK(info.st_size == 3);
+    ::close(fd);
+    ::unlink(a.c_str());
+}
@@ -0,0 +1,113 @@
+#include <catch2/catch_test_macros.hpp>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#include "Constants.hpp"
+#include "OutputQueue.hpp"
+
+static string gathered(const OutputQueue &queue, size_t maxBytes, int maxIov = CONSTANTS_MAX_IOVECS) {
+    struct iovec iov[CONSTANTS_MAX_IOVECS];
+    size_t bytes;
+    int count = queue.gather(iov, maxIov, maxBytes, bytes);
+    string data;
+    for (int i = 0; i < count; ++i)
+        data.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+    CHECK(bytes == data.size());
+    return data;
+}
+
+TEST_CASE("small pieces are merged", "[outputqueue]") {
+    OutputQueue queue;
+    queue.append("HTTP/1.1 200 OK\r\n");
+    queue.append("");
+    queue.append("\r\n");
+    CHECK(queue.size() == 19);
+    CHECK(queue.get_segments().size() == 1);
+    CHECK(gathered(queue, 100) == "HTTP/1.1 200 OK\r\n\r\n");
+}
+
+TEST_CASE("consuming advances through the segments", "[outputqueue]") {
+    OutputQueue queue;
+    string big(CONSTANTS_CHUNK_SIZE, 'a');
+    queue.append("head");
+    queue.append(big);
+    queue.append("tail");
+    CHECK(queue.size() == big.size() + 8);
+    CHECK(gathered(queue, 6) == "headaa");
+    CHECK(gathered(queue, 1000, 1) == "head");
+
+    queue.consume(2);
+    CHECK(queue.peek(4) == "adaa");
+    queue.consume(2 + big.size());
+    CHECK(gathered(queue, 100) == "tail");
+    queue.consume(4);
+    CHECK(queue.empty());
+    CHECK(queue.get_segments().empty());
+}
+
+TEST_CASE("clearing drops everything", "[outputqueue]") {
+    OutputQueue queue;
+    queue.append(string(3 * CONSTANTS_CHUNK_SIZE, 'x'));
+    queue.consume(10);
+    queue.clear();
+    CHECK(queue.size() == 0);
+    CHECK(gathered(queue, 100).empty());
+    queue.append("next");
+    CHECK(queue.peek(100) == "next");
+}
+
+TEST_CASE("file segments", "[outputqueue]") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    ::close(fds[1]);
+    OutputQueue queue;
+    queue.append("headers");
+    queue.appendFile(fds[0], 100, 5000);
+    queue.append("next");
+    CHECK(queue.size() == 7 + 5000 + 4);
+    CHECK(gathered(queue, 100) == "headers");
+
+    int fd;
+    off_t offset;
+    size_t length;
+    CHECK(!queue.frontFile(fd, offset, length));
+    queue.consume(7);
+    REQUIRE(queue.frontFile(fd, offset, length));
+    CHECK(fd == fds[0]);
+    CHECK(gathered(queue, 100).empty());
+    queue.consume(1000);
+    REQUIRE(queue.frontFile(fd, offset, length));
+    CHECK(offset == 1100);
+    CHECK(length == 4000);
+
+    OutputQueue copy(queue);
+    int copiedFd;
+    REQUIRE(copy.frontFile(copiedFd, offset, length));
+    CHECK(copiedFd != fd);
+
+    queue.consume(4000);
+    CHECK(::fcntl(fd, F_GETFD) < 0); // closed once sent
+    CHECK(queue.peek(100) == "next");
+    copy.clear();
+    CHECK(::fcntl(copiedFd, F_GETFD) < 0);
+}
+
+TEST_CASE("shared segments", "[outputqueue]") {
+    SharedBuffer buffer("HTTP/1.1 200 OK\r\nbody");
+    OutputQueue queue;
+    queue.appendShared(buffer, 0, 17);
+    queue.append("\r\n");
+    queue.appendShared(buffer, 17, 4);
+    CHECK(buffer.useCount() == 3);
+    CHECK(queue.size() == 23);
+    CHECK(gathered(queue, 100) == "HTTP/1.1 200 OK\r\n\r\nbody");
+
+    queue.consume(5);
+    CHECK(queue.peek(3) == "1.1");
+    queue.consume(14);
+    CHECK(gathered(queue, 100) == "body");
+    queue.consume(4);
+    CHECK(queue.empty());
+    CHECK(buffer.useCount() == 1);
+}
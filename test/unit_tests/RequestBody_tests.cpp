@@ -0,0 +1,135 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include "RequestBody.hpp"
+
+static string readAll(int fd) {
+    string contents;
+    char buffer[4096];
+    ssize_t bytesRead;
+    off_t offset = 0;
+    while ((bytesRead = ::pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+        contents.append(buffer, static_cast<size_t>(bytesRead));
+        offset += bytesRead;
+    }
+    return contents;
+}
+
+TEST_CASE("small bodies stay in memory", "[requestbody]") {
+    RequestBody body;
+    body.setBufferSize(8);
+    body.append("abcd", 4);
+    body.append("efgh", 4);
+    CHECK(body.inMemory());
+    CHECK(body.fd() == -1);
+    CHECK(body.memory() == "abcdefgh");
+
+    OutputQueue queue;
+    body.appendTo(queue);
+    int fd;
+    off_t offset;
+    size_t length;
+    CHECK(queue.size() == 8);
+    CHECK(!queue.frontFile(fd, offset, length));
+}
+
+TEST_CASE("bodies beyond the buffer size are spooled", "[requestbody]") {
+    RequestBody body;
+    body.setBufferSize(8);
+    body.append("abcdefgh", 8);
+    body.append("i", 1);
+    REQUIRE(!body.inMemory());
+    CHECK(body.memory().empty());
+    CHECK(body.size() == 9);
+    body.append("jk", 2);
+    CHECK(readAll(body.fd()) == "abcdefghijk");
+
+    OutputQueue queue;
+    body.appendTo(queue);
+    int fd;
+    off_t offset;
+    size_t length;
+    REQUIRE(queue.frontFile(fd, offset, length));
+    CHECK(fd != body.fd());
+    CHECK(offset == 0);
+    CHECK(length == 11);
+
+    FILE *file = std::tmpfile();
+    REQUIRE(file != NULL);
+    body.writeTo(fileno(file));
+    CHECK(readAll(fileno(file)) == "abcdefghijk");
+    std::fclose(file);
+
+    RequestBody copy(body);
+    CHECK(copy.fd() != body.fd());
+    CHECK(readAll(copy.fd()) == "abcdefghijk");
+    body.clear();
+    CHECK(body.inMemory());
+    CHECK(body.empty());
+}
+
+TEST_CASE("lowering the buffer size spools what is there", "[requestbody]") {
+    RequestBody body;
+    body.append("abc", 3);
+    CHECK(body.inMemory());
+    body.setBufferSize(2);
+    CHECK(!body.inMemory());
+    CHECK(readAll(body.fd()) == "abc");
+}
+
+TEST_CASE("uploads are streamed next to their destination", "[requestbody]") {
+    char dir[] = "/tmp/requestbody_XXXXXX";
+    REQUIRE(::mkdtemp(dir) != NULL);
+    string path = string(dir) + "/upload";
+
+    RequestBody body;
+    body.append("abc", 3);
+    body.streamTo(path);
+    CHECK(body.streaming());
+    CHECK(!body.inMemory());
+    body.append("def", 3);
+    CHECK(::access(path.c_str(), F_OK) < 0);
+    {
+        RequestBody copy(body);
+        CHECK(!copy.streaming());
+    } // a copy doesn't take the upload with it
+    REQUIRE(body.commit(false));
+    CHECK(!body.streaming());
+    FILE *file = std::fopen(path.c_str(), "r");
+    REQUIRE(file != NULL);
+    CHECK(readAll(fileno(file)) == "abcdef");
+    std::fclose(file);
+
+    body.append("x", 1);
+    body.streamTo(path);
+    CHECK(!body.commit(false)); // the file exists
+    body.append("y", 1);
+    body.streamTo(path);
+    string tmpPath = body.get_tmpPath();
+    CHECK(::access(tmpPath.c_str(), F_OK) == 0);
+    REQUIRE(body.commit(true));
+    CHECK(::access(tmpPath.c_str(), F_OK) < 0);
+    file = std::fopen(path.c_str(), "r");
+    REQUIRE(file != NULL);
+    CHECK(readAll(fileno(file)) == "y");
+    std::fclose(file);
+
+    body.append("z", 1);
+    body.streamTo(path);
+    tmpPath = body.get_tmpPath();
+    body.clear();
+    CHECK(::access(tmpPath.c_str(), F_OK) < 0);
+    {
+        RequestBody abandoned;
+        abandoned.append("z", 1);
+        abandoned.streamTo(path);
+        tmpPath = abandoned.get_tmpPath();
+        CHECK(::access(tmpPath.c_str(), F_OK) == 0);
+    }
+    CHECK(::access(tmpPath.c_str(), F_OK) < 0);
+    ::unlink(path.c_str());
+    ::rmdir(dir);
+}
@@ -0,0 +1,76 @@
+#include <catch2/catch_test_macros.hpp>
+#include <sstream>
+#include <string>
+
+#include "RequestParser.hpp"
+
+static const string request = "GET /index.html?x=1 HTTP/1.1\r\nHost: localhost\r\nAccept:  */* \r\n\r\nbody";
+
+TEST_CASE("request head in one piece", "[requestparser]") {
+    RequestParser parser;
+    REQUIRE(parser.parse(request.data(), request.size()) == RequestParser::PARSE_COMPLETE);
+    CHECK(parser.str(parser.method()) == "GET");
+    CHECK(parser.str(parser.target()) == "/index.html?x=1");
+    CHECK(parser.str(parser.version()) == "HTTP/1.1");
+    REQUIRE(parser.headers().size() == 2);
+    CHECK(parser.str(parser.headers()[0].name) == "host");
+    CHECK(parser.headers()[0].id == HeaderTable::HOST);
+    CHECK(parser.headers()[1].id == HeaderTable::OTHER);
+    CHECK(parser.str(parser.headers()[1].value) == "*/*");
+    CHECK(parser.buffer().substr(parser.headSize()) == "body");
+}
+
+TEST_CASE("request head byte by byte", "[requestparser]") {
+    RequestParser parser;
+    for (size_t i = 0; i + 5 < request.size(); ++i)
+        CHECK(parser.parse(request.data() + i, 1) == RequestParser::PARSE_INCOMPLETE);
+    CHECK(parser.parse(request.data() + request.size() - 5, 5) == RequestParser::PARSE_COMPLETE);
+    CHECK(parser.headSize() == request.size() - 4);
+    REQUIRE(parser.header(HeaderTable::HOST) != NULL);
+    CHECK(parser.str(*parser.header(HeaderTable::HOST)) == "localhost");
+
+    parser.reset();
+    string bare = "\r\nPUT / HTTP/1.1\nA: b\n\n";
+    CHECK(parser.parse(bare.data(), bare.size()) == RequestParser::PARSE_COMPLETE);
+    CHECK(parser.str(parser.method()) == "PUT");
+    CHECK(parser.headSize() == bare.size());
+}
+
+TEST_CASE("malformed request heads", "[requestparser]") {
+    const char *heads[] = {"GET / HTTP/1.1 extra\r\n", "GET /\r\n", "GET / HTTP/1.1\r\nNo colon\r\n",
+                           "GET / HTTP/1.1\r\nName : value\r\n", "GET / HTTP/1.1\r\nA: b\r\n folded\r\n", "GET / HTTP/1.1\r\n: empty\r\n",
+                           "GET / HTTP/1.1\r\nA: b\x01\r\n", "GET / HTTP/1.1\r\nA: b\rc\r\n"};
+    for (size_t i = 0; i < sizeof(heads) / sizeof(*heads); ++i) {
+        RequestParser parser;
+        CHECK(parser.parse(heads[i], string(heads[i]).size()) == RequestParser::PARSE_ERROR);
+    }
+}
+
+TEST_CASE("header table", "[requestparser]") {
+    std::ostringstream head;
+    head << "POST / HTTP/1.1\r\nContent-Length: 1\r\n";
+    for (int i = 0; i < 20; ++i)
+        head << "X-Field-" << i << ": " << i << "\r\n";
+    head << "CONTENT-LENGTH: 2\r\n\r\n";
+    RequestParser parser;
+    REQUIRE(parser.parse(head.str().data(), head.str().size()) == RequestParser::PARSE_COMPLETE);
+    CHECK(parser.headers().size() == 22);
+    CHECK(parser.str(parser.headers()[19].name) == "x-field-18");
+    REQUIRE(parser.header(HeaderTable::CONTENT_LENGTH) != NULL);
+    CHECK(parser.str(*parser.header(HeaderTable::CONTENT_LENGTH)) == "2"); // the last one wins
+    CHECK(parser.headerIs(HeaderTable::CONTENT_LENGTH, "2"));
+    CHECK(!parser.headerIs(HeaderTable::CONTENT_LENGTH, "1"));
+    CHECK(!parser.headerIs(HeaderTable::CONTENT_LENGTH, "22"));
+    CHECK(!parser.hasHeader(HeaderTable::HOST));
+    CHECK(parser.header(HeaderTable::HOST) == NULL);
+    CHECK(!parser.headerIs(HeaderTable::HOST, ""));
+
+    parser.reset();
+    string close = "GET / HTTP/1.1\r\nConnection: Close\r\n\r\n";
+    REQUIRE(parser.parse(close.data(), close.size()) == RequestParser::PARSE_COMPLETE);
+    CHECK(parser.headerIs(HeaderTable::CONNECTION, "close"));
+    CHECK(!parser.headerIs(HeaderTable::CONNECTION, "clos"));
+    CHECK(HeaderTable::identify("transfer-encoding", 17) == HeaderTable::TRANSFER_ENCODING);
+    CHECK(HeaderTable::identify("if-modified-since", 17) == HeaderTable::IF_MODIFIED_SINCE);
+    CHECK(HeaderTable::identify("hosts", 5) == HeaderTable::OTHER);
+}
@@ -0,0 +1,49 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+#include "ResponseCache.hpp"
+
+static struct stat fileInfo(off_t size, std::time_t mtime) {
+    struct stat info;
+    std::memset(&info, 0, sizeof(info));
+    info.st_mode = S_IFREG;
+    info.st_size = size;
+    info.st_mtime = mtime;
+    return info;
+}
+
+TEST_CASE("responses are validated against the file", "[responsecache]") {
+    ResponseCache cache;
+    cache.configure(1000, 100);
+    struct stat info = fileInfo(4, 1);
+    CHECK(cache.cacheable(info));
+    CHECK(!cache.cacheable(fileInfo(101, 1)));
+    cache.insert("/a", info, ResponseCache::Response(SharedBuffer("headersbody"), 7));
+
+    const ResponseCache::Response *hit = cache.find("/a", info);
+    REQUIRE(hit != NULL);
+    CHECK(hit->headersLength == 7);
+    CHECK(cache.find("/a", fileInfo(4, 2)) == NULL); // modified, dropped
+    CHECK(cache.size() == 0);
+    CHECK(cache.bytes() == 0);
+}
+
+TEST_CASE("the least recently used responses are evicted", "[responsecache]") {
+    ResponseCache cache;
+    cache.configure(25, 100);
+    struct stat info = fileInfo(10, 1);
+    cache.insert("/a", info, ResponseCache::Response(SharedBuffer(std::string(10, 'a')), 0));
+    cache.insert("/b", info, ResponseCache::Response(SharedBuffer(std::string(10, 'b')), 0));
+    CHECK(cache.find("/a", info) != NULL);
+    cache.insert("/c", info, ResponseCache::Response(SharedBuffer(std::string(10, 'c')), 0));
+    CHECK(cache.size() == 2);
+    CHECK(cache.bytes() == 20);
+    CHECK(cache.find("/b", info) == NULL);
+    CHECK(cache.find("/a", info) != NULL);
+
+    cache.configure(0, 100);
+    CHECK(!cache.cacheable(info));
+    CHECK(cache.size() == 0);
+}
@@ -0,0 +1,62 @@
+#include <catch2/catch_test_macros.hpp>
+#include <vector>
+
+#include "TimerWheel.hpp"
+
+static std::vector<size_t> advance(TimerWheel &wheel, uint64_t until) {
+    std::vector<size_t> expired;
+    wheel.advance(until, expired);
+    return expired;
+}
+
+TEST_CASE("timer expires once its time has come", "[timerwheel]") {
+    TimerWheel wheel;
+    uint64_t now = TimerWheel::now();
+    wheel.schedule(3, now + 1000);
+    CHECK(wheel.scheduled(3));
+    CHECK(advance(wheel, now + 500).empty());
+    std::vector<size_t> expired = advance(wheel, now + 1000 + TimerWheel::tickMs);
+    REQUIRE(expired.size() == 1);
+    CHECK(expired[0] == 3);
+    CHECK(!wheel.scheduled(3));
+    CHECK(wheel.size() == 0);
+}
+
+TEST_CASE("cancelled and rescheduled timers", "[timerwheel]") {
+    TimerWheel wheel;
+    uint64_t now = TimerWheel::now();
+    wheel.schedule(0, now + 1000);
+    wheel.schedule(1, now + 1000);
+    wheel.cancel(0);
+    wheel.schedule(1, now + 5000);
+    CHECK(advance(wheel, now + 2000).empty());
+    std::vector<size_t> expired = advance(wheel, now + 5000 + TimerWheel::tickMs);
+    REQUIRE(expired.size() == 1);
+    CHECK(expired[0] == 1);
+}
+
+TEST_CASE("timers in higher levels cascade down", "[timerwheel]") {
+    TimerWheel wheel;
+    uint64_t now = TimerWheel::now();
+    wheel.schedule(7, now + 3600 * 1000); // beyond the first two levels
+    wheel.schedule(8, now + 75 * 1000);
+    CHECK(advance(wheel, now + 74 * 1000).empty());
+    CHECK(advance(wheel, now + 76 * 1000).size() == 1);
+    CHECK(advance(wheel, now + 3599 * 1000).empty());
+    std::vector<size_t> expired = advance(wheel, now + 3601 * 1000);
+    REQUIRE(expired.size() == 1);
+    CHECK(expired[0] == 7);
+}
+
+TEST_CASE("time until the next timer", "[timerwheel]") {
+    TimerWheel wheel;
+    uint64_t now = TimerWheel::now();
+    CHECK(wheel.timeUntilNext(now) == -1);
+    wheel.schedule(2, now + 60 * 1000);
+    wheel.schedule(5, now + 2000);
+    long timeout = wheel.timeUntilNext(now);
+    CHECK(timeout > 0);
+    CHECK(timeout <= 2000 + static_cast<long>(TimerWheel::tickMs));
+    wheel.cancel(5);
+    CHECK(wheel.timeUntilNext(now) > timeout);
+}
@@ -1,3 +1,4 @@
+import os
 import pytest
 import subprocess
 import time
@@ -35,4 +36,14 @@ def upload_file(tmp_path):
 	"""Create a temporary file for upload tests"""
 	test_file = tmp_path / "test.txt"
 	test_file.write_text("Test content for upload")
-	return test_file
\ No newline at end of file
+	return test_file
+
+@pytest.fixture(scope="session")
+def static_variants():
+	"""Precompressed sidecars in html/server18/static, git doesn't keep the mtimes they're selected by"""
+	static = Path("html/server18/static")
+	for plain, offset in [("both.txt", 0), ("stale.txt", -60), ("always/file.txt", 0)]:
+		mtime = os.stat(static / plain).st_mtime
+		for sidecar in static.glob(plain + ".*"):
+			os.utime(sidecar, (mtime + offset, mtime + offset))
+	return "http://127.0.0.1:8009/static"
@@ -1,5 +1,9 @@
+import re
+import socket
+import time
 import pytest
 import requests
+from pathlib import Path
 
 def test_autoindex(webserver, base_url_foo):
     """Test directory listing (autoindex)"""
@@ -22,4 +26,198 @@ def test_client_max_body_size(webserver, base_url_foo, size, expected_status):
     """Test client_max_body_size directive"""
     data = "x" * size
     response = requests.post(f"{base_url_foo}/baz", data=data)
-    assert response.status_code == expected_status
\ No newline at end of file
+    assert response.status_code == expected_status
+
+def test_keepalive(webserver, base_url):
+    """Test that connections are kept open unless the client asks to close them"""
+    with requests.Session() as session:
+        first = session.get(f"{base_url}/")
+        second = session.get(f"{base_url}/")
+        assert first.headers['Connection'] == 'keep-alive'
+        assert second.status_code == 200
+        response = session.get(f"{base_url}/", headers={'Connection': 'close'})
+        assert response.headers['Connection'] == 'close'
+
+def test_pipelining(webserver):
+    """Test that pipelined requests sent in one go are all answered, in order"""
+    request = b"GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n"
+    with socket.create_connection(("127.0.0.1", 8000), timeout=2) as sock:
+        sock.sendall(request % b"/" + request % b"/nonexistent" + request % b"/")
+        data = b""
+        while data.count(b"HTTP/1.1 ") < 3:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    assert re.findall(rb"HTTP/1\.1 (\d{3})", data) == [b"200", b"404", b"200"]
+
+def read_until_closed(sock):
+    data = b""
+    while True:
+        chunk = sock.recv(4096)
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+@pytest.mark.parametrize("framing,expected_status", [
+    (b"Content-Length: 100\r\nContent-Length: 5\r\n\r\nhello", b"400"),
+    (b"Content-Length: 1x\r\n\r\nG", b"400"),
+    (b"Content-Length: 99999999999999999999999\r\n\r\n", b"400"),
+    (b"Transfer-Encoding: gzip\r\nContent-Length: 5\r\n\r\nhello", b"501"),
+    (b"Transfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", b"501"),
+    (b"Content-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", None),
+])
+def test_ambiguous_framing_closes_connection(webserver, framing, expected_status):
+    """Test that a request body without a reliable end is never followed by another request on the same connection"""
+    request = b"POST / HTTP/1.1\r\nHost: localhost\r\n" + framing + b"GET /nonexistent HTTP/1.1\r\nHost: localhost\r\n\r\n"
+    with socket.create_connection(("127.0.0.1", 8000), timeout=5) as sock:
+        sock.sendall(request)
+        data = read_until_closed(sock)
+    statuses = re.findall(rb"HTTP/1\.1 (\d{3})", data)
+    assert len(statuses) == 1
+    assert expected_status is None or statuses[0] == expected_status
+    assert b"Connection: close" in data
+
+def test_pipelining_without_reading(webserver):
+    """Test that a client pipelining requests without reading the responses doesn't make the server hold a file per request"""
+    path = Path("html/pipelined.bin")
+    path.write_bytes(b"x" * (1 << 20))
+    fds = Path(f"/proc/{webserver.pid}/fd")
+    try:
+        before = len(list(fds.iterdir()))
+        with socket.create_connection(("127.0.0.1", 8000), timeout=5) as sock:
+            sock.sendall(b"GET /pipelined.bin HTTP/1.1\r\nHost: localhost\r\n\r\n" * 3000)
+            time.sleep(0.5)
+            assert len(list(fds.iterdir())) - before < 10
+    finally:
+        path.unlink()
+
+def test_cgi_timeout(webserver):
+    """Test that a CGI process without output is killed after cgi_timeout"""
+    response = requests.get("http://127.0.0.1:8009/foo/cgi-bin/test_timeout.sh", timeout=15)
+    assert response.status_code == 504
+
+def test_cgi_timeout_with_unread_body(webserver):
+    """Test that a CGI process timing out before reading its stdin gets one 504, and its pipes are closed with it"""
+    body = b"x" * (256 << 10)
+    head = b"POST /foo/cgi-bin/test_timeout.sh HTTP/1.1\r\nHost: localhost\r\nContent-Length: %d\r\n\r\n" % len(body)
+    with socket.create_connection(("127.0.0.1", 8009), timeout=15) as sock:
+        sock.sendall(head + body)
+        data = read_until_closed(sock)
+    assert re.findall(rb"HTTP/1\.1 (\d{3})", data) == [b"504"]
+    assert requests.get("http://127.0.0.1:8009/foo/cgi-bin/test.py").status_code == 200
+
+def test_cgi_timeout_after_headers(webserver):
+    """Test that a CGI process timing out after its headers were sent only closes the connection, without a 504"""
+    request = b"GET /foo/cgi-bin/test_timeout_after_headers.sh HTTP/1.1\r\nHost: localhost\r\n\r\n"
+    with socket.create_connection(("127.0.0.1", 8009), timeout=15) as sock:
+        sock.sendall(request)
+        data = b""
+        while True:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    assert data.startswith(b"HTTP/1.1 200 ")
+    assert b"partial output" in data
+    assert data.count(b"HTTP/1.1 ") == 1
+
+def test_conditional_get(webserver, base_url):
+    """Test that unchanged files are answered with 304 Not Modified"""
+    response = requests.get(f"{base_url}/")
+    etag = response.headers['ETag']
+    last_modified = response.headers['Last-Modified']
+    response = requests.get(f"{base_url}/", headers={'If-None-Match': etag})
+    assert response.status_code == 304
+    assert response.content == b""
+    assert response.headers['ETag'] == etag
+    assert requests.get(f"{base_url}/", headers={'If-Modified-Since': last_modified}).status_code == 304
+    assert requests.get(f"{base_url}/", headers={'If-None-Match': '"other"'}).status_code == 200
+
+def test_range_requests(webserver, base_url):
+    """Test that byte ranges are answered with 206 Partial Content, or 416 if they can't be satisfied"""
+    full = requests.get(f"{base_url}/").content
+    response = requests.get(f"{base_url}/", headers={'Range': 'bytes=1-3'})
+    assert response.status_code == 206
+    assert response.headers['Content-Range'] == f"bytes 1-3/{len(full)}"
+    assert response.content == full[1:4]
+    response = requests.get(f"{base_url}/", headers={'Range': 'bytes=0-0,-1'})
+    assert response.status_code == 206
+    assert response.headers['Content-Type'].startswith('multipart/byteranges')
+    assert requests.get(f"{base_url}/", headers={'Range': f"bytes={len(full)}-"}).status_code == 416
+
+def test_cgi_chunked_keepalive(webserver):
+    """Test that CGI output without a Content-Length is sent chunked and the connection is reused"""
+    with requests.Session() as session:
+        first = session.get("http://127.0.0.1:8009/foo/cgi-bin/test.py")
+        assert first.headers['Transfer-Encoding'] == 'chunked'
+        assert first.headers['Connection'] == 'keep-alive'
+        assert '</html>' in first.text
+        assert session.get("http://127.0.0.1:8009/foo/cgi-bin/test.py").status_code == 200
+
+def test_cgi_failure_not_terminated(webserver):
+    """Test that the body of a failed CGI process isn't terminated, and the connection is closed instead"""
+    request = b"GET /foo/cgi-bin/test_exit_failure.sh HTTP/1.1\r\nHost: localhost\r\n\r\n"
+    with socket.create_connection(("127.0.0.1", 8009), timeout=5) as sock:
+        sock.sendall(request)
+        data = b""
+        while True:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            data += chunk
+    head, _, body = data.partition(b"\r\n\r\n")
+    assert b"Transfer-Encoding: chunked" in head
+    assert b"partial output" in body
+    assert not body.endswith(b"0\r\n\r\n")
+
+def get_raw(url, accept_encoding, **headers):
+    """GET without decoding the body, the sidecars aren't really compressed"""
+    response = requests.get(url, headers={'Accept-Encoding': accept_encoding, **headers}, stream=True)
+    return response, response.raw.read(decode_content=False)
+
+def test_gzip_static_prefers_br(webserver, static_variants):
+    """Test that file.br wins over file.gz if the client accepts both"""
+    response, body = get_raw(f"{static_variants}/both.txt", "gzip, br")
+    assert response.headers['Content-Encoding'] == 'br'
+    assert response.headers['Vary'] == 'Accept-Encoding'
+    assert body == b"br variant\n"
+    response, body = get_raw(f"{static_variants}/both.txt", "gzip")
+    assert response.headers['Content-Encoding'] == 'gzip'
+    assert body == b"gz variant\n"
+
+def test_gzip_static_ignores_stale_sidecar(webserver, static_variants):
+    """Test that a sidecar older than its file isn't sent"""
+    response, body = get_raw(f"{static_variants}/stale.txt", "gzip")
+    assert 'Content-Encoding' not in response.headers
+    assert body == b"plain\n"
+
+def test_gzip_static_honours_q0(webserver, static_variants):
+    """Test that an encoding refused with q=0 isn't sent, even if "*" would allow it"""
+    response, body = get_raw(f"{static_variants}/both.txt", "br;q=0, *")
+    assert response.headers['Content-Encoding'] == 'gzip'
+    response, body = get_raw(f"{static_variants}/both.txt", "gzip;q=0, br;q=0")
+    assert 'Content-Encoding' not in response.headers
+    assert body == b"plain\n"
+
+def test_gzip_static_always(webserver, static_variants):
+    """Test that gzip_static always sends file.gz to clients that don't accept gzip"""
+    response, body = get_raw(f"{static_variants}/always/file.txt", "identity")
+    assert response.headers['Content-Encoding'] == 'gzip'
+    assert body == b"gz variant\n"
+
+def test_gzip_static_vary_on_plain_response(webserver, static_variants):
+    """Test that the uncompressed file is sent with Vary too, when there are sidecars"""
+    response, body = get_raw(f"{static_variants}/both.txt", "identity")
+    assert 'Content-Encoding' not in response.headers
+    assert response.headers['Vary'] == 'Accept-Encoding'
+    assert body == b"plain\n"
+
+def test_gzip_static_range(webserver, static_variants):
+    """Test that a byte range of a sidecar is taken from the sidecar"""
+    response, body = get_raw(f"{static_variants}/both.txt", "gzip", Range='bytes=0-1')
+    assert response.status_code == 206
+    assert response.headers['Content-Encoding'] == 'gzip'
+    assert response.headers['Content-Range'] == "bytes 0-1/11"
+    assert body == b"gz"